@@ -0,0 +1,594 @@
+// Definitions shared by the mpi-analysis pass and the tools that read its results: operation classes,
+// communicator IDs, symbolic rank sets and the binary report format (mpi-analysis<format=binary>).
+
+#ifndef MPI_ANALYSIS_H
+#define MPI_ANALYSIS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace mpianalysis
+{
+    // Broad class of an MPI operation, used to decide which analyses look at a call
+    enum class MPIOpClass : uint8_t
+    {
+        PointToPoint, // Blocking/nonblocking/persistent send & receive
+        Probe,
+        Completion,
+        Collective,
+        Communicator,
+        Environment
+    };
+
+    // Every MPI entry point the pass understands. The value is the kind byte of the binary report
+    // and the pass's index into its entry-point table.
+    enum class MPIOpKind : uint8_t
+    {
+        // Blocking point-to-point
+        Send,
+        Ssend,
+        Bsend,
+        Rsend,
+        Recv,
+        Sendrecv,
+        SendrecvReplace,
+        // Nonblocking point-to-point
+        Isend,
+        Issend,
+        Ibsend,
+        Irsend,
+        Irecv,
+        // Persistent point-to-point
+        SendInit,
+        SsendInit,
+        BsendInit,
+        RsendInit,
+        RecvInit,
+        Start,
+        Startall,
+        RequestFree,
+        // Probes
+        Probe,
+        Iprobe,
+        // Completion
+        Wait,
+        Waitall,
+        Waitany,
+        Waitsome,
+        Test,
+        Testall,
+        Testany,
+        Testsome,
+        // Blocking collectives
+        Barrier,
+        Bcast,
+        Reduce,
+        Allreduce,
+        Scan,
+        Exscan,
+        ReduceScatter,
+        ReduceScatterBlock,
+        Gather,
+        Gatherv,
+        Scatter,
+        Scatterv,
+        Allgather,
+        Allgatherv,
+        Alltoall,
+        Alltoallv,
+        // Nonblocking collectives
+        Ibarrier,
+        Ibcast,
+        Ireduce,
+        Iallreduce,
+        Igather,
+        Iscatter,
+        Iallgather,
+        Ialltoall,
+        // Communicator management
+        CommRank,
+        CommSize,
+        CommSplit,
+        CommDup,
+        CommCreate,
+        CommFree,
+        // Environment
+        Init,
+        InitThread,
+        Finalize,
+        Abort,
+        NumKinds
+    };
+
+    // Interned communicator ID, an index into the module's communicator table
+    using MPICommId = uint32_t;
+    constexpr MPICommId WorldCommId = 0;      // MPI_COMM_WORLD
+    constexpr MPICommId SelfCommId = 1;       // MPI_COMM_SELF
+    constexpr MPICommId UnresolvedCommId = 2; // A handle the analysis could not trace to its origin
+
+    // Tag of a call whose tag argument could not be resolved to a constant. MPI_ANY_TAG (-1) and
+    // "no tag argument" keep their own value, so every negative tag still blocks tag-based rewrites.
+    constexpr int32_t UnknownTag = INT32_MIN;
+
+    // Prints a tag, or ? if it is not known
+    inline void printTag(llvm::raw_ostream &OS, int32_t tag)
+    {
+        if (tag == UnknownTag)
+            OS << "?";
+        else
+            OS << tag;
+    }
+
+    // Strided interval of ranks {first..last step stride}. The upper bound may be symbolic,
+    // relative to the communicator size (last = size + lastOffset), so sets such as
+    // {0..size-1} or {0..size-2 step 2} are represented without listing their members.
+    // Symbolic bounds are assumed to lie above every concrete rank in the program.
+    struct RankInterval
+    {
+        int32_t first = 0;
+        int32_t last = 0;          // Concrete upper bound, or the offset from size if lastFromSize
+        int32_t stride = 1;
+        bool lastFromSize = false;
+
+        static RankInterval single(int32_t rank) { return {rank, rank, 1, false}; }
+        static RankInterval all() { return {0, -1, 1, true}; } // {0..size-1}
+
+        bool isSingleton() const { return !lastFromSize && first == last; }
+
+        // Orders upper bounds: concrete bounds first, then size-relative ones
+        static bool boundLess(int32_t a, bool aFromSize, int32_t b, bool bFromSize)
+        {
+            if (aFromSize != bFromSize)
+                return bFromSize;
+            return a < b;
+        }
+
+        bool empty() const { return boundLess(last, lastFromSize, first, false); }
+
+        bool contains(int32_t rank) const
+        {
+            return rank >= first && !boundLess(last, lastFromSize, rank, false) &&
+                   (rank - first) % stride == 0;
+        }
+
+        // Number of members in a communicator of the given size
+        int64_t count(int32_t size) const
+        {
+            int64_t end = std::min<int64_t>(lastFromSize ? int64_t(size) + last : last, size - 1);
+            int64_t start = std::max(first, 0);
+            start += (stride - (start - first) % stride) % stride;
+            return end < start ? 0 : (end - start) / stride + 1;
+        }
+
+        void print(llvm::raw_ostream &OS) const
+        {
+            OS << first;
+            if (isSingleton())
+                return;
+            OS << "..";
+            if (lastFromSize)
+            {
+                OS << "size";
+                if (last != 0)
+                    OS << (last > 0 ? "+" : "") << last;
+            }
+            else
+                OS << last;
+            if (stride != 1)
+                OS << " step " << stride;
+        }
+    };
+
+    // Set of ranks as a normalized union of strided intervals. Union, intersection and
+    // membership work on the intervals, so their cost is independent of the job's rank count.
+    class RankSet
+    {
+        llvm::SmallVector<RankInterval, 2> intervals; // Sorted by first rank, non-overlapping after normalize()
+
+    public:
+        RankSet() = default;
+        RankSet(RankInterval interval) { insert(interval); }
+
+        void insert(RankInterval interval)
+        {
+            if (!interval.empty())
+                intervals.push_back(interval);
+        }
+
+        llvm::ArrayRef<RankInterval> getIntervals() const { return intervals; }
+        bool empty() const { return intervals.empty(); }
+        bool isSingleton() const { return intervals.size() == 1 && intervals[0].isSingleton(); }
+
+        // Number of members in a communicator of the given size (an upper bound if intervals of different strides overlap)
+        int64_t count(int32_t size) const
+        {
+            int64_t total = 0;
+            for (const RankInterval &i : intervals)
+                total += i.count(size);
+            return total;
+        }
+
+        bool contains(int32_t rank) const
+        {
+            return llvm::any_of(intervals, [rank](const RankInterval &i)
+                          { return i.contains(rank); });
+        }
+
+        RankSet unionWith(const RankSet &other) const
+        {
+            RankSet result = *this;
+            result.intervals.append(other.intervals.begin(), other.intervals.end());
+            result.normalize();
+            return result;
+        }
+
+        RankSet intersectWith(const RankSet &other) const
+        {
+            RankSet result;
+            for (const RankInterval &a : intervals)
+                for (const RankInterval &b : other.intervals)
+                    result.insert(intersect(a, b));
+            result.normalize();
+            return result;
+        }
+
+        bool intersects(const RankSet &other) const { return !intersectWith(other).empty(); }
+
+        // Sorts the intervals, merges overlapping and adjacent ones, and compresses runs of
+        // three or more equally spaced single ranks into one strided interval
+        void normalize()
+        {
+            llvm::SmallVector<RankInterval, 4> ranges;
+            llvm::SmallVector<int32_t, 8> singles;
+            for (const RankInterval &i : intervals)
+            {
+                if (i.isSingleton())
+                    singles.push_back(i.first);
+                else
+                    ranges.push_back(i);
+            }
+
+            // Merge ranges with the same stride and phase that overlap or touch
+            llvm::sort(ranges, [](const RankInterval &a, const RankInterval &b)
+                       { return std::make_tuple(a.stride, a.first % a.stride, a.first) <
+                                std::make_tuple(b.stride, b.first % b.stride, b.first); });
+            llvm::SmallVector<RankInterval, 4> merged;
+            for (const RankInterval &i : ranges)
+            {
+                if (!merged.empty())
+                {
+                    RankInterval &prev = merged.back();
+                    if (prev.stride == i.stride && prev.first % prev.stride == i.first % i.stride &&
+                        (prev.lastFromSize || i.first <= prev.last + prev.stride))
+                    {
+                        if (RankInterval::boundLess(prev.last, prev.lastFromSize, i.last, i.lastFromSize))
+                        {
+                            prev.last = i.last;
+                            prev.lastFromSize = i.lastFromSize;
+                        }
+                        continue;
+                    }
+                }
+                merged.push_back(i);
+            }
+
+            // Single ranks covered by a range, or extending one by a stride, are absorbed
+            llvm::sort(singles);
+            singles.erase(std::unique(singles.begin(), singles.end()), singles.end());
+            llvm::SmallVector<int32_t, 8> remaining;
+            for (int32_t rank : singles)
+            {
+                bool absorbed = false;
+                for (RankInterval &i : merged)
+                {
+                    if (i.contains(rank))
+                        absorbed = true;
+                    else if (rank == i.first - i.stride)
+                    {
+                        i.first = rank;
+                        absorbed = true;
+                    }
+                    else if (!i.lastFromSize && rank == i.last + i.stride)
+                    {
+                        i.last = rank;
+                        absorbed = true;
+                    }
+                    if (absorbed)
+                        break;
+                }
+                if (!absorbed)
+                    remaining.push_back(rank);
+            }
+
+            // Compress equally spaced runs of single ranks
+            for (size_t begin = 0; begin < remaining.size();)
+            {
+                size_t end = begin + 1;
+                if (end < remaining.size())
+                {
+                    int32_t step = remaining[end] - remaining[begin];
+                    while (end + 1 < remaining.size() && remaining[end + 1] - remaining[end] == step)
+                        end++;
+                    if (end - begin >= 2)
+                    {
+                        merged.push_back({remaining[begin], remaining[end], step, false});
+                        begin = end + 1;
+                        continue;
+                    }
+                }
+                merged.push_back(RankInterval::single(remaining[begin]));
+                begin++;
+            }
+
+            llvm::sort(merged, [](const RankInterval &a, const RankInterval &b)
+                       { return a.first < b.first; });
+            intervals.assign(merged.begin(), merged.end());
+        }
+
+        // Prints the set, e.g. {0, 1}, {0..size-1} or {1..7 step 2, 12}
+        void print(llvm::raw_ostream &OS) const
+        {
+            OS << "{";
+            for (size_t i = 0; i < intervals.size(); i++)
+            {
+                if (i != 0)
+                    OS << ", ";
+                intervals[i].print(OS);
+            }
+            OS << "}";
+        }
+
+    private:
+        // Intersects two strided intervals by finding the first common element of both progressions
+        static RankInterval intersect(const RankInterval &a, const RankInterval &b)
+        {
+            RankInterval result;
+            result.stride = a.stride / int32_t(llvm::GreatestCommonDivisor64(a.stride, b.stride)) * b.stride;
+            if (RankInterval::boundLess(a.last, a.lastFromSize, b.last, b.lastFromSize))
+            {
+                result.last = a.last;
+                result.lastFromSize = a.lastFromSize;
+            }
+            else
+            {
+                result.last = b.last;
+                result.lastFromSize = b.lastFromSize;
+            }
+
+            // Walk the progression with the larger stride until it meets the other one;
+            // if it does not within the smaller stride's steps, the progressions never meet
+            const RankInterval &outer = a.stride >= b.stride ? a : b;
+            const RankInterval &inner = a.stride >= b.stride ? b : a;
+            int32_t start = std::max(a.first, b.first);
+            int32_t first = outer.first + std::max(0, (start - outer.first + outer.stride - 1) / outer.stride) * outer.stride;
+            for (int32_t step = 0; step < inner.stride; step++, first += outer.stride)
+            {
+                if ((first - inner.first) % inner.stride == 0)
+                {
+                    result.first = first;
+                    return result;
+                }
+            }
+            return {1, 0, 1, false}; // Empty
+        }
+    };
+
+    // How the peer rank argument of an MPI call is expressed
+    enum class PeerKind : uint8_t
+    {
+        Unknown,         // Not resolved
+        Constant,        // A fixed rank
+        Relative,        // The calling rank plus a constant offset
+        RelativeModSize, // (The calling rank plus a constant offset) modulo the communicator size
+        Interval         // A strided interval, e.g. a loop induction variable
+    };
+
+    // Prints a rank-relative peer, e.g. rank+1 or (rank-1)%size
+    inline void printRelativePeer(llvm::raw_ostream &OS, PeerKind kind, int32_t offset)
+    {
+        if (kind == PeerKind::RelativeModSize)
+            OS << "(";
+        OS << "rank";
+        if (offset != 0)
+            OS << (offset > 0 ? "+" : "") << offset;
+        if (kind == PeerKind::RelativeModSize)
+            OS << ")%size";
+    }
+
+    // Checks whether two rank-relative peers pair a send with a receive: a send to rank+k is
+    // received by a receive from rank-k (both modulo size, or neither)
+    inline bool isMatchingShift(PeerKind kind, int32_t offset, PeerKind otherKind, int32_t otherOffset)
+    {
+        return kind == otherKind && offset == -otherOffset;
+    }
+
+    // Records of the binary report: a "MPIA" magic & u32 version, then one record per result, each a
+    // type byte followed by fixed-width little-endian fields. Strings are a u32 length & bytes, rank
+    // sets a u32 count & (i32 first, i32 last, i32 stride, u8 lastFromSize) intervals.
+    constexpr char MPIReportMagic[4] = {'M', 'P', 'I', 'A'};
+    constexpr uint32_t MPIReportVersion = 5;
+
+    enum class MPIReportRecord : uint8_t
+    {
+        Module = 1,    // str name, str sourceFile
+        Communicator,  // u32 id, u32 parent, str name, str origin
+        Function,      // str name, u32 directCalls
+        Call,          // u8 kind, u8 opClass, u8 receive, u32 comm, i32 tag, u8 peerKind, i32 peer, i32 executingRank,
+                       // u32 bytes, f32 frequency, u8 exactFrequency, rankset peerRanks, rankset worldPeerRanks,
+                       // rankset executingRanks
+        Participation, // u32 comm, i32 tag, rankset ranks, rankset worldRanks
+        Unmatched,     // u8 kind, u32 comm, i32 tag, u8 peerKind, i32 peer
+        Channel,       // u32 index, u32 comm, i32 src, u8 peerKind, i32 peer, i32 tag, u32 calls, f64 bytes, u8 exact
+        End
+    };
+
+    // Cursor over the fields of a binary report; reads past the end yield zeros and mark it failed
+    class MPIReportReader
+    {
+        llvm::StringRef data;
+        bool failed = false;
+
+    public:
+        explicit MPIReportReader(llvm::StringRef data) : data(data) {}
+
+        bool ok() const { return !failed; }
+        bool atEnd() const { return data.empty(); }
+
+        llvm::StringRef bytes(size_t size)
+        {
+            if (data.size() < size)
+            {
+                failed = true;
+                size = data.size();
+            }
+            llvm::StringRef result = data.take_front(size);
+            data = data.drop_front(size);
+            return result;
+        }
+
+        template <typename T>
+        T read()
+        {
+            llvm::StringRef field = bytes(sizeof(T));
+            if (field.size() != sizeof(T))
+                return T();
+            return llvm::support::endian::read<T, llvm::support::little, llvm::support::unaligned>(field.data());
+        }
+
+        llvm::StringRef string() { return bytes(read<uint32_t>()); }
+
+        RankSet rankSet()
+        {
+            RankSet ranks;
+            for (uint32_t count = read<uint32_t>(); count && ok(); count--)
+            {
+                RankInterval interval;
+                interval.first = read<int32_t>();
+                interval.last = read<int32_t>();
+                interval.stride = read<int32_t>();
+                interval.lastFromSize = read<uint8_t>();
+                ranks.insert(interval);
+            }
+            ranks.normalize();
+            return ranks;
+        }
+    };
+
+    // MPI call site of a binary report. Call sites are numbered by their position in the
+    // report, which is also the call-site ID given to them by mpi-instrument.
+    struct MPIReportCall
+    {
+        MPIOpKind kind;
+        MPIOpClass opClass;
+        bool receive;
+        MPICommId comm;
+        int32_t tag;            // UnknownTag if the tag argument was not resolved
+        PeerKind peerKind;
+        int32_t peer;           // Constant rank or rank offset; the first rank of interval peers
+        int32_t executingRank;
+        uint32_t bytes;
+        float frequency;
+        bool exactFrequency;
+        RankSet peerRanks;
+        RankSet worldPeerRanks; // Empty for MPI_COMM_WORLD calls & untranslatable peers
+        RankSet executingRanks; // World ranks the dominating rank guards let execute the call
+        uint32_t function;      // Index into MPIReport::functions
+    };
+
+    // Per-module contents of a binary report. The participation, unmatched-shift & hot-channel
+    // records are derived from the calls and are skipped.
+    struct MPIReport
+    {
+        std::string module;
+        std::string sourceFile;
+        std::vector<std::string> comms;     // Communicator names by ID
+        std::vector<std::string> functions; // Functions that reach MPI, in module order
+        std::vector<MPIReportCall> calls;   // Empty for quiet reports
+    };
+
+    // Function to decode a binary report
+    inline llvm::Error readMPIReport(llvm::StringRef data, MPIReport &report)
+    {
+        MPIReportReader reader(data);
+        if (reader.bytes(sizeof(MPIReportMagic)) != llvm::StringRef(MPIReportMagic, sizeof(MPIReportMagic)) ||
+            reader.read<uint32_t>() != MPIReportVersion)
+            return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                           "not an mpi-analysis report of version %u", MPIReportVersion);
+
+        while (reader.ok() && !reader.atEnd())
+        {
+            switch (MPIReportRecord(reader.read<uint8_t>()))
+            {
+            case MPIReportRecord::Module:
+                report.module = reader.string().str();
+                report.sourceFile = reader.string().str();
+                break;
+            case MPIReportRecord::Communicator:
+            {
+                uint32_t id = reader.read<uint32_t>();
+                reader.read<uint32_t>();
+                if (id >= report.comms.size())
+                    report.comms.resize(id + 1);
+                report.comms[id] = reader.string().str();
+                reader.string();
+                break;
+            }
+            case MPIReportRecord::Function:
+                report.functions.push_back(reader.string().str());
+                reader.read<uint32_t>();
+                break;
+            case MPIReportRecord::Call:
+            {
+                MPIReportCall call;
+                call.kind = MPIOpKind(reader.read<uint8_t>());
+                call.opClass = MPIOpClass(reader.read<uint8_t>());
+                call.receive = reader.read<uint8_t>();
+                call.comm = reader.read<uint32_t>();
+                call.tag = reader.read<int32_t>();
+                call.peerKind = PeerKind(reader.read<uint8_t>());
+                call.peer = reader.read<int32_t>();
+                call.executingRank = reader.read<int32_t>();
+                call.bytes = reader.read<uint32_t>();
+                call.frequency = reader.read<float>();
+                call.exactFrequency = reader.read<uint8_t>();
+                call.peerRanks = reader.rankSet();
+                call.worldPeerRanks = reader.rankSet();
+                call.executingRanks = reader.rankSet();
+                call.function = report.functions.empty() ? 0 : report.functions.size() - 1;
+                report.calls.push_back(std::move(call));
+                break;
+            }
+            case MPIReportRecord::Participation:
+                reader.bytes(sizeof(uint32_t) + sizeof(int32_t));
+                reader.rankSet();
+                reader.rankSet();
+                break;
+            case MPIReportRecord::Unmatched:
+                reader.bytes(sizeof(uint8_t) + sizeof(uint32_t) + sizeof(int32_t) + sizeof(uint8_t) + sizeof(int32_t));
+                break;
+            case MPIReportRecord::Channel:
+                reader.bytes(3 * sizeof(uint32_t) + sizeof(uint8_t) + 2 * sizeof(int32_t) + sizeof(uint32_t) +
+                             sizeof(double) + sizeof(uint8_t));
+                break;
+            case MPIReportRecord::End:
+                return llvm::Error::success();
+            default:
+                return llvm::createStringError(llvm::inconvertibleErrorCode(), "unknown record in mpi-analysis report");
+            }
+        }
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), "truncated mpi-analysis report");
+    }
+}
+
+#endif // MPI_ANALYSIS_H
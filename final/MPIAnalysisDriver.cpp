@@ -0,0 +1,531 @@
+// Whole-program driver for the mpi-analysis pass.
+//
+// Analyzes the translation units of an application concurrently and merges their MPI summaries into
+// one whole-program participation report, with rank-relative sends & receives matched across units.
+// The pass is linked into the driver; every module is parsed into its own LLVMContext on a pool of
+// worker threads, so the analysis time scales with the number of cores instead of the number of files.
+// Units analyzed at compile time are given as their binary reports (sidecar files), which are merged
+// without loading any IR.
+//
+// Usage: mpi_analysis_driver [-j N] [-cc <compiler>] [-Xcc <flag>...] [-o report]
+//                            <compile_commands.json | file.c | file.bc/.ll | - | file.mpia ...>
+//   compile_commands.json: every entry is compiled with its own flags (clang-based compilers)
+//   file.c:                C/C++ source, compiled with the -Xcc flags
+//   file.bc/.ll, -:        LLVM bitcode or textual IR (- reads it from stdin)
+//   file.mpia:             sidecar summary written by mpi-analysis<format=binary;out=file.mpia>
+//   -j:                    number of worker threads (all cores by default)
+//   -cc:                   compiler used instead of the one recorded in compile_commands.json
+//   -o:                    whole-program report file (stdout by default)
+//   -cache-dir:            persistent cache of function summaries, see mpi-analysis<cache-dir=...>
+//
+// Built with MPI_ANALYSIS_WITH_CLANG (make WITH_CLANG=1), sources are compiled by the clang frontend
+// linked into the driver and analyzed as in-memory modules; otherwise the compiler is run to produce
+// bitcode, which is then parsed back.
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef MPI_ANALYSIS_WITH_CLANG
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/CodeGen/CodeGenAction.h"
+#include "clang/Driver/Compilation.h"
+#include "clang/Driver/Driver.h"
+#include "clang/Driver/Job.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#endif
+
+#include "MPIAnalysis.h"
+
+using namespace llvm;
+using namespace mpianalysis;
+
+// Registration function of the mpi-analysis pass (MPIAnalysisPass.cpp)
+extern "C" PassPluginLibraryInfo llvmGetPassPluginInfo();
+
+namespace
+{
+    cl::list<std::string> inputs(cl::Positional, cl::OneOrMore,
+                                 cl::desc("<compile_commands.json | file.bc/.ll ...>"));
+    cl::opt<unsigned> jobs("j", cl::desc("Number of worker threads (all cores by default)"), cl::init(0));
+    cl::opt<std::string> compiler("cc", cl::desc("Compiler used instead of the one recorded in compile_commands.json"));
+    cl::list<std::string> extraArgs("Xcc", cl::desc("Compiler flag for the source files given on the command line"));
+    cl::opt<std::string> outputFile("o", cl::desc("Whole-program report file"), cl::init("-"));
+    cl::opt<std::string> cacheDir("cache-dir", cl::desc("Persistent cache of function summaries"));
+
+    // One translation unit to analyze: an IR file, or a compile command that produces one
+    struct TranslationUnit
+    {
+        std::string file;              // IR file, or the source file of the compile command
+        std::string directory;         // Working directory of the compile command
+        std::vector<std::string> args; // Compile command; empty for IR files
+        uint64_t size = 0;             // Input size, used to start the largest units first
+    };
+
+    // Point-to-point call of a translation unit, as recorded in its binary report
+    struct CallSummary
+    {
+        MPICommId comm;
+        int32_t tag;
+        PeerKind peerKind;
+        int32_t peer; // Constant rank or rank offset; the first rank of interval peers
+        bool receive;
+        RankSet peerRanks;
+        RankSet worldPeerRanks; // Empty for MPI_COMM_WORLD calls & untranslatable peers
+    };
+
+    // MPI summary of one translation unit
+    struct UnitSummary
+    {
+        std::vector<std::string> comms; // Communicator names by ID
+        std::vector<CallSummary> calls; // Point-to-point calls with a known tag
+        size_t callSites = 0;           // All MPI call sites
+        std::string error;              // Why the unit could not be analyzed
+    };
+
+    // Function to decode the communicators & point-to-point calls of a binary report
+    Error readSummary(StringRef data, UnitSummary &summary)
+    {
+        MPIReport report;
+        if (Error error = readMPIReport(data, report))
+            return error;
+
+        summary.comms = std::move(report.comms);
+        summary.callSites = report.calls.size();
+        for (MPIReportCall &call : report.calls)
+        {
+            if (call.opClass == MPIOpClass::PointToPoint && call.tag != UnknownTag)
+                summary.calls.push_back({call.comm, call.tag, call.peerKind, call.peer, call.receive,
+                                         std::move(call.peerRanks), std::move(call.worldPeerRanks)});
+        }
+        return Error::success();
+    }
+
+    // Function to read the translation units of a compile_commands.json database
+    Error readCompileCommands(StringRef path, std::vector<TranslationUnit> &units)
+    {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+        if (!buffer)
+            return errorCodeToError(buffer.getError());
+        Expected<json::Value> database = json::parse((*buffer)->getBuffer());
+        if (!database)
+            return database.takeError();
+        const json::Array *entries = database->getAsArray();
+        if (!entries)
+            return createStringError(inconvertibleErrorCode(), "%s is not an array of compile commands",
+                                     path.str().c_str());
+
+        BumpPtrAllocator allocator;
+        StringSaver saver(allocator);
+        for (const json::Value &value : *entries)
+        {
+            const json::Object *entry = value.getAsObject();
+            if (!entry)
+                continue;
+
+            TranslationUnit unit;
+            unit.directory = entry->getString("directory").getValueOr("").str();
+            SmallString<256> file(entry->getString("file").getValueOr(""));
+            sys::fs::make_absolute(unit.directory, file);
+            unit.file = file.str().str();
+
+            // The command is given either as an argument array or as one shell-quoted string
+            if (const json::Array *arguments = entry->getArray("arguments"))
+            {
+                for (const json::Value &argument : *arguments)
+                    if (Optional<StringRef> text = argument.getAsString())
+                        unit.args.push_back(text->str());
+            }
+            else if (Optional<StringRef> command = entry->getString("command"))
+            {
+                SmallVector<const char *, 32> argv;
+                cl::TokenizeGNUCommandLine(*command, saver, argv);
+                for (const char *argument : argv)
+                    unit.args.push_back(argument);
+            }
+            if (unit.args.empty())
+                continue;
+
+            sys::fs::file_size(unit.file, unit.size);
+            units.push_back(std::move(unit));
+        }
+        return Error::success();
+    }
+
+    // Function to build the compile command of a unit without its output options (-o, -c/-S & -emit-llvm).
+    // Relative paths are resolved against the command's directory with clang's -working-directory.
+    std::vector<std::string> compileArgs(const TranslationUnit &unit)
+    {
+        std::vector<std::string> args{compiler.empty() ? unit.args[0] : compiler.getValue()};
+        for (size_t i = 1; i < unit.args.size(); i++)
+        {
+            StringRef arg = unit.args[i];
+            if (arg == "-o")
+            {
+                i++;
+                continue;
+            }
+            if (arg == "-c" || arg == "-S" || arg == "-emit-llvm")
+                continue;
+            args.push_back(arg.str());
+        }
+        if (!unit.directory.empty())
+        {
+            args.push_back("-working-directory");
+            args.push_back(unit.directory);
+        }
+        return args;
+    }
+
+    // Function to find the executable of the compiler named in a compile command
+    ErrorOr<std::string> findCompiler(StringRef program)
+    {
+        if (sys::path::has_parent_path(program))
+            return program.str();
+        return sys::findProgramByName(program);
+    }
+
+#ifdef MPI_ANALYSIS_WITH_CLANG
+    // Function to compile a translation unit with the clang frontend linked into the driver. The module
+    // is generated directly into the given context, without any IR file in between.
+    Expected<std::unique_ptr<Module>> compileInProcess(const TranslationUnit &unit, LLVMContext &context)
+    {
+        std::vector<std::string> args = compileArgs(unit);
+        args.push_back("-fsyntax-only");
+        std::vector<const char *> argv;
+        for (const std::string &arg : args)
+            argv.push_back(arg.c_str());
+
+        // The clang driver turns the command into one frontend (cc1) invocation. The compiler's path
+        // is kept, so that its builtin headers (resource directory) are used.
+        ErrorOr<std::string> executable = findCompiler(args[0]);
+        IntrusiveRefCntPtr<clang::DiagnosticOptions> diagnosticOptions = new clang::DiagnosticOptions();
+        clang::DiagnosticsEngine diagnostics(new clang::DiagnosticIDs(), &*diagnosticOptions,
+                                             new clang::TextDiagnosticPrinter(errs(), &*diagnosticOptions));
+        clang::driver::Driver driver(executable ? *executable : args[0], sys::getDefaultTargetTriple(), diagnostics);
+        driver.setCheckInputsExist(false);
+        std::unique_ptr<clang::driver::Compilation> compilation(driver.BuildCompilation(argv));
+        if (!compilation || compilation->getJobs().size() != 1 ||
+            !isa<clang::driver::Command>(*compilation->getJobs().begin()))
+            return createStringError(inconvertibleErrorCode(), "compile command does not map to one frontend job");
+        const clang::driver::Command &job = cast<clang::driver::Command>(*compilation->getJobs().begin());
+
+        auto invocation = std::make_shared<clang::CompilerInvocation>();
+        if (!clang::CompilerInvocation::CreateFromArgs(*invocation, job.getArguments(), diagnostics, argv[0]))
+            return createStringError(inconvertibleErrorCode(), "invalid compile command");
+
+        clang::CompilerInstance instance;
+        instance.setInvocation(std::move(invocation));
+        instance.createDiagnostics();
+        clang::EmitLLVMOnlyAction action(&context);
+        if (!instance.ExecuteAction(action))
+            return createStringError(inconvertibleErrorCode(), "compilation failed");
+        return action.takeModule();
+    }
+#else
+    // Function to compile a translation unit to a bitcode file by running its compiler
+    Error compileToBitcode(const TranslationUnit &unit, StringRef bitcodePath)
+    {
+        std::vector<std::string> args = compileArgs(unit);
+        for (const char *arg : {"-c", "-emit-llvm", "-o"})
+            args.push_back(arg);
+        args.push_back(bitcodePath.str());
+
+        ErrorOr<std::string> executable = findCompiler(args[0]);
+        if (!executable)
+            return createStringError(executable.getError(), "cannot find compiler %s", args[0].c_str());
+
+        std::vector<StringRef> argv(args.begin(), args.end());
+        std::string message;
+        int status = sys::ExecuteAndWait(*executable, argv, None, {}, 0, 0, &message);
+        if (status != 0)
+            return createStringError(inconvertibleErrorCode(), "compilation failed%s%s",
+                                     message.empty() ? "" : ": ", message.c_str());
+        return Error::success();
+    }
+#endif
+
+    // Function to analyze one translation unit in its own LLVMContext
+    UnitSummary analyzeUnit(const TranslationUnit &unit, const PassPluginLibraryInfo &pluginInfo)
+    {
+        UnitSummary summary;
+        auto fail = [&](Error error)
+        {
+            summary.error = toString(std::move(error));
+            return std::move(summary);
+        };
+
+        // Sidecar summaries were analyzed when the unit was compiled
+        if (sys::path::extension(unit.file) == ".mpia")
+        {
+            ErrorOr<std::unique_ptr<MemoryBuffer>> report = MemoryBuffer::getFile(unit.file);
+            if (!report)
+                return fail(errorCodeToError(report.getError()));
+            if (Error error = readSummary((*report)->getBuffer(), summary))
+                return fail(std::move(error));
+            return summary;
+        }
+
+        SmallString<128> reportPath;
+        if (std::error_code EC = sys::fs::createTemporaryFile("mpi-analysis", "mpia", reportPath))
+            return fail(errorCodeToError(EC));
+        FileRemover reportRemover(reportPath);
+
+        LLVMContext context;
+        std::unique_ptr<Module> M;
+        StringRef irPath = unit.file;
+#ifdef MPI_ANALYSIS_WITH_CLANG
+        if (!unit.args.empty())
+        {
+            Expected<std::unique_ptr<Module>> compiled = compileInProcess(unit, context);
+            if (!compiled)
+                return fail(compiled.takeError());
+            M = std::move(*compiled);
+        }
+#else
+        SmallString<128> bitcodePath;
+        Optional<FileRemover> bitcodeRemover;
+        if (!unit.args.empty())
+        {
+            if (std::error_code EC = sys::fs::createTemporaryFile("mpi-analysis", "bc", bitcodePath))
+                return fail(errorCodeToError(EC));
+            bitcodeRemover.emplace(bitcodePath);
+            if (Error error = compileToBitcode(unit, bitcodePath))
+                return fail(std::move(error));
+            irPath = bitcodePath;
+        }
+#endif
+        if (!M)
+        {
+            SMDiagnostic diagnostic;
+            M = parseIRFile(irPath, diagnostic, context);
+            if (!M)
+                return fail(createStringError(inconvertibleErrorCode(), diagnostic.getMessage()));
+        }
+
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+        PassBuilder PB;
+        pluginInfo.RegisterPassBuilderCallbacks(PB);
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        // The pass streams its summary as a binary report, which is decoded once the pass is done
+        ModulePassManager MPM;
+        std::string pipeline = ("mpi-analysis<format=binary;out=" + reportPath).str();
+        if (!cacheDir.empty())
+            pipeline += ";cache-dir=" + cacheDir;
+        if (Error error = PB.parsePassPipeline(MPM, pipeline + ">"))
+            return fail(std::move(error));
+        MPM.run(*M, MAM);
+
+        ErrorOr<std::unique_ptr<MemoryBuffer>> report = MemoryBuffer::getFile(reportPath);
+        if (!report)
+            return fail(errorCodeToError(report.getError()));
+        if (Error error = readSummary((*report)->getBuffer(), summary))
+            return fail(std::move(error));
+        return summary;
+    }
+
+    // (comm, tag) group of the whole program
+    struct ParticipationGroup
+    {
+        std::string comm;
+        int32_t tag = 0;
+        RankSet ranks, worldRanks;
+        bool translated = true; // Whether every peer could be translated to world ranks
+        unsigned units = 0;     // Number of translation units with calls in the group
+        size_t lastUnit = ~size_t(0);
+        std::vector<std::pair<const CallSummary *, size_t>> shifts; // Rank-relative calls & their units
+    };
+
+    // Function to match the rank-relative sends & receives of a group across all units
+    void reportUnmatchedShifts(const ParticipationGroup &group, ArrayRef<TranslationUnit> units, raw_ostream &OS)
+    {
+        auto hasSide = [&](bool receive)
+        {
+            return any_of(group.shifts, [receive](const std::pair<const CallSummary *, size_t> &shift)
+                          { return shift.first->receive == receive; });
+        };
+        if (!hasSide(false) || !hasSide(true))
+            return; // One-sided groups are matched by constant-rank calls we cannot pair symbolically
+
+        for (const auto &shift : group.shifts)
+        {
+            const CallSummary &call = *shift.first;
+            bool matched = any_of(group.shifts, [&call](const std::pair<const CallSummary *, size_t> &other)
+                                  { return other.first->receive != call.receive &&
+                                           isMatchingShift(call.peerKind, call.peer, other.first->peerKind, other.first->peer); });
+            if (matched)
+                continue;
+
+            OS << "[WARN] " << (call.receive ? "Receive from " : "Send to ");
+            printRelativePeer(OS, call.peerKind, call.peer);
+            OS << " in Comm " << group.comm << " with Tag " << group.tag << " (" << units[shift.second].file
+               << ") has no matching " << (call.receive ? "send" : "receive") << "\n";
+        }
+    }
+
+    // Function to merge the per-unit summaries into (comm, tag) groups and output the whole-program report.
+    // MPI_COMM_WORLD & MPI_COMM_SELF are shared by all units; other communicators are created (or left
+    // unresolved) inside one unit, so their groups stay per unit & are named after it.
+    void reportParticipation(ArrayRef<TranslationUnit> units, ArrayRef<UnitSummary> summaries, raw_ostream &OS)
+    {
+        std::map<std::tuple<size_t, MPICommId, int32_t>, ParticipationGroup> groups;
+        for (size_t u = 0; u < summaries.size(); u++)
+        {
+            const UnitSummary &summary = summaries[u];
+            for (const CallSummary &call : summary.calls)
+            {
+                bool predefined = call.comm == WorldCommId || call.comm == SelfCommId;
+                ParticipationGroup &group = groups[std::make_tuple(predefined ? 0 : u + 1, call.comm, call.tag)];
+                if (group.comm.empty())
+                {
+                    StringRef name = call.comm < summary.comms.size() ? StringRef(summary.comms[call.comm]) : "<unknown>";
+                    group.comm = predefined ? name.str() : (units[u].file + ":" + name).str();
+                    group.tag = call.tag;
+                }
+                if (group.lastUnit != u)
+                {
+                    group.units++;
+                    group.lastUnit = u;
+                }
+
+                group.ranks = group.ranks.unionWith(call.peerRanks);
+                if (call.peerKind == PeerKind::Relative || call.peerKind == PeerKind::RelativeModSize)
+                    group.shifts.emplace_back(&call, u);
+                if (call.comm == WorldCommId)
+                    continue;
+                group.translated &= !call.worldPeerRanks.empty();
+                group.worldRanks = group.worldRanks.unionWith(call.worldPeerRanks);
+            }
+        }
+
+        // If more than one rank is involved in a (comm, tag) pair, report it as uniform participation
+        for (const auto &entry : groups)
+        {
+            const ParticipationGroup &group = entry.second;
+            if (!group.ranks.empty() && !group.ranks.isSingleton())
+            {
+                OS << "[INFO] Uniform Participation Detected in Comm " << group.comm << " with Tag " << group.tag
+                   << " involving Ranks: ";
+                group.ranks.print(OS);
+                OS << " across " << group.units << " translation unit(s)\n";
+                if (std::get<1>(entry.first) != WorldCommId)
+                {
+                    OS << "- World Ranks: ";
+                    if (group.translated && !group.worldRanks.empty())
+                        group.worldRanks.print(OS);
+                    else
+                        OS << "unknown";
+                    OS << "\n";
+                }
+            }
+
+            reportUnmatchedShifts(group, units, OS);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "Whole-program MPI participation analysis\n");
+
+    std::vector<TranslationUnit> units;
+    for (const std::string &input : inputs)
+    {
+        if (StringRef(input).endswith(".json"))
+        {
+            if (Error error = readCompileCommands(input, units))
+            {
+                errs() << "[ERROR] " << input << ": " << toString(std::move(error)) << "\n";
+                return 1;
+            }
+            continue;
+        }
+
+        // Source files are compiled like a compile command in the current directory
+        TranslationUnit unit;
+        unit.file = input;
+        sys::fs::file_size(input, unit.size);
+        StringRef extension = sys::path::extension(input);
+        if (extension == ".c" || extension == ".cc" || extension == ".cpp" || extension == ".cxx")
+        {
+            unit.args.push_back("clang");
+            unit.args.insert(unit.args.end(), extraArgs.begin(), extraArgs.end());
+            unit.args.push_back(input);
+        }
+        units.push_back(std::move(unit));
+    }
+
+    // The largest units are started first, so that no long unit is left running alone at the end
+    std::vector<size_t> order(units.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    llvm::stable_sort(order, [&](size_t a, size_t b)
+                      { return units[a].size > units[b].size; });
+
+    auto start = std::chrono::steady_clock::now();
+    PassPluginLibraryInfo pluginInfo = llvmGetPassPluginInfo();
+    std::vector<UnitSummary> summaries(units.size());
+    ThreadPool pool(hardware_concurrency(jobs));
+    for (size_t i : order)
+    {
+        pool.async([&, i]
+                   { summaries[i] = analyzeUnit(units[i], pluginInfo); });
+    }
+    pool.wait();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0, callSites = 0;
+    for (size_t i = 0; i < units.size(); i++)
+    {
+        callSites += summaries[i].callSites;
+        if (summaries[i].error.empty())
+            continue;
+        errs() << "[ERROR] " << units[i].file << ": " << summaries[i].error << "\n";
+        failed++;
+    }
+
+    std::error_code EC;
+    raw_fd_ostream OS(outputFile, EC, sys::fs::OF_Text);
+    if (EC)
+    {
+        errs() << "[ERROR] Cannot write " << outputFile << ": " << EC.message() << "\n";
+        return 1;
+    }
+    OS << "[INFO] Whole-program analysis of " << units.size() - failed << " translation unit(s), " << callSites
+       << " MPI call site(s), in " << format("%.2f", elapsed) << " s on " << pool.getThreadCount() << " thread(s)\n";
+    reportParticipation(units, summaries, OS);
+    return failed ? 1 : 0;
+}
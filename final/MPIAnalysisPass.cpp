@@ -1,138 +1,5320 @@
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/IR/PatternMatch.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 #include <map>
-#include <set>
 #include <vector>
 
+#include "MPIAnalysis.h"
+
 using namespace llvm;
+using namespace mpianalysis;
+
+#define DEBUG_TYPE "mpi-analysis"
+
+// Counters of the passes. They are TrackingStatistics rather than STATISTICs, so they also count in release
+// builds of LLVM: printed by opt -stats if LLVM has assertions enabled, and by mpi_bench in any case.
+#define MPI_STATISTIC(VARNAME, DESC) static TrackingStatistic VARNAME = {DEBUG_TYPE, #VARNAME, DESC}
+MPI_STATISTIC(NumCallSites, "MPI call sites summarized");
+MPI_STATISTIC(NumFunctionsSummarized, "Functions with MPI calls summarized");
+MPI_STATISTIC(NumSummaryCacheHits, "Function summaries read from the summary cache");
+MPI_STATISTIC(NumParticipationGroups, "(comm, tag) groups with uniform participation");
+MPI_STATISTIC(NumInstrumentedSites, "MPI call sites instrumented");
+MPI_STATISTIC(NumCoalescedRuns, "Runs of MPI_Send calls coalesced");
+MPI_STATISTIC(NumOverlappedCalls, "Blocking calls overlapped with computation");
+MPI_STATISTIC(NumRewrittenCollectives, "Point-to-point patterns rewritten into collectives");
+MPI_STATISTIC(NumFusedRuns, "Runs of collectives fused");
+MPI_STATISTIC(NumPersistentRequests, "Sends & receives turned into persistent requests");
+
+namespace
+{
+    // Timer group of the mpi-analysis phases (detection, participation & reporting), printed by opt -time-passes
+    // and read by mpi_bench
+    constexpr const char *PhaseTimerGroup = "mpi-analysis";
+    constexpr const char *PhaseTimerGroupDescription = "MPI analysis phases";
+
+    // Static description of one MPI entry point: its name and the positions of the
+    // arguments the analysis reads (-1 when the function has no such argument).
+    struct MPIEntryPoint
+    {
+        const char *name;
+        MPIOpKind kind;
+        MPIOpClass opClass;
+        int8_t countArg;    // Element count
+        int8_t datatypeArg; // MPI_Datatype
+        int8_t peerArg;     // Destination/source rank, or the root of a rooted collective
+        int8_t tagArg;      // Message tag
+        int8_t commArg;     // Communicator
+    };
+
+    // Table of all MPI entry points, indexed by MPIOpKind
+    const MPIEntryPoint mpiEntryPoints[] = {
+        {"MPI_Send", MPIOpKind::Send, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Ssend", MPIOpKind::Ssend, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Bsend", MPIOpKind::Bsend, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Rsend", MPIOpKind::Rsend, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Recv", MPIOpKind::Recv, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Sendrecv", MPIOpKind::Sendrecv, MPIOpClass::PointToPoint, 1, 2, 3, 4, 10},
+        {"MPI_Sendrecv_replace", MPIOpKind::SendrecvReplace, MPIOpClass::PointToPoint, 1, 2, 3, 4, 7},
+        {"MPI_Isend", MPIOpKind::Isend, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Issend", MPIOpKind::Issend, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Ibsend", MPIOpKind::Ibsend, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Irsend", MPIOpKind::Irsend, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Irecv", MPIOpKind::Irecv, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Send_init", MPIOpKind::SendInit, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Ssend_init", MPIOpKind::SsendInit, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Bsend_init", MPIOpKind::BsendInit, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Rsend_init", MPIOpKind::RsendInit, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Recv_init", MPIOpKind::RecvInit, MPIOpClass::PointToPoint, 1, 2, 3, 4, 5},
+        {"MPI_Start", MPIOpKind::Start, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Startall", MPIOpKind::Startall, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Request_free", MPIOpKind::RequestFree, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Probe", MPIOpKind::Probe, MPIOpClass::Probe, -1, -1, 0, 1, 2},
+        {"MPI_Iprobe", MPIOpKind::Iprobe, MPIOpClass::Probe, -1, -1, 0, 1, 2},
+        {"MPI_Wait", MPIOpKind::Wait, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Waitall", MPIOpKind::Waitall, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Waitany", MPIOpKind::Waitany, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Waitsome", MPIOpKind::Waitsome, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Test", MPIOpKind::Test, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Testall", MPIOpKind::Testall, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Testany", MPIOpKind::Testany, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Testsome", MPIOpKind::Testsome, MPIOpClass::Completion, -1, -1, -1, -1, -1},
+        {"MPI_Barrier", MPIOpKind::Barrier, MPIOpClass::Collective, -1, -1, -1, -1, 0},
+        {"MPI_Bcast", MPIOpKind::Bcast, MPIOpClass::Collective, 1, 2, 3, -1, 4},
+        {"MPI_Reduce", MPIOpKind::Reduce, MPIOpClass::Collective, 2, 3, 5, -1, 6},
+        {"MPI_Allreduce", MPIOpKind::Allreduce, MPIOpClass::Collective, 2, 3, -1, -1, 5},
+        {"MPI_Scan", MPIOpKind::Scan, MPIOpClass::Collective, 2, 3, -1, -1, 5},
+        {"MPI_Exscan", MPIOpKind::Exscan, MPIOpClass::Collective, 2, 3, -1, -1, 5},
+        {"MPI_Reduce_scatter", MPIOpKind::ReduceScatter, MPIOpClass::Collective, -1, 3, -1, -1, 5},
+        {"MPI_Reduce_scatter_block", MPIOpKind::ReduceScatterBlock, MPIOpClass::Collective, 2, 3, -1, -1, 5},
+        {"MPI_Gather", MPIOpKind::Gather, MPIOpClass::Collective, 1, 2, 6, -1, 7},
+        {"MPI_Gatherv", MPIOpKind::Gatherv, MPIOpClass::Collective, 1, 2, 7, -1, 8},
+        {"MPI_Scatter", MPIOpKind::Scatter, MPIOpClass::Collective, 4, 5, 6, -1, 7},
+        {"MPI_Scatterv", MPIOpKind::Scatterv, MPIOpClass::Collective, 5, 6, 7, -1, 8},
+        {"MPI_Allgather", MPIOpKind::Allgather, MPIOpClass::Collective, 1, 2, -1, -1, 6},
+        {"MPI_Allgatherv", MPIOpKind::Allgatherv, MPIOpClass::Collective, 1, 2, -1, -1, 7},
+        {"MPI_Alltoall", MPIOpKind::Alltoall, MPIOpClass::Collective, 1, 2, -1, -1, 6},
+        {"MPI_Alltoallv", MPIOpKind::Alltoallv, MPIOpClass::Collective, -1, 3, -1, -1, 8},
+        {"MPI_Ibarrier", MPIOpKind::Ibarrier, MPIOpClass::Collective, -1, -1, -1, -1, 0},
+        {"MPI_Ibcast", MPIOpKind::Ibcast, MPIOpClass::Collective, 1, 2, 3, -1, 4},
+        {"MPI_Ireduce", MPIOpKind::Ireduce, MPIOpClass::Collective, 2, 3, 5, -1, 6},
+        {"MPI_Iallreduce", MPIOpKind::Iallreduce, MPIOpClass::Collective, 2, 3, -1, -1, 5},
+        {"MPI_Igather", MPIOpKind::Igather, MPIOpClass::Collective, 1, 2, 6, -1, 7},
+        {"MPI_Iscatter", MPIOpKind::Iscatter, MPIOpClass::Collective, 4, 5, 6, -1, 7},
+        {"MPI_Iallgather", MPIOpKind::Iallgather, MPIOpClass::Collective, 1, 2, -1, -1, 6},
+        {"MPI_Ialltoall", MPIOpKind::Ialltoall, MPIOpClass::Collective, 1, 2, -1, -1, 6},
+        {"MPI_Comm_rank", MPIOpKind::CommRank, MPIOpClass::Communicator, -1, -1, -1, -1, 0},
+        {"MPI_Comm_size", MPIOpKind::CommSize, MPIOpClass::Communicator, -1, -1, -1, -1, 0},
+        {"MPI_Comm_split", MPIOpKind::CommSplit, MPIOpClass::Communicator, -1, -1, -1, -1, 0},
+        {"MPI_Comm_dup", MPIOpKind::CommDup, MPIOpClass::Communicator, -1, -1, -1, -1, 0},
+        {"MPI_Comm_create", MPIOpKind::CommCreate, MPIOpClass::Communicator, -1, -1, -1, -1, 0},
+        {"MPI_Comm_free", MPIOpKind::CommFree, MPIOpClass::Communicator, -1, -1, -1, -1, -1},
+        {"MPI_Init", MPIOpKind::Init, MPIOpClass::Environment, -1, -1, -1, -1, -1},
+        {"MPI_Init_thread", MPIOpKind::InitThread, MPIOpClass::Environment, -1, -1, -1, -1, -1},
+        {"MPI_Finalize", MPIOpKind::Finalize, MPIOpClass::Environment, -1, -1, -1, -1, -1},
+        {"MPI_Abort", MPIOpKind::Abort, MPIOpClass::Environment, -1, -1, -1, -1, 0},
+    };
+    static_assert(sizeof(mpiEntryPoints) / sizeof(mpiEntryPoints[0]) == size_t(MPIOpKind::NumKinds),
+                  "mpiEntryPoints must have one entry per MPIOpKind");
+
+    // Returns the static description of the given operation kind
+    const MPIEntryPoint &getEntryPoint(MPIOpKind kind)
+    {
+        return mpiEntryPoints[size_t(kind)];
+    }
+
+    // Checks whether the peer argument of an MPI call names the source of a message
+    inline bool isReceive(MPIOpKind kind)
+    {
+        return kind == MPIOpKind::Recv || kind == MPIOpKind::Irecv || kind == MPIOpKind::RecvInit;
+    }
+
+    // Wildcard tag of receives and probes (MPI_ANY_TAG is -1 in every MPI; the wildcard source depends on
+    // the MPI, see MPIEntryPointTable::getAnySource)
+    constexpr int32_t AnyTagValue = -1;
+
+    // Packs a (comm, tag) pair into one 64-bit key that sorts by communicator, then by signed tag
+    inline uint64_t packCommTag(MPICommId comm, int32_t tag)
+    {
+        return (uint64_t(comm) << 32) | (uint32_t(tag) ^ 0x80000000u);
+    }
+
+    inline MPICommId unpackComm(uint64_t key) { return MPICommId(key >> 32); }
+    inline int32_t unpackTag(uint64_t key) { return int32_t(uint32_t(key) ^ 0x80000000u); }
+
+    // Packed MPI communication record: operation kind, communicator, tag, and rank.
+    // Records hold no heap data; the call name comes from the entry point table.
+    struct MPICommunication
+    {
+        int32_t tag = -1;             // Tag associated with the MPI call (-1 if none, UnknownTag if not resolved)
+        int32_t rank = -1;            // Peer rank, offset from the calling rank, or index of the peer's RankInterval
+        MPICommId comm = WorldCommId; // Communicator the call uses
+        int32_t executingRank = -1;   // World rank that executes the call, from a dominating rank guard (-1 if unknown)
+        uint32_t executingRanks = 0;  // Index of the first interval of the executing world ranks in the rank-interval arena
+        uint32_t bytes = 0;           // Estimated message bytes per execution, count * datatype size (0 if unknown)
+        float frequency = 1;          // Estimated executions per invocation of the enclosing function
+        MPIOpKind kind;               // Operation kind of the MPI call
+        PeerKind peerKind = PeerKind::Unknown; // How rank is to be interpreted
+        bool exactFrequency = true;   // Whether frequency comes from constant loop trip counts, not a BFI estimate
+        uint8_t executingIntervals = 0; // Number of executing-rank intervals; 0 if the guards allow every rank
+    };
+    static_assert(sizeof(MPICommunication) <= 32, "MPICommunication should stay packed");
+
+    // Returns the size in bytes of a predefined MPI datatype handle, or 0 if it is not known
+    inline unsigned getDatatypeSize(const Value *datatype)
+    {
+        datatype = datatype->stripPointerCasts();
+
+        // MPICH encodes the size of builtin datatypes in bits 8-15 of the integer handle
+        if (auto *handle = dyn_cast<ConstantInt>(datatype))
+        {
+            uint64_t value = handle->getZExtValue();
+            return (value & 0xff000000) == 0x4c000000 ? (value >> 8) & 0xff : 0;
+        }
+
+        // Open MPI & LAM pass the address of a predefined datatype object, e.g. ompi_mpi_int
+        auto *global = dyn_cast<GlobalValue>(datatype);
+        if (!global)
+            return 0;
+        StringRef name = global->getName();
+        size_t prefix = name.rfind("mpi_");
+        if (prefix == StringRef::npos)
+            return 0;
+        return StringSwitch<unsigned>(name.drop_front(prefix + 4))
+            .Cases("char", "signed_char", "unsigned_char", "byte", "packed", "int8_t", "uint8_t", "c_bool", 1)
+            .Cases("short", "unsigned_short", "int16_t", "uint16_t", 2)
+            .Cases("int", "unsigned", "float", "int32_t", "uint32_t", "wchar", 4)
+            .Cases("long", "unsigned_long", "long_long_int", "long_long", "unsigned_long_long", 8)
+            .Cases("double", "int64_t", "uint64_t", "aint", "offset", "count", 8)
+            .Cases("float_int", "2int", 8)
+            .Cases("long_int", "double_int", "c_float_complex", "c_complex", 16)
+            .Cases("long_double", "c_double_complex", "c_long_double_complex", 16)
+            .Default(0);
+    }
+
+    // Returns the world ranks the rank guards dominating a call let execute it
+    inline RankSet getExecutingRanks(const MPICommunication &call, ArrayRef<RankInterval> rankIntervals)
+    {
+        if (!call.executingIntervals)
+            return RankInterval::all();
+        RankSet ranks;
+        for (const RankInterval &interval : rankIntervals.slice(call.executingRanks, call.executingIntervals))
+            ranks.insert(interval);
+        ranks.normalize();
+        return ranks;
+    }
+
+    // Returns the ranks the peer argument of a call may name, assuming every rank of the communicator executes it
+    inline RankSet getPeerRanks(const MPICommunication &call, ArrayRef<RankInterval> rankIntervals)
+    {
+        switch (call.peerKind)
+        {
+        case PeerKind::Constant:
+            return RankInterval::single(call.rank);
+        case PeerKind::Relative:
+            // rank+k is a valid rank for {k..size-1} (k >= 0) or {0..size-1+k} (k < 0)
+            return call.rank >= 0 ? RankInterval{call.rank, -1, 1, true} : RankInterval{0, call.rank - 1, 1, true};
+        case PeerKind::RelativeModSize:
+            return RankInterval::all();
+        case PeerKind::Interval:
+            return rankIntervals[call.rank];
+        case PeerKind::Unknown:
+            break;
+        }
+        return RankSet();
+    }
+
+    // Prints the peer argument of a call, e.g. 3, rank+1, (rank-1)%size or {1..size-1}
+    inline void printPeer(raw_ostream &OS, const MPICommunication &call, ArrayRef<RankInterval> rankIntervals)
+    {
+        switch (call.peerKind)
+        {
+        case PeerKind::Constant:
+            OS << call.rank;
+            break;
+        case PeerKind::Relative:
+        case PeerKind::RelativeModSize:
+            printRelativePeer(OS, call.peerKind, call.rank);
+            break;
+        case PeerKind::Interval:
+            OS << "{";
+            rankIntervals[call.rank].print(OS);
+            OS << "}";
+            break;
+        case PeerKind::Unknown:
+            OS << "?";
+            break;
+        }
+    }
+
+    // How MPI_Comm_split assigns the ranks of the parent communicator to groups
+    enum class ColorKind : uint8_t
+    {
+        Unknown,  // Not modelled; local ranks cannot be translated
+        Identity, // One group with the parent's rank order (MPI_Comm_dup, or a constant color)
+        RankMod,  // color = rank % colorArg: the group of rank r is {r % m, r % m + m, ...}
+        RankDiv   // color = rank / colorArg: the group of rank r is {r / d * d .. r / d * d + d - 1}
+    };
+
+    // A communicator known to the analysis and how its ranks relate to its parent's
+    struct MPICommunicator
+    {
+        std::string name;                    // Display name, e.g. "MPI_COMM_WORLD" or "comm#3"
+        std::string origin;                  // How the communicator was created, for reports
+        MPICommId parent = WorldCommId;      // Communicator it was derived from
+        ColorKind color = ColorKind::Unknown;
+        int32_t colorArg = 0;                // Modulus or divisor of the color expression
+
+        // Translates a rank local to this communicator to the parent's ranks, given the
+        // parent rank that executes the call (-1 if unknown)
+        RankSet toParentRanks(int32_t local, int32_t executingRank) const
+        {
+            switch (color)
+            {
+            case ColorKind::Identity:
+                return RankInterval::single(local);
+            case ColorKind::RankMod:
+                if (executingRank >= 0)
+                    return RankInterval::single(executingRank % colorArg + local * colorArg);
+                return RankInterval{local * colorArg, local * colorArg + colorArg - 1, 1, false};
+            case ColorKind::RankDiv:
+                if (executingRank >= 0)
+                    return RankInterval::single(executingRank / colorArg * colorArg + local);
+                return RankInterval{local, -1, colorArg, true};
+            case ColorKind::Unknown:
+                break;
+            }
+            return RankSet();
+        }
+    };
+
+    // The MPI entry points declared in a module and the call sites that reach them.
+    // Resolved once per module from the declarations' use lists.
+    struct MPIEntryPointTable
+    {
+        DenseMap<Function *, MPIOpKind> kinds;                          // Declaration -> operation kind
+        DenseMap<const Function *, SmallVector<CallBase *, 4>> callSites; // Caller -> MPI call sites in program order
+        std::vector<Function *> callers;                                // Functions with MPI calls, in module order
+        std::vector<MPICommunicator> comms;                             // Interned communicators, indexed by MPICommId
+        DenseMap<const Value *, MPICommId> commSlots;                   // Handle slot -> communicator created into it
+        bool integerHandles = false;                                    // Handles are integers (MPICH), not pointers
+
+        MPIEntryPointTable()
+        {
+            comms.push_back({"MPI_COMM_WORLD", "predefined", WorldCommId, ColorKind::Identity, 0});
+            comms.push_back({"MPI_COMM_SELF", "predefined", WorldCommId, ColorKind::Unknown, 0});
+            comms.push_back({"<unresolved>", "handle not traced to its origin", WorldCommId, ColorKind::Unknown, 0});
+        }
+
+        // Returns the name of an interned communicator
+        StringRef getCommName(MPICommId id) const { return comms[id].name; }
+
+        // Returns the rank values of MPI_ANY_SOURCE & MPI_PROC_NULL: -2 & -1 where handles are integers
+        // (MPICH), -1 & -2 in Open MPI, LAM & the stub MPI
+        int32_t getAnySource() const { return integerHandles ? -2 : -1; }
+        int32_t getProcNull() const { return integerHandles ? -1 : -2; }
+
+        // Resolves a communicator handle argument through loads, stores and copies to the
+        // communicator it denotes. Results are memoized per handle value.
+        MPICommId resolveComm(const Value *handle) const;
+
+        // Registers the communicator created by an MPI_Comm_split/MPI_Comm_dup/MPI_Comm_create call
+        void addCommunicator(CallBase &call, MPIOpKind kind);
+
+        // Translates a rank local to a communicator to world ranks (empty if the mapping is not known)
+        RankSet toWorldRanks(MPICommId comm, int32_t local, int32_t executingRank) const
+        {
+            if (comm == WorldCommId)
+                return RankInterval::single(local);
+            if (comm == SelfCommId)
+                return executingRank >= 0 ? RankSet(RankInterval::single(executingRank)) : RankSet();
+
+            // Splits of splits are only translated through identity parents, whose ranks are world ranks
+            const MPICommunicator &c = comms[comm];
+            for (MPICommId parent = c.parent; parent != WorldCommId; parent = comms[parent].parent)
+            {
+                if (comms[parent].color != ColorKind::Identity)
+                    return RankSet();
+            }
+            return c.toParentRanks(local, executingRank);
+        }
+
+        // Checks whether V is a load of the value written by an MPI_Comm_rank/MPI_Comm_size call,
+        // optionally returning the communicator that was queried
+        bool isCommQueryResult(const Value *V, MPIOpKind kind, MPICommId *queried = nullptr) const
+        {
+            auto *load = dyn_cast<LoadInst>(V->stripPointerCasts());
+            if (!load)
+                return false;
+
+            const Value *slot = load->getPointerOperand()->stripPointerCasts();
+            for (const User *user : slot->users())
+            {
+                auto *call = dyn_cast<CallBase>(user);
+                if (!call)
+                {
+                    // The slot may reach the call through a bitcast
+                    if (auto *cast = dyn_cast<CastInst>(user))
+                        if (cast->hasOneUse())
+                            call = dyn_cast<CallBase>(*cast->user_begin());
+                }
+                if (call && call->arg_size() > 1 && call->getArgOperand(1)->stripPointerCasts() == slot &&
+                    lookup(*call) == kind)
+                {
+                    if (queried)
+                        *queried = resolveComm(call->getArgOperand(0));
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Returns the operation kind of a call, or None if it does not call an MPI entry point
+        Optional<MPIOpKind> lookup(const CallBase &call) const
+        {
+            auto it = kinds.find(call.getCalledFunction());
+            if (it == kinds.end())
+                return None;
+            return it->second;
+        }
+
+    private:
+        mutable DenseMap<const Value *, MPICommId> commCache; // Memoized resolveComm results
+
+    public:
+        // Handles invalidation: function analyses read the table through the outer proxy, so (like
+        // GlobalsAA) it is kept until a pass explicitly abandons it, whatever else PA invalidates. The
+        // passes of this plugin that add, remove or retarget MPI calls abandon MPIEntryPointAnalysis;
+        // other passes that do (inlining, dead code elimination, unrolling) are not detected and leave
+        // the table stale, so mpi-analysis should run before them in a pipeline.
+        bool invalidate(Module &, const PreservedAnalyses &PA, ModuleAnalysisManager::Invalidator &);
+    };
+
+    // Module analysis that builds the MPIEntryPointTable
+    struct MPIEntryPointAnalysis : public AnalysisInfoMixin<MPIEntryPointAnalysis>
+    {
+        using Result = MPIEntryPointTable;
+
+        // Function that resolves the MPI declarations of module M and collects their call sites
+        Result run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            Result table;
+
+            // Resolve each MPI entry point (and its PMPI_ profiling alias) once
+            for (const MPIEntryPoint &entry : mpiEntryPoints)
+            {
+                StringRef name(entry.name);
+                for (Function *F : {M.getFunction(name), M.getFunction(("P" + name).str())})
+                {
+                    if (!F)
+                        continue;
+                    table.kinds[F] = entry.kind;
+                    if (entry.commArg >= 0 && unsigned(entry.commArg) < F->arg_size() &&
+                        F->getArg(entry.commArg)->getType()->isIntegerTy())
+                        table.integerHandles = true;
+                }
+            }
+
+            // Visit only the direct call sites of the resolved declarations
+            for (const auto &entry : table.kinds)
+            {
+                for (User *user : entry.first->users())
+                {
+                    auto *call = dyn_cast<CallBase>(user);
+                    if (!call || call->getCalledFunction() != entry.first)
+                        continue; // The address of the function is taken, not called
+
+                    table.callSites[call->getFunction()].push_back(call);
+                }
+            }
+
+            // Functions are reported in module order
+            for (Function &F : M)
+            {
+                if (table.callSites.count(&F))
+                    table.callers.push_back(&F);
+            }
+
+            // Use lists are unordered; restore program order within each caller (and so the
+            // communicators below are numbered in program order)
+            for (auto &entry : table.callSites)
+            {
+                SmallVectorImpl<CallBase *> &calls = entry.second;
+                if (calls.size() < 2)
+                    continue;
+
+                DenseMap<const BasicBlock *, unsigned> blockOrder;
+                for (const BasicBlock &BB : *entry.first)
+                    blockOrder[&BB] = blockOrder.size();
+
+                llvm::sort(calls, [&](const CallBase *a, const CallBase *b)
+                           {
+                               if (a->getParent() != b->getParent())
+                                   return blockOrder[a->getParent()] < blockOrder[b->getParent()];
+                               return a->comesBefore(b); });
+            }
+
+            // Intern the communicators created in the module
+            for (Function *F : table.callers)
+            {
+                for (CallBase *call : table.callSites[F])
+                {
+                    MPIOpKind kind = *table.lookup(*call);
+                    if (kind == MPIOpKind::CommSplit || kind == MPIOpKind::CommDup || kind == MPIOpKind::CommCreate)
+                        table.addCommunicator(*call, kind);
+                }
+            }
+
+            return table;
+        }
+
+    private:
+        static AnalysisKey Key;
+        friend struct AnalysisInfoMixin<MPIEntryPointAnalysis>;
+    };
+
+    AnalysisKey MPIEntryPointAnalysis::Key;
+
+    void MPIEntryPointTable::addCommunicator(CallBase &call, MPIOpKind kind)
+    {
+        // Position of the MPI_Comm * output argument
+        unsigned newCommArg = kind == MPIOpKind::CommSplit ? 3 : kind == MPIOpKind::CommDup ? 1 : 2;
+        if (call.arg_size() <= newCommArg)
+            return;
+
+        // Named after the handle variable when the IR keeps value names
+        const Value *slot = call.getArgOperand(newCommArg)->stripPointerCasts();
+        MPICommunicator comm;
+        comm.parent = resolveComm(call.getArgOperand(0));
+        comm.name = slot->hasName() ? slot->getName().str() : ("comm#" + Twine(comms.size())).str();
+
+        raw_string_ostream origin(comm.origin);
+        origin << getEntryPoint(kind).name << "(" << getCommName(comm.parent);
+        if (kind == MPIOpKind::CommDup)
+        {
+            comm.color = ColorKind::Identity;
+        }
+        else if (kind == MPIOpKind::CommSplit)
+        {
+            // Model the color and key; local ranks keep the parent's order only if the key is the rank or a constant
+            using namespace PatternMatch;
+            Value *color = call.getArgOperand(1), *key = call.getArgOperand(2);
+            Value *rank;
+            const APInt *divisor;
+            origin << ", color=";
+            if (isa<ConstantInt>(color))
+            {
+                comm.color = ColorKind::Identity;
+                origin << cast<ConstantInt>(color)->getSExtValue();
+            }
+            else if (match(color, m_SRem(m_Value(rank), m_APInt(divisor))) &&
+                     isCommQueryResult(rank, MPIOpKind::CommRank) && divisor->isStrictlyPositive())
+            {
+                comm.color = ColorKind::RankMod;
+                comm.colorArg = divisor->getSExtValue();
+                origin << "rank%" << comm.colorArg;
+            }
+            else if (match(color, m_SDiv(m_Value(rank), m_APInt(divisor))) &&
+                     isCommQueryResult(rank, MPIOpKind::CommRank) && divisor->isStrictlyPositive())
+            {
+                comm.color = ColorKind::RankDiv;
+                comm.colorArg = divisor->getSExtValue();
+                origin << "rank/" << comm.colorArg;
+            }
+            else
+                origin << "?";
+
+            origin << ", key=";
+            if (isa<ConstantInt>(key) || isCommQueryResult(key, MPIOpKind::CommRank))
+                origin << (isa<ConstantInt>(key) ? "const" : "rank");
+            else
+            {
+                comm.color = ColorKind::Unknown;
+                origin << "?";
+            }
+        }
+        origin << ")";
+        origin.flush();
+
+        // A slot that receives several communicators cannot be resolved to one of them
+        auto inserted = commSlots.try_emplace(slot, MPICommId(comms.size()));
+        if (!inserted.second)
+            inserted.first->second = UnresolvedCommId;
+        comms.push_back(std::move(comm));
+    }
+
+    MPICommId MPIEntryPointTable::resolveComm(const Value *handle) const
+    {
+        handle = handle->stripPointerCasts();
+        auto cached = commCache.find(handle);
+        if (cached != commCache.end())
+            return cached->second;
+        commCache[handle] = UnresolvedCommId; // Breaks cycles through copies
+
+        MPICommId result = UnresolvedCommId;
+        if (auto *global = dyn_cast<GlobalValue>(handle))
+        {
+            // Open MPI & LAM pass the address of a predefined communicator object
+            if (global->getName().endswith("comm_world"))
+                result = WorldCommId;
+            else if (global->getName().endswith("comm_self"))
+                result = SelfCommId;
+        }
+        else if (auto *constant = dyn_cast<ConstantInt>(handle))
+        {
+            // MPICH uses integer handles
+            if (constant->getZExtValue() == 0x44000000)
+                result = WorldCommId;
+            else if (constant->getZExtValue() == 0x44000001)
+                result = SelfCommId;
+        }
+        else if (auto *load = dyn_cast<LoadInst>(handle))
+        {
+            // A handle loaded from a slot: either a slot written by a communicator constructor,
+            // or a slot with a single store of another handle (a copy)
+            const Value *slot = load->getPointerOperand()->stripPointerCasts();
+            auto created = commSlots.find(slot);
+            if (created != commSlots.end())
+                result = created->second;
+            else
+            {
+                const StoreInst *onlyStore = nullptr;
+                bool single = true;
+                for (const User *user : slot->users())
+                {
+                    if (auto *store = dyn_cast<StoreInst>(user))
+                    {
+                        if (store->getPointerOperand()->stripPointerCasts() != slot)
+                            continue; // The slot's address is stored, not written
+                        single = !onlyStore;
+                        onlyStore = store;
+                        if (!single)
+                            break;
+                    }
+                }
+                if (onlyStore && single)
+                    result = resolveComm(onlyStore->getValueOperand());
+            }
+        }
+
+        commCache[handle] = result;
+        return result;
+    }
+
+    bool MPIEntryPointTable::invalidate(Module &, const PreservedAnalyses &PA,
+                                        ModuleAnalysisManager::Invalidator &)
+    {
+        // Only abandonment invalidates the table; preservation of anything else is not checked
+        auto PAC = PA.getChecker<MPIEntryPointAnalysis>();
+        return !PAC.preservedWhenStateless();
+    }
+
+    // An integer MPI call argument resolved by MPIValueResolver: a constant, the result of an
+    // MPI_Comm_rank/MPI_Comm_size query plus a constant, their sum plus a constant (the operand of
+    // the left-neighbour idiom (rank - 1 + size) % size), or (rank + constant) modulo the size
+    struct ResolvedValue
+    {
+        enum Kind : uint8_t
+        {
+            Unknown,
+            Constant,
+            RankPlus,
+            SizePlus,
+            RankPlusSizePlus,
+            RankPlusModSize
+        };
+
+        Kind kind = Unknown;
+        int64_t value = 0; // The constant, or the offset added to the rank, the size or both
+
+        bool operator==(const ResolvedValue &other) const { return kind == other.kind && value == other.value; }
+        bool operator!=(const ResolvedValue &other) const { return !(*this == other); }
+    };
+
+    // Demand-driven backward resolver for the integer arguments of MPI calls. Unoptimized (-O0) code
+    // keeps tags, peers and counts in local variables, so a value is traced from its use back through
+    // loads to the stores (or MPI_Comm_rank/MPI_Comm_size calls) that reach them in a non-escaping
+    // alloca, and through casts, arithmetic with constants, selects and PHIs. Only the values MPI
+    // calls ask for are visited, and every result is memoized per value, so no mem2reg is needed.
+    class MPIValueResolver
+    {
+    public:
+        explicit MPIValueResolver(const MPIEntryPointTable &table) : table(table) {}
+
+        ResolvedValue resolve(const Value *V)
+        {
+            auto cached = cache.find(V);
+            if (cached != cache.end())
+                return cached->second;
+            cache[V] = ResolvedValue(); // Breaks cycles through loop-carried values
+
+            ResolvedValue result = compute(V);
+            cache[V] = result;
+            return result;
+        }
+
+    private:
+        // Most blocks a reaching-store search visits before the value is given up as unknown
+        static constexpr unsigned MaxSearchBlocks = 1024;
+
+        const MPIEntryPointTable &table;
+        DenseMap<const Value *, ResolvedValue> cache;  // Memoized results, per value
+        DenseMap<const AllocaInst *, bool> localSlots; // Memoized isLocalSlot results
+
+        static ResolvedValue constant(int64_t value) { return {ResolvedValue::Constant, value}; }
+
+        ResolvedValue compute(const Value *V)
+        {
+            using namespace PatternMatch;
+
+            if (auto *constantInt = dyn_cast<ConstantInt>(V))
+                return constantInt->getBitWidth() <= 64 ? constant(constantInt->getSExtValue()) : ResolvedValue();
+            if (auto *load = dyn_cast<LoadInst>(V))
+                return resolveLoad(load);
+
+            // Both sides of a select, and every incoming value of a PHI other than itself, must agree
+            if (auto *select = dyn_cast<SelectInst>(V))
+            {
+                ResolvedValue result = resolve(select->getTrueValue());
+                return result == resolve(select->getFalseValue()) ? result : ResolvedValue();
+            }
+            if (auto *phi = dyn_cast<PHINode>(V))
+            {
+                Optional<ResolvedValue> result;
+                for (const Value *incoming : phi->incoming_values())
+                {
+                    if (incoming == phi)
+                        continue;
+                    ResolvedValue value = resolve(incoming);
+                    if (value.kind == ResolvedValue::Unknown || (result && *result != value))
+                        return ResolvedValue();
+                    result = value;
+                }
+                return result.getValueOr(ResolvedValue());
+            }
+
+            // Integer casts only change the width of a rank or size; constants are folded
+            if (auto *cast = dyn_cast<CastInst>(V))
+            {
+                if ((!isa<SExtInst>(cast) && !isa<ZExtInst>(cast) && !isa<TruncInst>(cast)) ||
+                    !cast->getSrcTy()->isIntegerTy() || cast->getSrcTy()->getIntegerBitWidth() > 64 ||
+                    !cast->getDestTy()->isIntegerTy() || cast->getDestTy()->getIntegerBitWidth() > 64)
+                    return ResolvedValue();
+                ResolvedValue operand = resolve(cast->getOperand(0));
+                if (operand.kind != ResolvedValue::Constant)
+                    return operand;
+                APInt value = APInt(64, operand.value, true).trunc(cast->getSrcTy()->getIntegerBitWidth());
+                unsigned width = cast->getDestTy()->getIntegerBitWidth();
+                value = isa<ZExtInst>(cast) ? value.zext(width) : value.sextOrTrunc(width);
+                return constant(value.getSExtValue());
+            }
+
+            auto *binary = dyn_cast<BinaryOperator>(V);
+            if (!binary || !binary->getType()->isIntegerTy() || binary->getType()->getIntegerBitWidth() > 64)
+                return ResolvedValue();
+            ResolvedValue lhs = resolve(binary->getOperand(0));
+            ResolvedValue rhs = resolve(binary->getOperand(1));
+            if (lhs.kind == ResolvedValue::Unknown || rhs.kind == ResolvedValue::Unknown)
+                return ResolvedValue();
+
+            // Fold constant operands with the instruction's own semantics (width, wrapping, division by 0)
+            if (lhs.kind == ResolvedValue::Constant && rhs.kind == ResolvedValue::Constant)
+            {
+                IntegerType *type = cast<IntegerType>(binary->getType());
+                auto *folded = dyn_cast_or_null<ConstantInt>(
+                    ConstantExpr::get(binary->getOpcode(), ConstantInt::get(type, lhs.value, true),
+                                      ConstantInt::get(type, rhs.value, true)));
+                return folded ? constant(folded->getSExtValue()) : ResolvedValue();
+            }
+
+            bool lhsSymbolic = lhs.kind != ResolvedValue::Constant;
+            const ResolvedValue &symbolic = lhsSymbolic ? lhs : rhs;
+            const ResolvedValue &other = lhsSymbolic ? rhs : lhs;
+            switch (binary->getOpcode())
+            {
+            case Instruction::Add: // rank + k + c, c + size + k, (rank + k) + (size + j)
+                if (other.kind == ResolvedValue::Constant && symbolic.kind != ResolvedValue::RankPlusModSize)
+                    return {symbolic.kind, symbolic.value + other.value};
+                if ((lhs.kind == ResolvedValue::RankPlus && rhs.kind == ResolvedValue::SizePlus) ||
+                    (lhs.kind == ResolvedValue::SizePlus && rhs.kind == ResolvedValue::RankPlus))
+                    return {ResolvedValue::RankPlusSizePlus, lhs.value + rhs.value};
+                break;
+            case Instruction::Sub: // rank + k - c
+                if (lhsSymbolic && rhs.kind == ResolvedValue::Constant && lhs.kind != ResolvedValue::RankPlusModSize)
+                    return {lhs.kind, lhs.value - rhs.value};
+                break;
+            case Instruction::SRem: // (rank + k) % size, and (rank + size + k) % size for k >= -size
+            case Instruction::URem:
+                if (rhs != ResolvedValue{ResolvedValue::SizePlus, 0})
+                    break;
+                if (lhs.kind == ResolvedValue::RankPlus || lhs.kind == ResolvedValue::RankPlusSizePlus)
+                    return {ResolvedValue::RankPlusModSize, lhs.value};
+                break;
+            default:
+                break;
+            }
+            return ResolvedValue();
+        }
+
+        // Resolves a load: a rank or size query result, a constant global, or the values of
+        // every store that reaches it in a local slot, which must all agree
+        ResolvedValue resolveLoad(const LoadInst *load)
+        {
+            if (table.isCommQueryResult(load, MPIOpKind::CommRank))
+                return {ResolvedValue::RankPlus, 0};
+            if (table.isCommQueryResult(load, MPIOpKind::CommSize))
+                return {ResolvedValue::SizePlus, 0};
+
+            const Value *pointer = load->getPointerOperand()->stripPointerCasts();
+            if (auto *global = dyn_cast<GlobalVariable>(pointer))
+            {
+                if (global->isConstant() && global->hasDefinitiveInitializer() &&
+                    global->getValueType() == load->getType())
+                    return resolve(global->getInitializer());
+                return ResolvedValue();
+            }
+
+            auto *slot = dyn_cast<AllocaInst>(pointer);
+            if (!slot || load->isVolatile() || !isLocalSlot(slot))
+                return ResolvedValue();
+
+            SmallVector<const Instruction *, 4> writes;
+            if (!findReachingWrites(load, slot, writes))
+                return ResolvedValue();
+            Optional<ResolvedValue> result;
+            for (const Instruction *write : writes)
+            {
+                ResolvedValue value;
+                if (auto *store = dyn_cast<StoreInst>(write))
+                {
+                    if (store->getValueOperand()->getType() == load->getType())
+                        value = resolve(store->getValueOperand());
+                }
+                else if (table.lookup(*cast<CallBase>(write)) == MPIOpKind::CommRank)
+                    value = {ResolvedValue::RankPlus, 0};
+                else
+                    value = {ResolvedValue::SizePlus, 0};
+                if (value.kind == ResolvedValue::Unknown || (result && *result != value))
+                    return ResolvedValue();
+                result = value;
+            }
+            return result.getValueOr(ResolvedValue());
+        }
+
+        // Returns the instruction that writes slot, if I is a store to it or the MPI_Comm_rank/MPI_Comm_size
+        // call it is passed to
+        const Instruction *getWrite(const Instruction &I, const AllocaInst *slot) const
+        {
+            if (auto *store = dyn_cast<StoreInst>(&I))
+                return store->getPointerOperand()->stripPointerCasts() == slot ? store : nullptr;
+            if (auto *call = dyn_cast<CallBase>(&I))
+                if (call->arg_size() > 1 && call->getArgOperand(1)->stripPointerCasts() == slot)
+                    return call;
+            return nullptr;
+        }
+
+        // Collects the writes of slot that reach load: the last write of each block found by walking
+        // backwards from the load. Fails if a path reaches the entry block without a write.
+        bool findReachingWrites(const LoadInst *load, const AllocaInst *slot,
+                                SmallVectorImpl<const Instruction *> &writes) const
+        {
+            SmallPtrSet<const BasicBlock *, 16> visited;
+            SmallVector<std::pair<const BasicBlock *, BasicBlock::const_reverse_iterator>, 16> worklist;
+            worklist.emplace_back(load->getParent(), std::next(load->getReverseIterator()));
+            while (!worklist.empty())
+            {
+                const BasicBlock *BB = worklist.back().first;
+                BasicBlock::const_reverse_iterator it = worklist.back().second;
+                worklist.pop_back();
+
+                const Instruction *write = nullptr;
+                for (; it != BB->rend() && !write; ++it)
+                    write = getWrite(*it, slot);
+                if (write)
+                {
+                    writes.push_back(write);
+                    continue;
+                }
+
+                if (BB->isEntryBlock())
+                    return false; // Read before any write
+                for (const BasicBlock *pred : predecessors(BB))
+                {
+                    if (!visited.insert(pred).second)
+                        continue;
+                    if (visited.size() > MaxSearchBlocks)
+                        return false;
+                    worklist.emplace_back(pred, pred->rbegin());
+                }
+            }
+            return true;
+        }
+
+        // Checks whether the address of an alloca never escapes: it is only loaded from, stored to,
+        // or passed as the result slot of MPI_Comm_rank/MPI_Comm_size, possibly through bitcasts
+        bool isLocalSlot(const AllocaInst *slot)
+        {
+            auto cached = localSlots.find(slot);
+            if (cached != localSlots.end())
+                return cached->second;
+
+            bool local = true;
+            SmallVector<const Value *, 4> addresses = {slot};
+            while (local && !addresses.empty())
+            {
+                const Value *address = addresses.pop_back_val();
+                for (const User *user : address->users())
+                {
+                    if (auto *store = dyn_cast<StoreInst>(user))
+                        local = store->getValueOperand() != address && !store->isVolatile();
+                    else if (auto *call = dyn_cast<CallBase>(user))
+                    {
+                        Optional<MPIOpKind> kind = table.lookup(*call);
+                        local = call->isLifetimeStartOrEnd() ||
+                                ((kind == MPIOpKind::CommRank || kind == MPIOpKind::CommSize) &&
+                                 call->arg_size() > 1 && call->getArgOperand(1) == address &&
+                                 call->getArgOperand(0) != address);
+                    }
+                    else if (isa<BitCastInst>(user))
+                        addresses.push_back(user);
+                    else
+                        local = isa<LoadInst>(user);
+                    if (!local)
+                        break;
+                }
+            }
+            localSlots[slot] = local;
+            return local;
+        }
+    };
+
+    // Compact summary of the MPI calls made directly by one function.
+    // Computed once per function and cached by the FunctionAnalysisManager.
+    struct MPIFunctionSummary
+    {
+        SmallVector<MPICommunication, 4> mpiCalls; // MPI calls made directly in the function
+        SmallVector<RankInterval, 0> rankIntervals; // Arena of the peer (MPICommunication::rank) & executing-rank intervals
+        bool reachesMPI = false;                   // Set by the module pass if the function (transitively) calls MPI
+    };
+
+    // Function analysis that summarizes the MPI calls made by a single function
+    struct MPIFunctionAnalysis : public AnalysisInfoMixin<MPIFunctionAnalysis>
+    {
+        using Result = MPIFunctionSummary;
+
+        // Function that computes the MPI summary of the given function F
+        Result run(Function &F, FunctionAnalysisManager &FAM)
+        {
+            Result summary;
+
+            // The call sites come from the module-level entry point table
+            auto &MAMProxy = FAM.getResult<ModuleAnalysisManagerFunctionProxy>(F);
+            const MPIEntryPointTable *table =
+                MAMProxy.getCachedResult<MPIEntryPointAnalysis>(*F.getParent());
+            if (!table)
+            {
+                report_fatal_error("mpi-analysis: MPIEntryPointAnalysis must be computed "
+                                   "before MPIFunctionAnalysis");
+            }
+            MAMProxy.registerOuterAnalysisInvalidation<MPIEntryPointAnalysis, MPIFunctionAnalysis>();
+
+            auto it = table->callSites.find(&F);
+            if (it == table->callSites.end())
+                return summary; // No MPI calls in this function
+
+            summary.reachesMPI = true;
+            summary.mpiCalls.reserve(it->second.size());
+            NumFunctionsSummarized++;
+            NumCallSites += it->second.size();
+            ScalarEvolution &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+            const DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+            const LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+            BlockFrequencyInfo &BFI = FAM.getResult<BlockFrequencyAnalysis>(F);
+            MPIValueResolver resolver(*table); // Shared by the calls, which often pass the same variables
+            for (CallBase *call : it->second)
+            {
+                MPICommunication mpiComm =
+                    analyzeMPICall(call, *table->lookup(*call), *table, resolver, SE, summary);
+                getExecutingRanks(call, DT, *table, summary, mpiComm);
+                estimateFrequency(call, LI, SE, BFI, mpiComm);
+                summary.mpiCalls.push_back(mpiComm);
+            }
+
+            return summary;
+        }
+
+        // Function to analyze a call to an MPI entry point
+        static MPICommunication analyzeMPICall(CallBase *call, MPIOpKind kind, const MPIEntryPointTable &table,
+                                               MPIValueResolver &resolver, ScalarEvolution &SE,
+                                               MPIFunctionSummary &summary)
+        {
+            const MPIEntryPoint &entry = getEntryPoint(kind);
+
+            MPICommunication mpiComm; // Create an MPICommunication object to store MPI call details
+            mpiComm.kind = kind;      // The operation kind also identifies the name of the MPI call
+
+            // Resolve the communicator handle to the communicator it was created as
+            if (entry.commArg >= 0)
+            {
+                mpiComm.comm = table.resolveComm(call->getArgOperand(entry.commArg));
+            }
+
+            // Extract the tag (the 5th argument of MPI_Send & MPI_Recv), or mark it unknown
+            if (entry.tagArg >= 0)
+            {
+                ResolvedValue tag = resolver.resolve(call->getArgOperand(entry.tagArg));
+                bool known = tag.kind == ResolvedValue::Constant && isInt<32>(tag.value) && tag.value != UnknownTag;
+                mpiComm.tag = known ? int32_t(tag.value) : UnknownTag;
+            }
+
+            // Estimate the message size from the count & datatype (the 2nd & 3rd arguments of MPI_Send & MPI_Recv)
+            if (entry.countArg >= 0 && entry.datatypeArg >= 0)
+            {
+                Value *count = call->getArgOperand(entry.countArg);
+                unsigned size = getDatatypeSize(call->getArgOperand(entry.datatypeArg));
+                ResolvedValue resolved = resolver.resolve(count);
+                Optional<int64_t> constant;
+                if (resolved.kind == ResolvedValue::Constant)
+                    constant = resolved.value;
+                else if (SE.isSCEVable(count->getType()))
+                    if (auto *countSCEV = dyn_cast<SCEVConstant>(SE.getSCEV(count)))
+                        if (countSCEV->getAPInt().getMinSignedBits() <= 64)
+                            constant = countSCEV->getAPInt().getSExtValue();
+                if (constant && *constant >= 0)
+                    mpiComm.bytes = uint32_t(std::min<uint64_t>(std::min<uint64_t>(*constant, UINT32_MAX) * size,
+                                                                UINT32_MAX));
+            }
+
+            // Extract the peer rank (the 4th argument of MPI_Send & MPI_Recv), possibly symbolically
+            if (entry.peerArg >= 0)
+            {
+                analyzePeer(call->getArgOperand(entry.peerArg), table, resolver, SE, summary, mpiComm);
+            }
+
+            return mpiComm;
+        }
+
+        // Function to express a peer rank argument as a constant, an offset from the calling rank
+        // (optionally modulo the communicator size), or a strided interval from a loop recurrence
+        static void analyzePeer(Value *peer, const MPIEntryPointTable &table, MPIValueResolver &resolver,
+                                ScalarEvolution &SE, MPIFunctionSummary &summary, MPICommunication &mpiComm)
+        {
+            // A constant, rank + k or (rank + k) % size, also through local variables
+            ResolvedValue resolved = resolver.resolve(peer);
+            if (isInt<32>(resolved.value))
+            {
+                switch (resolved.kind)
+                {
+                case ResolvedValue::Constant:
+                    mpiComm.peerKind = PeerKind::Constant;
+                    break;
+                case ResolvedValue::RankPlus:
+                    mpiComm.peerKind = PeerKind::Relative;
+                    break;
+                case ResolvedValue::RankPlusModSize:
+                    mpiComm.peerKind = PeerKind::RelativeModSize;
+                    break;
+                default:
+                    break;
+                }
+                if (mpiComm.peerKind != PeerKind::Unknown)
+                {
+                    mpiComm.rank = resolved.value;
+                    return;
+                }
+            }
+
+            if (!SE.isSCEVable(peer->getType()))
+                return;
+            const SCEV *peerSCEV = SE.getSCEV(peer);
+
+            // rank + k
+            if (Optional<int64_t> offset = getRankOffset(peerSCEV, table))
+            {
+                mpiComm.rank = *offset;
+                mpiComm.peerKind = PeerKind::Relative;
+                return;
+            }
+
+            // {start,+,step} over a loop with a computable trip count
+            auto *addRec = dyn_cast<SCEVAddRecExpr>(peerSCEV);
+            if (!addRec || !addRec->isAffine())
+                return;
+            auto *start = dyn_cast<SCEVConstant>(addRec->getStart());
+            auto *step = dyn_cast<SCEVConstant>(addRec->getStepRecurrence(SE));
+            const SCEV *tripCount = SE.getBackedgeTakenCount(addRec->getLoop());
+            if (!start || !step || step->getAPInt().isZero() || isa<SCEVCouldNotCompute>(tripCount))
+                return;
+
+            const SCEV *lastSCEV = addRec->evaluateAtIteration(tripCount, SE);
+            RankInterval interval;
+            interval.stride = std::abs(step->getAPInt().getSExtValue());
+            if (auto *last = dyn_cast<SCEVConstant>(lastSCEV))
+            {
+                int64_t a = start->getAPInt().getSExtValue(), b = last->getAPInt().getSExtValue();
+                interval.first = std::min(a, b);
+                interval.last = std::max(a, b);
+            }
+            else if (Optional<int64_t> offset = getSizeOffset(lastSCEV, table))
+            {
+                if (step->getAPInt().isNegative())
+                    return;
+
+                interval.first = start->getAPInt().getSExtValue();
+                interval.last = *offset;
+                interval.lastFromSize = true;
+            }
+            else
+                return;
+
+            mpiComm.rank = summary.rankIntervals.size();
+            mpiComm.peerKind = PeerKind::Interval;
+            summary.rankIntervals.push_back(interval);
+        }
+
+        // Function to estimate how often a call executes per invocation of its function: the product of
+        // the enclosing loops' constant trip counts, or the block frequency relative to the entry block
+        static void estimateFrequency(CallBase *call, const LoopInfo &LI, ScalarEvolution &SE,
+                                      BlockFrequencyInfo &BFI, MPICommunication &mpiComm)
+        {
+            double tripCounts = 1;
+            for (Loop *L = LI.getLoopFor(call->getParent()); L; L = L->getParentLoop())
+            {
+                unsigned tripCount = SE.getSmallConstantTripCount(L);
+                if (tripCount == 0)
+                {
+                    mpiComm.exactFrequency = false;
+                    break;
+                }
+                tripCounts *= tripCount;
+            }
+
+            if (mpiComm.exactFrequency)
+                mpiComm.frequency = tripCounts;
+            else
+                mpiComm.frequency = double(BFI.getBlockFreq(call->getParent()).getFrequency()) / BFI.getEntryFreq();
+        }
+
+        // Function to visit the branches on the MPI_COMM_WORLD rank that dominate block, innermost first, e.g.
+        // rank == C, rank != C, rank < C, rank < size-1 or rank % 2 == 0, on either side of the branch. The
+        // callback gets the block the guard enters (its single predecessor ends with the guarding branch) and
+        // the world ranks that enter it, and returns false to stop.
+        static void forEachRankGuard(const BasicBlock *block, const DominatorTree &DT, const MPIEntryPointTable &table,
+                                     function_ref<bool(BasicBlock *, const RankSet &)> callback)
+        {
+            for (const DomTreeNode *node = DT.getNode(block); node && node->getIDom(); node = node->getIDom())
+            {
+                BasicBlock *BB = node->getBlock();
+                BasicBlock *guard = BB->getSinglePredecessor();
+                auto *branch = guard ? dyn_cast<BranchInst>(guard->getTerminator()) : nullptr;
+                if (!branch || !branch->isConditional() || branch->getSuccessor(0) == branch->getSuccessor(1))
+                    continue;
+                auto *cmp = dyn_cast<ICmpInst>(branch->getCondition());
+                if (!cmp)
+                    continue;
+
+                // The guarded block is entered on the true edge, or on the false edge with the inverse predicate
+                ICmpInst::Predicate predicate = branch->getSuccessor(0) == BB ? cmp->getPredicate()
+                                                                              : cmp->getInversePredicate();
+                Optional<RankSet> allowed = getGuardedRanks(predicate, cmp->getOperand(0), cmp->getOperand(1), table);
+                if (!allowed)
+                    allowed = getGuardedRanks(ICmpInst::getSwappedPredicate(predicate), cmp->getOperand(1),
+                                              cmp->getOperand(0), table);
+                if (allowed && !callback(BB, *allowed))
+                    return;
+            }
+        }
+
+        // Function to find the world ranks that execute a call: the intersection of the rank sets that the
+        // dominating rank guards allow. A single rank is also kept as the executing rank.
+        static void getExecutingRanks(CallBase *call, const DominatorTree &DT, const MPIEntryPointTable &table,
+                                      MPIFunctionSummary &summary, MPICommunication &mpiComm)
+        {
+            RankSet ranks = RankInterval::all();
+            bool guarded = false;
+            forEachRankGuard(call->getParent(), DT, table, [&](BasicBlock *, const RankSet &allowed)
+                             {
+                                 ranks = ranks.intersectWith(allowed);
+                                 guarded = true;
+                                 return true; });
+            if (!guarded || ranks.empty() || ranks.getIntervals().size() > UINT8_MAX)
+                return; // Unguarded, or contradictory guards on a path that never executes
+
+            if (ranks.isSingleton())
+                mpiComm.executingRank = ranks.getIntervals()[0].first;
+            mpiComm.executingRanks = summary.rankIntervals.size();
+            mpiComm.executingIntervals = ranks.getIntervals().size();
+            summary.rankIntervals.append(ranks.getIntervals().begin(), ranks.getIntervals().end());
+        }
+
+        // Function to find the world ranks for which `lhs <predicate> rhs` holds, where lhs is the MPI_COMM_WORLD
+        // rank (or the rank modulo a constant) and rhs a constant or the size plus a constant
+        static Optional<RankSet> getGuardedRanks(ICmpInst::Predicate predicate, Value *lhs, Value *rhs,
+                                                 const MPIEntryPointTable &table)
+        {
+            using namespace PatternMatch;
+
+            // rank % m ==/!= c: the residue classes of m
+            Value *rank;
+            const APInt *modulus, *constant;
+            MPICommId queried;
+            bool mask = match(lhs, m_And(m_Value(rank), m_APInt(modulus))); // rank & (m-1), for m a power of 2
+            if ((mask || match(lhs, m_SRem(m_Value(rank), m_APInt(modulus)))) && match(rhs, m_APInt(constant)) &&
+                (predicate == ICmpInst::ICMP_EQ || predicate == ICmpInst::ICMP_NE) &&
+                table.isCommQueryResult(rank, MPIOpKind::CommRank, &queried) && queried == WorldCommId)
+            {
+                int64_t m = modulus->getSExtValue(), c = constant->getSExtValue();
+                if (mask)
+                    m = isPowerOf2_64(m + 1) ? m + 1 : 0;
+                if (m <= 0 || m > 16 || c < 0 || c >= m)
+                    return None;
+                RankSet ranks;
+                for (int64_t residue = 0; residue < m; residue++)
+                    if ((residue == c) == (predicate == ICmpInst::ICMP_EQ))
+                        ranks.insert({int32_t(residue), -1, int32_t(m), true});
+                ranks.normalize();
+                return ranks;
+            }
+
+            if (!table.isCommQueryResult(lhs, MPIOpKind::CommRank, &queried) || queried != WorldCommId)
+                return None;
+
+            // The bound, concrete or relative to the size: ranks {0..bound-1} lie below it & {bound..size-1} above
+            int32_t bound;
+            bool fromSize = false;
+            Value *size;
+            const APInt *offset = nullptr;
+            if (match(rhs, m_APInt(constant)))
+                bound = constant->getSExtValue();
+            else if ((table.isCommQueryResult(rhs, MPIOpKind::CommSize, &queried) ||
+                      (match(rhs, m_Add(m_Value(size), m_APInt(offset))) &&
+                       table.isCommQueryResult(size, MPIOpKind::CommSize, &queried))) &&
+                     queried == WorldCommId)
+            {
+                bound = offset ? offset->getSExtValue() : 0;
+                fromSize = true;
+            }
+            else
+                return None;
+
+            auto below = [&](int32_t end) -> RankSet // {0..end-1}
+            { return RankInterval{0, end - 1, 1, fromSize}; };
+            auto above = [&](int32_t start) -> Optional<RankSet> // {start..size-1}
+            {
+                if (fromSize)
+                    return None; // A symbolic first rank cannot be represented
+                return RankSet(RankInterval{std::max(start, 0), -1, 1, true});
+            };
+            switch (predicate)
+            {
+            case ICmpInst::ICMP_EQ:
+                if (fromSize)
+                    return None;
+                return RankSet(RankInterval::single(bound));
+            case ICmpInst::ICMP_NE:
+            {
+                if (fromSize)
+                    return None;
+                RankSet ranks = below(bound);
+                ranks.insert({bound + 1, -1, 1, true});
+                ranks.normalize();
+                return ranks;
+            }
+            case ICmpInst::ICMP_SLT:
+            case ICmpInst::ICMP_ULT:
+                return below(bound);
+            case ICmpInst::ICMP_SLE:
+            case ICmpInst::ICMP_ULE:
+                return below(bound + 1);
+            case ICmpInst::ICMP_SGT:
+            case ICmpInst::ICMP_UGT:
+                return above(bound + 1);
+            case ICmpInst::ICMP_SGE:
+            case ICmpInst::ICMP_UGE:
+                return above(bound);
+            default:
+                return None;
+            }
+        }
+
+        // Returns k if S is (rank of the calling process + k)
+        static Optional<int64_t> getRankOffset(const SCEV *S, const MPIEntryPointTable &table)
+        {
+            return getCommQueryOffset(S, MPIOpKind::CommRank, table);
+        }
+
+        // Returns k if S is (communicator size + k)
+        static Optional<int64_t> getSizeOffset(const SCEV *S, const MPIEntryPointTable &table)
+        {
+            return getCommQueryOffset(S, MPIOpKind::CommSize, table);
+        }
+
+        // Returns k if S is (result of an MPI_Comm_rank/MPI_Comm_size query + k)
+        static Optional<int64_t> getCommQueryOffset(const SCEV *S, MPIOpKind kind, const MPIEntryPointTable &table)
+        {
+            int64_t offset = 0;
+            if (auto *add = dyn_cast<SCEVAddExpr>(S))
+            {
+                if (add->getNumOperands() != 2)
+                    return None;
+                auto *constant = dyn_cast<SCEVConstant>(add->getOperand(0));
+                if (!constant)
+                    return None;
+                offset = constant->getAPInt().getSExtValue();
+                S = add->getOperand(1);
+            }
+            if (auto *cast = dyn_cast<SCEVCastExpr>(S))
+                S = cast->getOperand();
+
+            auto *unknown = dyn_cast<SCEVUnknown>(S);
+            if (!unknown || !table.isCommQueryResult(unknown->getValue(), kind))
+                return None;
+            return offset;
+        }
+
+    private:
+        static AnalysisKey Key;
+        friend struct AnalysisInfoMixin<MPIFunctionAnalysis>;
+    };
+
+    AnalysisKey MPIFunctionAnalysis::Key;
+
+    // Magic of summary cache entries, followed by the u32 call & interval counts and the raw records
+    constexpr char MPISummaryMagic[4] = {'M', 'P', 'I', 'S'};
+
+    // Persistent on-disk cache of function summaries (mpi-analysis<cache-dir=...>), shared by every
+    // run that uses the same directory. An entry is keyed by the MD5 of the cache version, the module's
+    // communicator table and the function's structure including its constants, so any change that can
+    // alter a summary yields a new key and stale entries are simply never looked up again. Entries are
+    // written to a unique temporary file and renamed into place, so concurrent writers from parallel
+    // builds never expose a partial entry.
+    class MPISummaryCache
+    {
+        // Bump when the analysis or the fields of MPICommunication/RankInterval change
+        static constexpr uint32_t Version = 4;
+
+        // Calls & intervals are written field by field in little-endian order, so entries hold no padding
+        // bytes and read back on any host
+        static constexpr size_t CallRecordSize = 7 * sizeof(uint32_t) + 4;
+        static constexpr size_t IntervalRecordSize = 3 * sizeof(int32_t) + 1;
+
+        std::string dir;
+        std::array<uint8_t, 16> moduleHash; // MD5 of the cache version & communicator table
+
+        // Structure of a function serialized into a flat buffer, which is hashed once
+        using KeyBytes = SmallVector<char, 4096>;
+
+        static void hashInt(KeyBytes &hash, uint64_t value)
+        {
+            char bytes[sizeof(value)];
+            support::endian::write64le(bytes, value);
+            hash.append(bytes, bytes + sizeof(bytes));
+        }
+
+        static void hashString(KeyBytes &hash, StringRef text)
+        {
+            hashInt(hash, text.size());
+            hash.append(text.begin(), text.end());
+        }
+
+        static void hashType(KeyBytes &hash, Type *T)
+        {
+            hashInt(hash, T->getTypeID());
+            if (auto *intType = dyn_cast<IntegerType>(T))
+                hashInt(hash, intType->getBitWidth());
+            else if (auto *arrayType = dyn_cast<ArrayType>(T))
+                hashInt(hash, arrayType->getNumElements());
+            else if (auto *vectorType = dyn_cast<VectorType>(T))
+                hashInt(hash, vectorType->getElementCount().getKnownMinValue());
+
+            auto *structType = dyn_cast<StructType>(T);
+            if (structType && structType->hasName())
+            {
+                hashString(hash, structType->getName()); // Named structs may be recursive
+                return;
+            }
+            for (Type *contained : T->subtypes())
+                hashType(hash, contained);
+        }
+
+        // Hashes an operand: local values by their position in the function, globals by name and
+        // constants by their contents. Constant globals also hash their initializer, which the value
+        // resolver reads tags, peers & counts from (not the initializers of the globals it refers to)
+        static void hashValue(KeyBytes &hash, const Value *V, const DenseMap<const Value *, uint32_t> &ids,
+                              bool hashInitializers = true)
+        {
+            hashInt(hash, V->getValueID());
+            auto it = ids.find(V);
+            if (it != ids.end())
+            {
+                hashInt(hash, it->second);
+                return;
+            }
+            if (auto *global = dyn_cast<GlobalValue>(V))
+            {
+                hashString(hash, global->getName());
+                auto *variable = dyn_cast<GlobalVariable>(global);
+                if (hashInitializers && variable && variable->isConstant() && variable->hasDefinitiveInitializer())
+                    hashValue(hash, variable->getInitializer(), ids, false);
+                return;
+            }
+
+            hashType(hash, V->getType());
+            if (auto *constInt = dyn_cast<ConstantInt>(V))
+            {
+                for (uint64_t word : makeArrayRef(constInt->getValue().getRawData(), constInt->getValue().getNumWords()))
+                    hashInt(hash, word);
+            }
+            else if (auto *constFP = dyn_cast<ConstantFP>(V))
+            {
+                APInt bits = constFP->getValueAPF().bitcastToAPInt();
+                for (uint64_t word : makeArrayRef(bits.getRawData(), bits.getNumWords()))
+                    hashInt(hash, word);
+            }
+            else if (auto *data = dyn_cast<ConstantDataSequential>(V))
+                hashString(hash, data->getRawDataValues());
+            else if (auto *inlineAsm = dyn_cast<InlineAsm>(V))
+                hashString(hash, inlineAsm->getAsmString());
+            else if (auto *constant = dyn_cast<Constant>(V))
+            {
+                if (auto *expr = dyn_cast<ConstantExpr>(constant))
+                {
+                    hashInt(hash, expr->getOpcode());
+                    if (expr->isCompare())
+                        hashInt(hash, expr->getPredicate());
+                }
+                for (const Value *operand : constant->operands())
+                    hashValue(hash, operand, ids, hashInitializers);
+            }
+        }
+
+        // Hashes everything a function summary is computed from: the instructions with their
+        // operands, compare predicates and branch weights (used for frequency estimates)
+        static void hashFunction(KeyBytes &hash, const Function &F)
+        {
+            DenseMap<const Value *, uint32_t> ids;
+            for (const Argument &arg : F.args())
+                ids[&arg] = ids.size();
+            for (const BasicBlock &BB : F)
+            {
+                ids[&BB] = ids.size();
+                for (const Instruction &I : BB)
+                    ids[&I] = ids.size();
+            }
+
+            hashType(hash, F.getFunctionType());
+            for (const BasicBlock &BB : F)
+            {
+                hashInt(hash, ids[&BB]);
+                for (const Instruction &I : BB)
+                {
+                    hashInt(hash, I.getOpcode());
+                    hashType(hash, I.getType());
+                    if (auto *cmp = dyn_cast<CmpInst>(&I))
+                        hashInt(hash, cmp->getPredicate());
+                    else if (auto *gep = dyn_cast<GetElementPtrInst>(&I))
+                        hashType(hash, gep->getSourceElementType());
+                    else if (auto *alloca = dyn_cast<AllocaInst>(&I))
+                        hashType(hash, alloca->getAllocatedType());
+                    else if (auto *phi = dyn_cast<PHINode>(&I))
+                    {
+                        for (const BasicBlock *incoming : phi->blocks())
+                            hashInt(hash, ids.lookup(incoming));
+                    }
+                    for (const Value *operand : I.operands())
+                        hashValue(hash, operand, ids);
+
+                    if (const MDNode *weights = I.getMetadata(LLVMContext::MD_prof))
+                    {
+                        for (const MDOperand &operand : weights->operands())
+                        {
+                            if (auto *name = dyn_cast<MDString>(operand))
+                                hashString(hash, name->getString());
+                            else if (auto *constant = dyn_cast<ConstantAsMetadata>(operand))
+                                hashValue(hash, constant->getValue(), ids);
+                        }
+                    }
+                }
+            }
+        }
+
+        std::string entryPath(StringRef key) const
+        {
+            SmallString<128> path(dir);
+            sys::path::append(path, key + ".mpis");
+            return path.str().str();
+        }
+
+    public:
+        // Communicator IDs in the summaries depend on the whole module, so the communicator table is
+        // part of every key
+        MPISummaryCache(StringRef dir, const MPIEntryPointTable &table) : dir(dir.str())
+        {
+            sys::fs::create_directories(dir);
+
+            KeyBytes hash;
+            hashInt(hash, Version);
+            hashInt(hash, sizeof(MPICommunication));
+            for (const MPICommunicator &comm : table.comms)
+            {
+                hashString(hash, comm.name);
+                hashString(hash, comm.origin);
+                hashInt(hash, comm.parent);
+                hashInt(hash, uint64_t(comm.color));
+                hashInt(hash, uint64_t(comm.colorArg));
+            }
+
+            // Handles stored into globals are resolved across functions
+            std::vector<std::pair<StringRef, MPICommId>> globalSlots;
+            for (const auto &slot : table.commSlots)
+                if (auto *global = dyn_cast<GlobalValue>(slot.first))
+                    globalSlots.emplace_back(global->getName(), slot.second);
+            llvm::sort(globalSlots);
+            for (const auto &slot : globalSlots)
+            {
+                hashString(hash, slot.first);
+                hashInt(hash, slot.second);
+            }
+            moduleHash = MD5::hash(arrayRefFromStringRef(StringRef(hash.data(), hash.size())));
+        }
+
+        // Returns the key of a function's summary
+        std::string getKey(const Function &F) const
+        {
+            KeyBytes hash(moduleHash.begin(), moduleHash.end());
+            hashFunction(hash, F);
+            return toHex(MD5::hash(arrayRefFromStringRef(StringRef(hash.data(), hash.size()))), /*LowerCase=*/true);
+        }
+
+        // Reads a cached summary; damaged or foreign entries count as misses
+        bool lookup(StringRef key, MPIFunctionSummary &summary) const
+        {
+            ErrorOr<std::unique_ptr<MemoryBuffer>> entry =
+                MemoryBuffer::getFile(entryPath(key), /*IsText=*/false, /*RequiresNullTerminator=*/false);
+            if (!entry)
+                return false;
+
+            StringRef data = (*entry)->getBuffer();
+            const size_t headerSize = sizeof(MPISummaryMagic) + 2 * sizeof(uint32_t);
+            if (data.size() < headerSize || !data.startswith(StringRef(MPISummaryMagic, sizeof(MPISummaryMagic))))
+                return false;
+            uint32_t calls = support::endian::read32le(data.data() + sizeof(MPISummaryMagic));
+            uint32_t intervals = support::endian::read32le(data.data() + sizeof(MPISummaryMagic) + sizeof(uint32_t));
+            if (data.size() != headerSize + uint64_t(calls) * CallRecordSize + uint64_t(intervals) * IntervalRecordSize)
+                return false;
+
+            using namespace support;
+            const char *record = data.data() + headerSize;
+            summary.mpiCalls.resize(calls);
+            for (MPICommunication &call : summary.mpiCalls)
+            {
+                call.tag = endian::readNext<int32_t, little, unaligned>(record);
+                call.rank = endian::readNext<int32_t, little, unaligned>(record);
+                call.comm = endian::readNext<uint32_t, little, unaligned>(record);
+                call.executingRank = endian::readNext<int32_t, little, unaligned>(record);
+                call.executingRanks = endian::readNext<uint32_t, little, unaligned>(record);
+                call.bytes = endian::readNext<uint32_t, little, unaligned>(record);
+                call.frequency = endian::readNext<float, little, unaligned>(record);
+                uint8_t kind = endian::readNext<uint8_t, little, unaligned>(record);
+                uint8_t peerKind = endian::readNext<uint8_t, little, unaligned>(record);
+                if (kind >= uint8_t(MPIOpKind::NumKinds) || peerKind > uint8_t(PeerKind::Interval))
+                    return false;
+                call.kind = MPIOpKind(kind);
+                call.peerKind = PeerKind(peerKind);
+                call.exactFrequency = endian::readNext<uint8_t, little, unaligned>(record);
+                call.executingIntervals = endian::readNext<uint8_t, little, unaligned>(record);
+            }
+            summary.rankIntervals.resize(intervals);
+            for (RankInterval &interval : summary.rankIntervals)
+            {
+                interval.first = endian::readNext<int32_t, little, unaligned>(record);
+                interval.last = endian::readNext<int32_t, little, unaligned>(record);
+                interval.stride = endian::readNext<int32_t, little, unaligned>(record);
+                interval.lastFromSize = endian::readNext<uint8_t, little, unaligned>(record);
+            }
+            summary.reachesMPI = true;
+            return true;
+        }
+
+        // Writes a summary; failures only cost a later re-analysis
+        void store(StringRef key, const MPIFunctionSummary &summary) const
+        {
+            std::string path = entryPath(key);
+            SmallString<128> tempPath;
+            int fd;
+            if (sys::fs::createUniqueFile(path + ".%%%%%%%%.tmp", fd, tempPath))
+                return;
+
+            {
+                raw_fd_ostream OS(fd, /*shouldClose=*/true);
+                support::endian::Writer W(OS, support::little);
+                OS.write(MPISummaryMagic, sizeof(MPISummaryMagic));
+                W.write<uint32_t>(summary.mpiCalls.size());
+                W.write<uint32_t>(summary.rankIntervals.size());
+                for (const MPICommunication &call : summary.mpiCalls)
+                {
+                    W.write<int32_t>(call.tag);
+                    W.write<int32_t>(call.rank);
+                    W.write<uint32_t>(call.comm);
+                    W.write<int32_t>(call.executingRank);
+                    W.write<uint32_t>(call.executingRanks);
+                    W.write<uint32_t>(call.bytes);
+                    W.write<float>(call.frequency);
+                    W.write<uint8_t>(uint8_t(call.kind));
+                    W.write<uint8_t>(uint8_t(call.peerKind));
+                    W.write<uint8_t>(call.exactFrequency);
+                    W.write<uint8_t>(call.executingIntervals);
+                }
+                for (const RankInterval &interval : summary.rankIntervals)
+                {
+                    W.write<int32_t>(interval.first);
+                    W.write<int32_t>(interval.last);
+                    W.write<int32_t>(interval.stride);
+                    W.write<uint8_t>(interval.lastFromSize);
+                }
+                OS.close();
+                if (OS.has_error())
+                {
+                    OS.clear_error();
+                    sys::fs::remove(tempPath);
+                    return;
+                }
+            }
+            if (sys::fs::rename(tempPath, path))
+                sys::fs::remove(tempPath);
+        }
+    };
+
+    // Estimated communication load of one world rank, per invocation of the functions that make the calls
+    struct MPIRankLoad
+    {
+        double sends = 0;
+        double receives = 0;
+        double bytes = 0;    // Sent, received & contributed to collectives
+        double blocking = 0; // Blocking sends & receives, probes, waits & blocking collectives
+
+        double messages() const { return sends + receives; }
+        bool operator==(const MPIRankLoad &other) const
+        {
+            return sends == other.sends && receives == other.receives && bytes == other.bytes &&
+                   blocking == other.blocking;
+        }
+    };
+
+    // Prints the peer argument of a receive or probe, naming MPI_ANY_SOURCE & MPI_PROC_NULL
+    inline void printSource(raw_ostream &OS, const MPICommunication &call, ArrayRef<RankInterval> rankIntervals,
+                            const MPIEntryPointTable &table)
+    {
+        if (call.peerKind == PeerKind::Constant && call.rank == table.getAnySource())
+            OS << "MPI_ANY_SOURCE";
+        else if (call.peerKind == PeerKind::Constant && call.rank == table.getProcNull())
+            OS << "MPI_PROC_NULL";
+        else
+            printPeer(OS, call, rankIntervals);
+    }
+
+    // Finding of the unexpected-message queue lint (mpi-analysis<lint>). Severities are the estimated
+    // entries of the MPI matching queues searched per invocation of the functions that make the calls.
+    struct MPIQueueFinding
+    {
+        enum class Kind : uint8_t
+        {
+            WildcardReceive, // A receive or probe with MPI_ANY_SOURCE and/or MPI_ANY_TAG
+            DeepQueue,       // A (comm, tag) context in which many messages can wait for one rank
+            TagReorder       // Receives consume a sender's tags in another order than they were sent
+        };
+
+        Kind kind;
+        double severity;
+        double depth = 0;                       // Messages that can wait for one rank in the searched context(s)
+        MPICommId comm;
+        int32_t tag;                            // The context's tag; for TagReorder, the tag received first
+        const MPICommunication *call;           // The wildcard receive, the largest send or the overtaking receive
+        ArrayRef<RankInterval> rankIntervals;   // Intervals of call
+        StringRef function;                     // Function of call
+        int32_t sentFirstTag = -1;              // TagReorder: the tag sent first but received later
+        unsigned inversions = 0;                // TagReorder: pairs of messages received in the opposite order
+        StringRef sendFunction;                 // TagReorder: function of the sends
+    };
+
+    // MPI thread support levels, numbered as MPI_THREAD_SINGLE..MPI_THREAD_MULTIPLE in MPICH, Open MPI & LAM.
+    // Also the level an MPI call needs from the threads that can make it.
+    enum class MPIThreadLevel : uint8_t
+    {
+        Single,     // Only the main thread runs
+        Funneled,   // Only the master thread calls MPI
+        Serialized, // Any thread calls MPI, one at a time
+        Multiple    // Several threads call MPI at once
+    };
+
+    const char *getThreadLevelName(MPIThreadLevel level)
+    {
+        static const char *const names[] = {"MPI_THREAD_SINGLE", "MPI_THREAD_FUNNELED", "MPI_THREAD_SERIALIZED",
+                                            "MPI_THREAD_MULTIPLE"};
+        return names[size_t(level)];
+    }
+
+    // MPI calls that the threads of OpenMP parallel regions make at once on one communicator, which contend
+    // for its locks & queues under MPI_THREAD_MULTIPLE
+    struct MPIContentionHotspot
+    {
+        Optional<MPICommId> comm; // None for the calls without a communicator (waits & tests)
+        unsigned sites = 0;
+        double calls = 0;         // Estimated calls per thread & invocation of the calling functions
+        bool exact = true;
+        StringRef function;       // Function of the most frequent call
+        float largest = 0;        // Frequency of that call
+    };
+
+    // Receives the analysis results as they are produced and renders them to a stream. Records are
+    // written as soon as they are known, so no report is ever built up in memory.
+    class MPIReportWriter
+    {
+    public:
+        virtual ~MPIReportWriter() = default;
+
+        // Start of the report of a module (and the source file it was compiled from), with the communicators known in it
+        virtual void beginModule(StringRef module, StringRef sourceFile, const MPIEntryPointTable &table) = 0;
+        // A function that reaches MPI, with its number of direct MPI calls
+        virtual void function(StringRef name, size_t directCalls) = 0;
+        // An MPI call site of the last reported function
+        virtual void call(const MPICommunication &call, ArrayRef<RankInterval> rankIntervals,
+                          const MPIEntryPointTable &table) = 0;
+        virtual void beginParticipation() = 0;
+        // A (comm, tag) group with more than one rank; worldRanks is null for MPI_COMM_WORLD
+        // groups and empty if the local ranks could not be translated
+        virtual void participation(StringRef comm, int32_t tag, const RankSet &ranks, const RankSet *worldRanks) = 0;
+        // A rank-relative send or receive without a matching partner
+        virtual void unmatchedShift(const MPICommunication &call, StringRef comm) = 0;
+        virtual void beginHotChannels() = 0;
+        // One row of the hot channel table (index counts from 1)
+        virtual void hotChannel(size_t index, const MPICommunication &send, unsigned calls, double bytes, bool exact,
+                                ArrayRef<RankInterval> rankIntervals, const MPIEntryPointTable &table) = 0;
+        virtual void endHotChannels(size_t omitted) = 0;
+        // The load of every world rank of a job of loads.size() ranks, and the ranks whose load is an outlier
+        virtual void loadProfile(ArrayRef<MPIRankLoad> loads, ArrayRef<int32_t> outliers, const MPIRankLoad &median) = 0;
+        // Start of the queue lint for a job of the given size
+        virtual void beginQueueLint(int32_t ranks) = 0;
+        // One lint finding, in order of decreasing severity
+        virtual void queueFinding(const MPIQueueFinding &finding, const MPIEntryPointTable &table) = 0;
+        virtual void endQueueLint(size_t findings) = 0;
+        // Start of the thread report: the level MPI_Init_thread requests (None if not known) and the number of
+        // OpenMP parallel regions & tasks whose bodies reach MPI
+        virtual void beginThreadReport(Optional<MPIThreadLevel> requested, size_t regions) = 0;
+        // An MPI call that the threads of a parallel region or task can make, and the thread level it needs
+        virtual void threadedCall(const MPICommunication &call, StringRef function, MPIThreadLevel needed,
+                                  const MPIEntryPointTable &table) = 0;
+        // One contention hotspot, in order of decreasing calls (index counts from 1)
+        virtual void contentionHotspot(size_t index, const MPIContentionHotspot &hotspot,
+                                       const MPIEntryPointTable &table) = 0;
+        // End of the thread report, with the level the module's MPI calls need
+        virtual void endThreadReport(MPIThreadLevel needed, size_t hotspots) = 0;
+        virtual void endModule() = 0;
+    };
+
+    // Renders a value with one of the print helpers into a string
+    template <typename PrintT>
+    std::string printToString(PrintT print)
+    {
+        std::string text;
+        raw_string_ostream OS(text);
+        print(OS);
+        return OS.str();
+    }
+
+    // Human-readable report, the pass's original output format
+    class TextReportWriter : public MPIReportWriter
+    {
+        raw_ostream &OS;
+        Optional<MPIThreadLevel> requestedThreadLevel; // Of the current thread report
+
+    public:
+        explicit TextReportWriter(raw_ostream &OS) : OS(OS) {}
+
+        void beginModule(StringRef module, StringRef sourceFile, const MPIEntryPointTable &table) override
+        {
+            OS << "MPIAnalysisPass running on module: " << module << "\n";
+
+            // Output the communicators created in the module and how their ranks map to their parents
+            for (MPICommId id = UnresolvedCommId + 1; id < table.comms.size(); id++)
+            {
+                OS << "[INFO] Communicator " << table.comms[id].name << " = " << table.comms[id].origin << "\n";
+            }
+        }
+
+        void function(StringRef name, size_t directCalls) override
+        {
+            OS << "[INFO] Function " << name << ": " << directCalls << " direct MPI call(s)";
+            if (directCalls == 0)
+                OS << ", reaches MPI through its callees";
+            OS << "\n";
+        }
+
+        void call(const MPICommunication &call, ArrayRef<RankInterval> rankIntervals,
+                  const MPIEntryPointTable &table) override
+        {
+            const MPIEntryPoint &entry = getEntryPoint(call.kind);
+            OS << "[INFO] Detected MPI " << entry.name;
+            if (entry.commArg >= 0)
+                OS << ": comm=" << table.getCommName(call.comm);
+            if (entry.tagArg >= 0)
+            {
+                OS << ", tag=";
+                printTag(OS, call.tag);
+            }
+            if (entry.peerArg >= 0)
+            {
+                OS << ", rank=";
+                printPeer(OS, call, rankIntervals);
+                if (call.comm != WorldCommId && call.peerKind == PeerKind::Constant)
+                {
+                    RankSet worldRanks = table.toWorldRanks(call.comm, call.rank, call.executingRank);
+                    if (!worldRanks.empty())
+                    {
+                        OS << " (world ";
+                        worldRanks.print(OS);
+                        OS << ")";
+                    }
+                }
+            }
+            if (entry.countArg >= 0)
+            {
+                OS << ", bytes=";
+                if (call.bytes)
+                    OS << call.bytes;
+                else
+                    OS << "?";
+            }
+            OS << ", freq=" << (call.exactFrequency ? "" : "~") << format("%g", call.frequency);
+            if (call.executingIntervals)
+            {
+                OS << ", executing=";
+                getExecutingRanks(call, rankIntervals).print(OS);
+            }
+            OS << "\n";
+        }
+
+        void beginParticipation() override
+        {
+            OS << "\n[INFO] Analyzing Uniform Participation Patterns...\n\n";
+        }
+
+        void participation(StringRef comm, int32_t tag, const RankSet &ranks, const RankSet *worldRanks) override
+        {
+            OS << "[INFO] Uniform Participation Detected in Comm " << comm
+               << " with Tag " << tag << " involving Ranks: ";
+            for (const RankInterval &interval : ranks.getIntervals()) // Output the ranks involved in the uniform participation
+            {
+                interval.print(OS);
+                OS << " ";
+            }
+            OS << "\n";
+
+            // Output a detailed uniform participation report.
+            OS << "Uniform Participation Report:\n";
+            OS << "------------------------------------\n";
+            OS << "- Communicator: " << comm << "\n";
+            OS << "- Tag: " << tag << "\n";
+            OS << "- Participating Ranks: ";
+            ranks.print(OS);
+            OS << "\n";
+            if (worldRanks)
+            {
+                // Communicator-local ranks are translated back to MPI_COMM_WORLD ranks
+                OS << "- World Ranks: ";
+                if (!worldRanks->empty())
+                    worldRanks->print(OS);
+                else
+                    OS << "unknown";
+                OS << "\n";
+            }
+            OS << "This indicates that both MPI_Send and MPI_Recv operations with tag "
+               << tag << " in communicator\n"
+               << comm
+               << " involve these ranks.\n\n";
+        }
+
+        void unmatchedShift(const MPICommunication &call, StringRef comm) override
+        {
+            OS << "[WARN] " << getEntryPoint(call.kind).name << " with peer ";
+            printPeer(OS, call, {});
+            OS << " in Comm " << comm << " with Tag ";
+            printTag(OS, call.tag);
+            OS << " has no matching " << (isReceive(call.kind) ? "send" : "receive") << "\n";
+        }
+
+        void beginHotChannels() override
+        {
+            OS << "[INFO] Hot Channels (estimated bytes per invocation of the sending function, '~' marks estimates):\n";
+            OS << "#    Comm             Src    Dst              Tag    Calls  Bytes\n";
+        }
+
+        void hotChannel(size_t index, const MPICommunication &send, unsigned calls, double bytes, bool exact,
+                        ArrayRef<RankInterval> rankIntervals, const MPIEntryPointTable &table) override
+        {
+            std::string src = "*";
+            if (send.executingRank >= 0)
+                src = std::to_string(send.executingRank);
+            else if (send.executingIntervals)
+                src = printToString([&](raw_ostream &OS)
+                                    { getExecutingRanks(send, rankIntervals).print(OS); });
+            std::string dst = printToString([&](raw_ostream &OS)
+                                            { printPeer(OS, send, rankIntervals); });
+            std::string tag = printToString([&](raw_ostream &OS)
+                                            { printTag(OS, send.tag); });
+            OS << format("%-4zu %-16s %-6s %-16s %-6s %-6u %s%.0f\n", index,
+                         table.getCommName(send.comm).str().c_str(), src.c_str(), dst.c_str(),
+                         tag.c_str(), calls, exact ? "" : "~", bytes);
+        }
+
+        void endHotChannels(size_t omitted) override
+        {
+            if (omitted)
+                OS << "... " << omitted << " more channel(s)\n";
+            OS << "\n";
+        }
+
+        void loadProfile(ArrayRef<MPIRankLoad> loads, ArrayRef<int32_t> outliers, const MPIRankLoad &median) override
+        {
+            OS << "[INFO] Communication Load per Rank (" << loads.size()
+               << " ranks, estimated per invocation of the calling functions):\n";
+            OS << "Ranks            Sends        Recvs        Bytes          Blocking\n";
+
+            // Consecutive ranks with the same load share a row
+            const size_t maxRows = 32;
+            size_t rows = 0, omitted = 0;
+            for (size_t first = 0, last; first < loads.size(); first = last + 1)
+            {
+                for (last = first; last + 1 < loads.size() && loads[last + 1] == loads[first]; last++)
+                    ;
+                const MPIRankLoad &load = loads[first];
+                if (rows++ >= maxRows)
+                {
+                    omitted++;
+                    continue;
+                }
+                std::string ranks = first == last ? std::to_string(first)
+                                                  : std::to_string(first) + ".." + std::to_string(last);
+                OS << format("%-16s %-12.6g %-12.6g %-14.0f %.6g\n", ranks.c_str(), load.sends, load.receives,
+                             load.bytes, load.blocking);
+            }
+            if (omitted)
+                OS << "... " << omitted << " more row(s)\n";
+
+            // Max over mean of each metric; 1 is a perfect balance
+            auto imbalance = [&](function_ref<double(const MPIRankLoad &)> metric)
+            {
+                double max = 0, total = 0;
+                for (const MPIRankLoad &load : loads)
+                {
+                    max = std::max(max, metric(load));
+                    total += metric(load);
+                }
+                return total > 0 ? max * loads.size() / total : 1.0;
+            };
+            OS << format("[INFO] Load imbalance (max/mean): messages %.2f, bytes %.2f, blocking calls %.2f\n",
+                         imbalance([](const MPIRankLoad &load)
+                                   { return load.messages(); }),
+                         imbalance([](const MPIRankLoad &load)
+                                   { return load.bytes; }),
+                         imbalance([](const MPIRankLoad &load)
+                                   { return load.blocking; }));
+
+            const size_t maxOutliers = 10;
+            for (size_t i = 0; i < outliers.size() && i < maxOutliers; i++)
+            {
+                const MPIRankLoad &load = loads[outliers[i]];
+                OS << "[WARN] Rank " << outliers[i] << " is a communication outlier: "
+                   << format("%.6g message(s), %.0f byte(s) & %.6g blocking call(s) against a median of %.6g, %.0f & %.6g\n",
+                             load.messages(), load.bytes, load.blocking, median.messages(), median.bytes,
+                             median.blocking);
+            }
+            if (outliers.size() > maxOutliers)
+                OS << "... " << outliers.size() - maxOutliers << " more outlier rank(s)\n";
+            OS << "\n";
+        }
+
+        void beginQueueLint(int32_t ranks) override
+        {
+            OS << "[INFO] Unexpected-Message Queue Lint (" << ranks
+               << " ranks, severity = estimated queue entries searched per invocation):\n";
+        }
+
+        void queueFinding(const MPIQueueFinding &finding, const MPIEntryPointTable &table) override
+        {
+            const MPICommunication &call = *finding.call;
+            StringRef op = getEntryPoint(call.kind).name;
+            StringRef comm = table.getCommName(finding.comm);
+            OS << format("[WARN] Severity %.6g: ", finding.severity);
+            switch (finding.kind)
+            {
+            case MPIQueueFinding::Kind::WildcardReceive:
+                OS << op << " from ";
+                printSource(OS, call, finding.rankIntervals, table);
+                OS << " with Tag ";
+                if (call.tag == AnyTagValue)
+                    OS << "MPI_ANY_TAG";
+                else
+                    printTag(OS, call.tag);
+                OS << " in Comm " << comm << " (" << finding.function << ") searches up to "
+                   << format("%.6g", finding.depth) << " queued message(s)\n";
+                break;
+            case MPIQueueFinding::Kind::DeepQueue:
+                OS << "up to " << format("%.6g", finding.depth) << " message(s) can wait for one rank in Comm "
+                   << comm << " with Tag ";
+                printTag(OS, finding.tag);
+                OS << ", mostly from " << op << " to ";
+                printPeer(OS, call, finding.rankIntervals);
+                OS << " (" << finding.function << ")\n";
+                break;
+            case MPIQueueFinding::Kind::TagReorder:
+                OS << op << " from ";
+                printPeer(OS, call, finding.rankIntervals);
+                OS << " in Comm " << comm << " (" << finding.function << ") receives Tag ";
+                printTag(OS, finding.tag);
+                OS << " before Tag ";
+                printTag(OS, finding.sentFirstTag);
+                OS << ", which " << finding.sendFunction << " sends first (" << finding.inversions
+                   << " message pair(s) out of order)\n";
+                break;
+            }
+        }
+
+        void endQueueLint(size_t findings) override
+        {
+            if (!findings)
+                OS << "[INFO] No unexpected-message queue findings\n";
+            OS << "\n";
+        }
+
+        void beginThreadReport(Optional<MPIThreadLevel> requested, size_t regions) override
+        {
+            requestedThreadLevel = requested;
+            OS << "[INFO] Thread Safety (" << regions << " OpenMP parallel region(s) & task(s) reach MPI, "
+               << (requested ? getThreadLevelName(*requested) : "an unknown level") << " requested):\n";
+        }
+
+        void threadedCall(const MPICommunication &call, StringRef function, MPIThreadLevel needed,
+                          const MPIEntryPointTable &table) override
+        {
+            static const char *const how[] = {"", "runs on the master thread only",
+                                              "runs on one thread at a time (single & critical regions)",
+                                              "runs on several threads at once"};
+            const MPIEntryPoint &entry = getEntryPoint(call.kind);
+            bool exceeds = requestedThreadLevel && needed > *requestedThreadLevel;
+            OS << (exceeds ? "[WARN] " : "[INFO] ") << entry.name << " in " << function;
+            if (entry.commArg >= 0)
+                OS << " (comm=" << table.getCommName(call.comm) << ")";
+            OS << " " << how[size_t(needed)] << ": needs " << getThreadLevelName(needed) << "\n";
+        }
+
+        void contentionHotspot(size_t index, const MPIContentionHotspot &hotspot,
+                               const MPIEntryPointTable &table) override
+        {
+            if (index == 1)
+            {
+                OS << "[INFO] Contention Hotspots (MPI calls made by concurrent threads, estimated per thread & "
+                      "invocation, '~' marks estimates):\n";
+                OS << "#    Comm             Sites  Calls        Function\n";
+            }
+            std::string calls = (hotspot.exact ? "" : "~") + printToString([&](raw_ostream &OS)
+                                                                           { OS << format("%.6g", hotspot.calls); });
+            OS << format("%-4zu %-16s %-6u %-12s %s\n", index,
+                         hotspot.comm ? table.getCommName(*hotspot.comm).str().c_str() : "-", hotspot.sites,
+                         calls.c_str(), hotspot.function.str().c_str());
+        }
+
+        void endThreadReport(MPIThreadLevel needed, size_t hotspots) override
+        {
+            if (hotspots)
+                OS << "[INFO] Concurrent calls contend for the MPI library's locks: funnel them through the master "
+                      "thread, or give each thread its own communicator (MPI_Comm_dup)\n";
+            OS << "[INFO] The MPI calls need " << getThreadLevelName(needed) << "\n";
+            if (requestedThreadLevel && needed > *requestedThreadLevel)
+                OS << "[WARN] The requested " << getThreadLevelName(*requestedThreadLevel) << " is below the "
+                   << getThreadLevelName(needed) << " the MPI calls need\n";
+            OS << "\n";
+        }
+
+        void endModule() override { OS.flush(); }
+    };
+
+    // One JSON object per line, for scripts & dashboards
+    class JSONLReportWriter : public MPIReportWriter
+    {
+        raw_ostream &OS;
+        std::string currentFunction; // Function of the call records that follow
+        Optional<MPIThreadLevel> requestedThreadLevel; // Of the current thread report
+        size_t threadedRegions = 0;
+
+        // Writes one record as a single line
+        template <typename FieldsT>
+        void record(StringRef type, FieldsT fields)
+        {
+            json::OStream J(OS);
+            J.object([&]
+                     {
+                         J.attribute("record", type);
+                         fields(J); });
+            OS << "\n";
+        }
+
+        // Writes the tag attribute, null if the tag is unknown
+        static void tagAttribute(json::OStream &J, int32_t tag)
+        {
+            if (tag == UnknownTag)
+                J.attribute("tag", nullptr);
+            else
+                J.attribute("tag", tag);
+        }
+
+        static void rankSet(json::OStream &J, StringRef name, const RankSet &ranks)
+        {
+            J.attributeArray(name, [&]
+                             {
+                                 for (const RankInterval &interval : ranks.getIntervals())
+                                 {
+                                     J.object([&]
+                                              {
+                                                  J.attribute("first", interval.first);
+                                                  J.attribute("last", interval.last);
+                                                  J.attribute("stride", interval.stride);
+                                                  if (interval.lastFromSize)
+                                                      J.attribute("lastFromSize", true); });
+                                 } });
+        }
+
+    public:
+        explicit JSONLReportWriter(raw_ostream &OS) : OS(OS) {}
+
+        void beginModule(StringRef module, StringRef sourceFile, const MPIEntryPointTable &table) override
+        {
+            record("module", [&](json::OStream &J)
+                   { J.attribute("name", module); });
+            for (MPICommId id = 0; id < table.comms.size(); id++)
+            {
+                record("communicator", [&](json::OStream &J)
+                       {
+                           J.attribute("id", int64_t(id));
+                           J.attribute("name", table.comms[id].name);
+                           J.attribute("origin", table.comms[id].origin);
+                           J.attribute("parent", int64_t(table.comms[id].parent)); });
+            }
+        }
+
+        void function(StringRef name, size_t directCalls) override
+        {
+            currentFunction = name.str();
+            record("function", [&](json::OStream &J)
+                   {
+                       J.attribute("name", name);
+                       J.attribute("directCalls", int64_t(directCalls)); });
+        }
+
+        void call(const MPICommunication &call, ArrayRef<RankInterval> rankIntervals,
+                  const MPIEntryPointTable &table) override
+        {
+            const MPIEntryPoint &entry = getEntryPoint(call.kind);
+            record("call", [&](json::OStream &J)
+                   {
+                       J.attribute("function", currentFunction);
+                       J.attribute("op", entry.name);
+                       if (entry.commArg >= 0)
+                           J.attribute("comm", table.getCommName(call.comm));
+                       if (entry.tagArg >= 0)
+                           tagAttribute(J, call.tag);
+                       if (entry.peerArg >= 0)
+                       {
+                           J.attribute("peer", printToString([&](raw_ostream &OS)
+                                                             { printPeer(OS, call, rankIntervals); }));
+                           rankSet(J, "peerRanks", getPeerRanks(call, rankIntervals));
+                           if (call.comm != WorldCommId && call.peerKind == PeerKind::Constant)
+                               rankSet(J, "worldPeerRanks", table.toWorldRanks(call.comm, call.rank, call.executingRank));
+                       }
+                       if (call.executingRank >= 0)
+                           J.attribute("executingRank", call.executingRank);
+                       if (call.executingIntervals)
+                           rankSet(J, "executingRanks", getExecutingRanks(call, rankIntervals));
+                       if (entry.countArg >= 0 && call.bytes)
+                           J.attribute("bytes", int64_t(call.bytes));
+                       J.attribute("frequency", call.frequency);
+                       J.attribute("exactFrequency", call.exactFrequency); });
+        }
+
+        void beginParticipation() override {}
+
+        void participation(StringRef comm, int32_t tag, const RankSet &ranks, const RankSet *worldRanks) override
+        {
+            record("participation", [&](json::OStream &J)
+                   {
+                       J.attribute("comm", comm);
+                       J.attribute("tag", tag);
+                       rankSet(J, "ranks", ranks);
+                       if (worldRanks && !worldRanks->empty())
+                           rankSet(J, "worldRanks", *worldRanks); });
+        }
+
+        void unmatchedShift(const MPICommunication &call, StringRef comm) override
+        {
+            record("unmatched", [&](json::OStream &J)
+                   {
+                       J.attribute("op", getEntryPoint(call.kind).name);
+                       J.attribute("peer", printToString([&](raw_ostream &OS)
+                                                         { printPeer(OS, call, {}); }));
+                       J.attribute("comm", comm);
+                       tagAttribute(J, call.tag); });
+        }
+
+        void beginHotChannels() override {}
+
+        void hotChannel(size_t index, const MPICommunication &send, unsigned calls, double bytes, bool exact,
+                        ArrayRef<RankInterval> rankIntervals, const MPIEntryPointTable &table) override
+        {
+            record("channel", [&](json::OStream &J)
+                   {
+                       J.attribute("index", int64_t(index));
+                       J.attribute("comm", table.getCommName(send.comm));
+                       if (send.executingRank >= 0)
+                           J.attribute("src", send.executingRank);
+                       else if (send.executingIntervals)
+                           rankSet(J, "srcRanks", getExecutingRanks(send, rankIntervals));
+                       J.attribute("dst", printToString([&](raw_ostream &OS)
+                                                        { printPeer(OS, send, rankIntervals); }));
+                       tagAttribute(J, send.tag);
+                       J.attribute("calls", int64_t(calls));
+                       J.attribute("bytes", bytes);
+                       J.attribute("exact", exact); });
+        }
+
+        void endHotChannels(size_t omitted) override {}
+
+        void loadProfile(ArrayRef<MPIRankLoad> loads, ArrayRef<int32_t> outliers, const MPIRankLoad &median) override
+        {
+            for (size_t first = 0, last; first < loads.size(); first = last + 1)
+            {
+                for (last = first; last + 1 < loads.size() && loads[last + 1] == loads[first]; last++)
+                    ;
+                record("load", [&](json::OStream &J)
+                       {
+                           J.attribute("firstRank", int64_t(first));
+                           J.attribute("lastRank", int64_t(last));
+                           J.attribute("sends", loads[first].sends);
+                           J.attribute("receives", loads[first].receives);
+                           J.attribute("bytes", loads[first].bytes);
+                           J.attribute("blocking", loads[first].blocking);
+                           J.attribute("outlier", is_contained(outliers, int32_t(first))); });
+            }
+        }
+
+        void beginQueueLint(int32_t) override {}
+
+        void queueFinding(const MPIQueueFinding &finding, const MPIEntryPointTable &table) override
+        {
+            static const char *const kinds[] = {"wildcardReceive", "deepQueue", "tagReorder"};
+            record("queue", [&](json::OStream &J)
+                   {
+                       J.attribute("kind", kinds[size_t(finding.kind)]);
+                       J.attribute("severity", finding.severity);
+                       J.attribute("depth", finding.depth);
+                       J.attribute("comm", table.getCommName(finding.comm));
+                       tagAttribute(J, finding.tag);
+                       J.attribute("function", finding.function);
+                       J.attribute("op", getEntryPoint(finding.call->kind).name);
+                       J.attribute("peer", printToString([&](raw_ostream &OS)
+                                                         { printSource(OS, *finding.call, finding.rankIntervals, table); }));
+                       if (finding.kind == MPIQueueFinding::Kind::TagReorder)
+                       {
+                           J.attribute("sentFirstTag", finding.sentFirstTag);
+                           J.attribute("inversions", int64_t(finding.inversions));
+                           J.attribute("sendFunction", finding.sendFunction);
+                       } });
+        }
+
+        void endQueueLint(size_t) override {}
+
+        void beginThreadReport(Optional<MPIThreadLevel> requested, size_t regions) override
+        {
+            requestedThreadLevel = requested;
+            threadedRegions = regions;
+        }
+
+        void threadedCall(const MPICommunication &call, StringRef function, MPIThreadLevel needed,
+                          const MPIEntryPointTable &table) override
+        {
+            const MPIEntryPoint &entry = getEntryPoint(call.kind);
+            record("thread", [&](json::OStream &J)
+                   {
+                       J.attribute("function", function);
+                       J.attribute("op", entry.name);
+                       if (entry.commArg >= 0)
+                           J.attribute("comm", table.getCommName(call.comm));
+                       J.attribute("needed", getThreadLevelName(needed));
+                       J.attribute("frequency", call.frequency); });
+        }
+
+        void contentionHotspot(size_t index, const MPIContentionHotspot &hotspot,
+                               const MPIEntryPointTable &table) override
+        {
+            record("contention", [&](json::OStream &J)
+                   {
+                       J.attribute("index", int64_t(index));
+                       if (hotspot.comm)
+                           J.attribute("comm", table.getCommName(*hotspot.comm));
+                       else
+                           J.attribute("comm", nullptr);
+                       J.attribute("sites", int64_t(hotspot.sites));
+                       J.attribute("calls", hotspot.calls);
+                       J.attribute("exact", hotspot.exact);
+                       J.attribute("function", hotspot.function); });
+        }
+
+        void endThreadReport(MPIThreadLevel needed, size_t) override
+        {
+            record("threadLevel", [&](json::OStream &J)
+                   {
+                       if (requestedThreadLevel)
+                           J.attribute("requested", getThreadLevelName(*requestedThreadLevel));
+                       else
+                           J.attribute("requested", nullptr);
+                       J.attribute("needed", getThreadLevelName(needed));
+                       J.attribute("regions", int64_t(threadedRegions)); });
+        }
+
+        void endModule() override { OS.flush(); }
+    };
+
+    // Compact binary records, in the format described by MPIReportRecord
+    class BinaryReportWriter : public MPIReportWriter
+    {
+    private:
+        raw_ostream &OS;
+        support::endian::Writer W;
+        const MPIEntryPointTable *table = nullptr;
+
+        void record(MPIReportRecord type) { W.write<uint8_t>(uint8_t(type)); }
+
+        void string(StringRef text)
+        {
+            W.write<uint32_t>(text.size());
+            OS << text;
+        }
+
+        void rankSet(const RankSet &ranks)
+        {
+            W.write<uint32_t>(ranks.getIntervals().size());
+            for (const RankInterval &interval : ranks.getIntervals())
+            {
+                W.write<int32_t>(interval.first);
+                W.write<int32_t>(interval.last);
+                W.write<int32_t>(interval.stride);
+                W.write<uint8_t>(interval.lastFromSize);
+            }
+        }
+
+        // Interval peers are written as the interval's first rank; the exact set is in peerRanks
+        void peer(const MPICommunication &call, ArrayRef<RankInterval> rankIntervals)
+        {
+            W.write<uint8_t>(uint8_t(call.peerKind));
+            W.write<int32_t>(call.peerKind == PeerKind::Interval ? rankIntervals[call.rank].first : call.rank);
+        }
+
+        // Finds the ID of a communicator reported by name
+        uint32_t commId(StringRef comm) const
+        {
+            for (MPICommId id = 0; id < table->comms.size(); id++)
+                if (table->comms[id].name == comm)
+                    return id;
+            return UnresolvedCommId;
+        }
+
+    public:
+        explicit BinaryReportWriter(raw_ostream &OS) : OS(OS), W(OS, support::little) {}
+
+        void beginModule(StringRef module, StringRef sourceFile, const MPIEntryPointTable &table) override
+        {
+            this->table = &table;
+            OS.write(MPIReportMagic, sizeof(MPIReportMagic));
+            W.write<uint32_t>(MPIReportVersion);
+            record(MPIReportRecord::Module);
+            string(module);
+            string(sourceFile);
+            for (MPICommId id = 0; id < table.comms.size(); id++)
+            {
+                record(MPIReportRecord::Communicator);
+                W.write<uint32_t>(id);
+                W.write<uint32_t>(table.comms[id].parent);
+                string(table.comms[id].name);
+                string(table.comms[id].origin);
+            }
+        }
+
+        void function(StringRef name, size_t directCalls) override
+        {
+            record(MPIReportRecord::Function);
+            string(name);
+            W.write<uint32_t>(directCalls);
+        }
+
+        void call(const MPICommunication &call, ArrayRef<RankInterval> rankIntervals,
+                  const MPIEntryPointTable &table) override
+        {
+            record(MPIReportRecord::Call);
+            W.write<uint8_t>(uint8_t(call.kind));
+            W.write<uint8_t>(uint8_t(getEntryPoint(call.kind).opClass));
+            W.write<uint8_t>(isReceive(call.kind));
+            W.write<uint32_t>(call.comm);
+            W.write<int32_t>(call.tag);
+            peer(call, rankIntervals);
+            W.write<int32_t>(call.executingRank);
+            W.write<uint32_t>(call.bytes);
+            W.write<float>(call.frequency);
+            W.write<uint8_t>(call.exactFrequency);
+            rankSet(getPeerRanks(call, rankIntervals));
+            rankSet(call.comm != WorldCommId && call.peerKind == PeerKind::Constant
+                        ? table.toWorldRanks(call.comm, call.rank, call.executingRank)
+                        : RankSet());
+            rankSet(getExecutingRanks(call, rankIntervals));
+        }
+
+        void beginParticipation() override {}
+
+        void participation(StringRef comm, int32_t tag, const RankSet &ranks, const RankSet *worldRanks) override
+        {
+            record(MPIReportRecord::Participation);
+            W.write<uint32_t>(commId(comm));
+            W.write<int32_t>(tag);
+            rankSet(ranks);
+            rankSet(worldRanks ? *worldRanks : RankSet());
+        }
+
+        void unmatchedShift(const MPICommunication &call, StringRef) override
+        {
+            record(MPIReportRecord::Unmatched);
+            W.write<uint8_t>(uint8_t(call.kind));
+            W.write<uint32_t>(call.comm);
+            W.write<int32_t>(call.tag);
+            peer(call, {});
+        }
+
+        void beginHotChannels() override {}
+
+        void hotChannel(size_t index, const MPICommunication &send, unsigned calls, double bytes, bool exact,
+                        ArrayRef<RankInterval> rankIntervals, const MPIEntryPointTable &) override
+        {
+            record(MPIReportRecord::Channel);
+            W.write<uint32_t>(index);
+            W.write<uint32_t>(send.comm);
+            W.write<int32_t>(send.executingRank);
+            peer(send, rankIntervals);
+            W.write<int32_t>(send.tag);
+            W.write<uint32_t>(calls);
+            W.write<double>(bytes);
+            W.write<uint8_t>(exact);
+        }
+
+        void endHotChannels(size_t) override {}
+
+        // Readers derive the load from the executing ranks of the call records
+        void loadProfile(ArrayRef<MPIRankLoad>, ArrayRef<int32_t>, const MPIRankLoad &) override {}
+        void beginQueueLint(int32_t) override {}
+        void queueFinding(const MPIQueueFinding &, const MPIEntryPointTable &) override {}
+        void endQueueLint(size_t) override {}
+        // Thread levels are a property of the module's OpenMP structure, which the records do not describe
+        void beginThreadReport(Optional<MPIThreadLevel>, size_t) override {}
+        void threadedCall(const MPICommunication &, StringRef, MPIThreadLevel, const MPIEntryPointTable &) override {}
+        void contentionHotspot(size_t, const MPIContentionHotspot &, const MPIEntryPointTable &) override {}
+        void endThreadReport(MPIThreadLevel, size_t) override {}
+
+        void endModule() override
+        {
+            record(MPIReportRecord::End);
+            OS.flush();
+        }
+    };
+
+    // OpenMP runtime entry points that run an outlined function on the threads of a team, or as a task on any
+    // thread, and the argument that passes the function (clang's libomp & GCC's libgomp)
+    struct OpenMPFork
+    {
+        const char *name;
+        unsigned bodyArg;
+    };
+    const OpenMPFork openMPForks[] = {
+        {"__kmpc_fork_call", 2},
+        {"__kmpc_fork_teams", 2},
+        {"__kmpc_omp_task_alloc", 5},
+        {"GOMP_parallel", 0},
+        {"GOMP_task", 0},
+    };
+
+    // OpenMP runtime calls that restrict the threads running the code they guard. Master, masked & single
+    // constructs branch on their result being nonzero (omp_get_thread_num() on it being 0); critical sections
+    // lie between a start & an end call.
+    struct OpenMPGuard
+    {
+        const char *name;
+        const char *end;      // End of a critical section, or null for a branch on the result
+        MPIThreadLevel level; // The most a guarded call needs
+        bool onZero;          // The guarded code runs if the result is 0
+    };
+    const OpenMPGuard openMPGuards[] = {
+        {"__kmpc_master", nullptr, MPIThreadLevel::Funneled, false},
+        {"omp_get_thread_num", nullptr, MPIThreadLevel::Funneled, true},
+        {"__kmpc_masked", nullptr, MPIThreadLevel::Serialized, false}, // The filter may pick another thread
+        {"__kmpc_single", nullptr, MPIThreadLevel::Serialized, false},
+        {"GOMP_single_start", nullptr, MPIThreadLevel::Serialized, false},
+        {"__kmpc_critical", "__kmpc_end_critical", MPIThreadLevel::Serialized, false},
+        {"__kmpc_critical_with_hint", "__kmpc_end_critical", MPIThreadLevel::Serialized, false},
+        {"GOMP_critical_start", "GOMP_critical_end", MPIThreadLevel::Serialized, false},
+        {"GOMP_critical_name_start", "GOMP_critical_name_end", MPIThreadLevel::Serialized, false},
+    };
+
+    // Returns the outlined function that a parallel region or task call runs on other threads, or null
+    Function *getForkedBody(const CallBase &call)
+    {
+        Function *callee = call.getCalledFunction();
+        if (!callee)
+            return nullptr;
+        for (const OpenMPFork &fork : openMPForks)
+        {
+            if (callee->getName() == fork.name && call.arg_size() > fork.bodyArg)
+                return dyn_cast<Function>(call.getArgOperand(fork.bodyArg)->stripPointerCasts());
+        }
+        return nullptr;
+    }
+
+    // Function to visit the calls of F: its direct calls, and the parallel regions & tasks that run it
+    // (callback(call, forked)). The outlined body is passed to the runtime, usually through a bitcast.
+    void forEachCallOf(Function &F, function_ref<void(CallBase &, bool)> callback)
+    {
+        for (User *user : F.users())
+        {
+            auto *call = dyn_cast<CallBase>(user);
+            if (call && call->getCalledFunction() == &F)
+            {
+                callback(*call, false);
+                continue;
+            }
+            auto visitFork = [&](User *forkUser)
+            {
+                auto *fork = dyn_cast<CallBase>(forkUser);
+                if (fork && getForkedBody(*fork) == &F)
+                    callback(*fork, true);
+            };
+            if (isa<ConstantExpr>(user))
+                for_each(user->users(), visitFork);
+            else
+                visitFork(user);
+        }
+    }
+
+    // Function to find every function that reaches MPI: walks up from the MPI callers through
+    // their callers' use lists, and from outlined parallel regions & tasks to the functions that run them
+    SmallPtrSet<Function *, 32> getFunctionsReachingMPI(const MPIEntryPointTable &table)
+    {
+        SmallPtrSet<Function *, 32> reachesMPI(table.callers.begin(), table.callers.end());
+        SmallVector<Function *, 32> worklist(table.callers.begin(), table.callers.end());
+        while (!worklist.empty())
+        {
+            Function *callee = worklist.pop_back_val();
+            forEachCallOf(*callee, [&](CallBase &call, bool)
+                          {
+                              if (reachesMPI.insert(call.getFunction()).second)
+                                  worklist.push_back(call.getFunction()); });
+        }
+        return reachesMPI;
+    }
+
+    // Checks whether a call may communicate: an MPI or indirect call, or a call of a function, parallel
+    // region or task that reaches MPI
+    bool mayCommunicate(const CallBase &call, const MPIEntryPointTable &table,
+                        const SmallPtrSetImpl<Function *> &reachesMPI)
+    {
+        Function *callee = call.getCalledFunction();
+        if (!callee || table.lookup(call) || reachesMPI.count(callee))
+            return true;
+        Function *body = getForkedBody(call);
+        return body && reachesMPI.count(body);
+    }
+
+    // Options of the mpi-analysis pass, given as mpi-analysis<key=value;...>
+    struct MPIAnalysisOptions
+    {
+        enum class Format
+        {
+            Text,  // format=text: human-readable report (default)
+            JSONL, // format=jsonl: one JSON record per line
+            Binary // format=binary: compact binary records (requires out=)
+        };
+
+        Format format = Format::Text;
+        std::string out;               // out=<file>: report file; the report goes to stderr by default
+        bool quiet = false;            // quiet: omit the per-function & per-call records
+        std::string cacheDir;          // cache-dir=<dir>: persistent cache of function summaries
+        std::string trafficMatrixFile; // traffic-matrix=<file>: export the rank-to-rank traffic matrix
+        int32_t ranks = 0;             // ranks=<N>: job size used to instantiate symbolic rank patterns
+        bool lint = false;             // lint: report unexpected-message queue pressure
+    };
+
+    // Parses the parameters of mpi-analysis<...>
+    Expected<MPIAnalysisOptions> parseMPIAnalysisOptions(StringRef params)
+    {
+        MPIAnalysisOptions options;
+        while (!params.empty())
+        {
+            StringRef param, key, value;
+            std::tie(param, params) = params.split(';');
+            std::tie(key, value) = param.split('=');
+            if (key == "format" && (value == "text" || value == "jsonl" || value == "binary"))
+                options.format = value == "text"    ? MPIAnalysisOptions::Format::Text
+                                 : value == "jsonl" ? MPIAnalysisOptions::Format::JSONL
+                                                    : MPIAnalysisOptions::Format::Binary;
+            else if (key == "out" && !value.empty())
+                options.out = value.str();
+            else if (key == "quiet" && value.empty())
+                options.quiet = true;
+            else if (key == "lint" && value.empty())
+                options.lint = true;
+            else if (key == "cache-dir" && !value.empty())
+                options.cacheDir = value.str();
+            else if (key == "traffic-matrix" && !value.empty())
+                options.trafficMatrixFile = value.str();
+            else if (key == "ranks" && !value.getAsInteger(10, options.ranks) && options.ranks > 0)
+                continue;
+            else
+                return createStringError(inconvertibleErrorCode(), "invalid mpi-analysis parameter '%s'",
+                                         param.str().c_str());
+        }
+        if (options.format == MPIAnalysisOptions::Format::Binary && options.out.empty())
+            return createStringError(inconvertibleErrorCode(), "mpi-analysis<format=binary> requires out=<file>");
+        return options;
+    }
+
+    // Main analysis pass that analyzes MPI communication patterns across a module
+    struct MPIAnalysisPass : public PassInfoMixin<MPIAnalysisPass>
+    {
+        MPIAnalysisOptions options;
+
+        explicit MPIAnalysisPass(MPIAnalysisOptions options = {}) : options(std::move(options)) {}
+
+        // Function that runs the analysis pass on the given module M
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            // The report is streamed through a buffered stream: the out= file, or stderr
+            std::error_code EC;
+            raw_fd_ostream OS(options.out.empty() ? "-" : options.out, EC,
+                              options.format == MPIAnalysisOptions::Format::Binary ? sys::fs::OF_None : sys::fs::OF_Text);
+            if (EC)
+            {
+                errs() << "[ERROR] Cannot write " << options.out << ": " << EC.message() << "\n";
+                return PreservedAnalyses::all();
+            }
+            Optional<raw_fd_ostream> stderrStream;
+            if (options.out.empty())
+                stderrStream.emplace(2, /*shouldClose=*/false);
+            std::unique_ptr<MPIReportWriter> writer = createWriter(stderrStream ? *stderrStream : OS);
+
+            // Each phase is timed while it runs, if -time-passes is given
+            Optional<NamedRegionTimer> phase;
+            auto startPhase = [&](StringRef name, StringRef description)
+            {
+                phase.reset();
+                phase.emplace(name, description, PhaseTimerGroup, PhaseTimerGroupDescription, TimePassesIsEnabled);
+            };
+
+            startPhase("detection", "Detection: MPI call sites & function summaries");
+            FunctionAnalysisManager &FAM =
+                MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            const MPIEntryPointTable &table = MAM.getResult<MPIEntryPointAnalysis>(M);
+
+            // Only functions that contain MPI calls are summarized; all other functions are never touched.
+            // With a summary cache, unchanged functions are read from it instead of being analyzed.
+            Optional<MPISummaryCache> cache;
+            if (!options.cacheDir.empty())
+                cache.emplace(options.cacheDir, table);
+            std::vector<MPIFunctionSummary> cachedSummaries;
+            cachedSummaries.reserve(table.callers.size());
+            DenseMap<const Function *, const MPIFunctionSummary *> summaries;
+            size_t cacheHits = 0;
+            for (Function *F : table.callers)
+            {
+                if (!cache)
+                {
+                    summaries[F] = &FAM.getResult<MPIFunctionAnalysis>(*F);
+                    continue;
+                }
+                std::string key = cache->getKey(*F);
+                cachedSummaries.emplace_back();
+                if (cache->lookup(key, cachedSummaries.back()))
+                {
+                    cacheHits++;
+                    NumSummaryCacheHits++;
+                }
+                else
+                {
+                    cachedSummaries.back() = FAM.getResult<MPIFunctionAnalysis>(*F);
+                    cache->store(key, cachedSummaries.back());
+                }
+                summaries[F] = &cachedSummaries.back();
+            }
+
+            // The packed records of the whole module are copied into one contiguous array
+            std::vector<MPICommunication> mpiCalls;   // All MPI calls of the module
+            std::vector<RankInterval> rankIntervals; // Peer & executing-rank intervals of the module
+            for (Function *F : table.callers)
+            {
+                const MPIFunctionSummary &summary = *summaries[F];
+                for (MPICommunication call : summary.mpiCalls)
+                {
+                    if (call.peerKind == PeerKind::Interval)
+                    {
+                        rankIntervals.push_back(summary.rankIntervals[call.rank]);
+                        call.rank = rankIntervals.size() - 1;
+                    }
+                    if (call.executingIntervals)
+                    {
+                        auto executing = makeArrayRef(summary.rankIntervals).slice(call.executingRanks, call.executingIntervals);
+                        call.executingRanks = rankIntervals.size();
+                        rankIntervals.insert(rankIntervals.end(), executing.begin(), executing.end());
+                    }
+                    mpiCalls.push_back(call);
+                }
+            }
+
+            // Combine the summaries across the call graph
+            SmallPtrSet<Function *, 32> reachesMPI = getFunctionsReachingMPI(table);
+
+            // Output the per-function summaries for debugging, unless the report is quiet
+            startPhase("reporting", "Reporting: records, hot channels, load profile & lints");
+            writer->beginModule(M.getModuleIdentifier(), M.getSourceFileName(), table);
+            for (Function &F : M)
+            {
+                if (!reachesMPI.count(&F))
+                    continue;
+
+                const MPIFunctionSummary *summary = summaries.lookup(&F);
+                if (!summary)
+                {
+                    // Reaches MPI only through its callees
+                    MPIFunctionSummary &calleesOnly = FAM.getResult<MPIFunctionAnalysis>(F);
+                    calleesOnly.reachesMPI = true;
+                    summary = &calleesOnly;
+                }
+                if (options.quiet)
+                    continue;
+
+                writer->function(F.getName(), summary->mpiCalls.size());
+                for (const MPICommunication &call : summary->mpiCalls)
+                {
+                    writer->call(call, summary->rankIntervals, table);
+                }
+            }
+
+            startPhase("participation", "Participation: (comm, tag) groups & shift matching");
+            analyzeUniformParticipation(mpiCalls, rankIntervals, table, *writer); // Analyze uniform participation patterns once per module
+            startPhase("reporting", "Reporting: records, hot channels, load profile & lints");
+            reportHotChannels(mpiCalls, rankIntervals, table, *writer);           // Rank the channels by estimated message volume
+            reportLoadProfile(mpiCalls, rankIntervals, *writer);                  // Compare the communication load of the ranks
+            if (options.lint)
+                reportQueueLint(summaries, table, *writer);                      // Lint the unexpected-message queue pressure
+            reportThreadSafety(M, summaries, table, reachesMPI, FAM, *writer);   // Check the MPI calls of OpenMP threads
+            writer->endModule();
+            if (cache)
+                errs() << "[INFO] Summary cache: " << cacheHits << " of " << table.callers.size()
+                       << " function(s) unchanged\n";
+            if (!options.trafficMatrixFile.empty())
+                exportTrafficMatrix(mpiCalls, rankIntervals, table);     // Write the rank-to-rank traffic matrix
+            phase.reset();
+            return PreservedAnalyses::all();                              // Indicate that all analyses are preserved
+        }
+
+        // Function to create the report writer for the requested format
+        std::unique_ptr<MPIReportWriter> createWriter(raw_ostream &OS) const
+        {
+            switch (options.format)
+            {
+            case MPIAnalysisOptions::Format::JSONL:
+                return std::make_unique<JSONLReportWriter>(OS);
+            case MPIAnalysisOptions::Format::Binary:
+                return std::make_unique<BinaryReportWriter>(OS);
+            case MPIAnalysisOptions::Format::Text:
+                break;
+            }
+            return std::make_unique<TextReportWriter>(OS);
+        }
+
+        // Function to write the weighted rank-to-rank traffic matrix of the point-to-point sends as a sparse
+        // edge list of "src dst bytes" lines (world ranks), one row of the matrix at a time. Symbolic peers are
+        // instantiated for the job size given by ranks=N; only the current row is held in memory.
+        void exportTrafficMatrix(ArrayRef<MPICommunication> mpiCalls, ArrayRef<RankInterval> rankIntervals,
+                                 const MPIEntryPointTable &table)
+        {
+            // The sends that contribute traffic, with their bytes per invocation of the sending function
+            std::vector<std::pair<const MPICommunication *, double>> sends;
+            int32_t ranks = options.ranks;
+            bool symbolic = false;
+            for (const MPICommunication &call : mpiCalls)
+            {
+                const MPIEntryPoint &entry = getEntryPoint(call.kind);
+                if (entry.opClass != MPIOpClass::PointToPoint || isReceive(call.kind) || entry.countArg < 0 ||
+                    call.peerKind == PeerKind::Unknown || call.bytes == 0)
+                    continue;
+                if (call.comm != WorldCommId && call.peerKind != PeerKind::Constant)
+                    continue; // Only constant communicator-local peers can be translated to world ranks
+
+                sends.emplace_back(&call, double(call.bytes) * call.frequency);
+
+                // Without ranks=N the job size is inferred from concrete executing & destination ranks
+                RankSet dst = table.toWorldRanks(call.comm, call.rank, call.executingRank);
+                if (call.executingRank < 0 || call.peerKind != PeerKind::Constant || !dst.isSingleton())
+                    symbolic = true;
+                else if (!options.ranks)
+                    ranks = std::max({ranks, call.executingRank + 1, dst.getIntervals()[0].first + 1});
+            }
+            if (symbolic && !options.ranks)
+            {
+                errs() << "[WARN] The traffic matrix has symbolic rank patterns; pass "
+                          "mpi-analysis<ranks=N;...> to export it for a job of N ranks\n";
+                return;
+            }
+
+            std::error_code EC;
+            raw_fd_ostream OS(options.trafficMatrixFile, EC, sys::fs::OF_Text);
+            if (EC)
+            {
+                errs() << "[ERROR] Cannot write " << options.trafficMatrixFile << ": " << EC.message() << "\n";
+                return;
+            }
+            OS << "# MPI rank-to-rank traffic matrix: src dst bytes (world ranks, bytes per invocation)\n";
+            OS << "# ranks " << ranks << "\n";
+
+            uint64_t edges = 0;
+            std::vector<std::pair<int32_t, double>> row; // (dst, bytes) of the current src
+            for (int32_t src = 0; src < ranks; src++)
+            {
+                row.clear();
+                for (const auto &send : sends)
+                {
+                    const MPICommunication &call = *send.first;
+                    if (!getExecutingRanks(call, rankIntervals).contains(src))
+                        continue;
+                    addTrafficRow(call, send.second, src, ranks, rankIntervals, table, row);
+                }
+                if (row.empty())
+                    continue;
+
+                // Merge the traffic of the sends that share a destination
+                llvm::sort(row, [](const std::pair<int32_t, double> &a, const std::pair<int32_t, double> &b)
+                           { return a.first < b.first; });
+                for (size_t i = 0; i < row.size();)
+                {
+                    int32_t dst = row[i].first;
+                    double bytes = 0;
+                    for (; i < row.size() && row[i].first == dst; i++)
+                        bytes += row[i].second;
+                    OS << src << " " << dst << " " << format("%.0f", bytes) << "\n";
+                    edges++;
+                }
+            }
+            errs() << "[INFO] Wrote traffic matrix of " << ranks << " ranks & " << edges << " edge(s) to "
+                   << options.trafficMatrixFile << "\n";
+        }
+
+        // Function to append the destinations (& bytes) that rank src sends to through one send call
+        static void addTrafficRow(const MPICommunication &call, double bytes, int32_t src, int32_t ranks,
+                                  ArrayRef<RankInterval> rankIntervals, const MPIEntryPointTable &table,
+                                  std::vector<std::pair<int32_t, double>> &row)
+        {
+            auto add = [&](int64_t dst, double weight)
+            {
+                if (dst >= 0 && dst < ranks && dst != src)
+                    row.emplace_back(int32_t(dst), weight);
+            };
+
+            switch (call.peerKind)
+            {
+            case PeerKind::Constant:
+                if (call.comm == WorldCommId)
+                    add(call.rank, bytes);
+                else
+                {
+                    RankSet world = table.toWorldRanks(call.comm, call.rank, src);
+                    if (world.isSingleton())
+                        add(world.getIntervals()[0].first, bytes);
+                }
+                break;
+            case PeerKind::Relative:
+                add(int64_t(src) + call.rank, bytes);
+                break;
+            case PeerKind::RelativeModSize:
+                add(((int64_t(src) + call.rank) % ranks + ranks) % ranks, bytes);
+                break;
+            case PeerKind::Interval:
+            {
+                // The frequency covers every iteration, so each destination gets an equal share
+                const RankInterval &interval = rankIntervals[call.rank];
+                int64_t last = interval.lastFromSize ? int64_t(ranks) + interval.last : interval.last;
+                last = std::min<int64_t>(last, ranks - 1);
+                if (last < interval.first)
+                    break;
+                int64_t count = (last - interval.first) / interval.stride + 1;
+                for (int64_t dst = interval.first; dst <= last; dst += interval.stride)
+                    add(dst, bytes / count);
+                break;
+            }
+            case PeerKind::Unknown:
+                break;
+            }
+        }
+
+        // Function to rank the point-to-point channels (comm, src, dst, tag) by estimated bytes per
+        // invocation of the sending function. A channel is counted at its sends: bytes per execution * frequency.
+        void reportHotChannels(ArrayRef<MPICommunication> mpiCalls, ArrayRef<RankInterval> rankIntervals,
+                               const MPIEntryPointTable &table, MPIReportWriter &writer)
+        {
+            struct Channel
+            {
+                const MPICommunication *send; // First send of the channel; identifies comm, src, dst & tag
+                unsigned calls = 0;           // Send call sites on the channel
+                double volume = 0;            // Estimated bytes
+                bool exact = true;            // Whether all sizes & frequencies are exact
+            };
+
+            // Channels keyed by (packed (comm, tag), src, dst); src numbers the distinct executing-rank sets,
+            // dst packs the peer kind and value
+            DenseMap<std::tuple<uint64_t, unsigned, uint64_t>, unsigned> channelIndex;
+            StringMap<unsigned> srcIds; // Printed executing-rank set -> src
+            std::vector<Channel> channels;
+            for (const MPICommunication &call : mpiCalls)
+            {
+                const MPIEntryPoint &entry = getEntryPoint(call.kind);
+                if (entry.opClass != MPIOpClass::PointToPoint || isReceive(call.kind) || entry.countArg < 0)
+                    continue;
+
+                std::string ranks = printToString([&](raw_ostream &OS)
+                                                  { getExecutingRanks(call, rankIntervals).print(OS); });
+                unsigned src = srcIds.try_emplace(ranks, srcIds.size()).first->second;
+                uint64_t dst = (uint64_t(call.peerKind) << 32) | uint32_t(call.rank);
+                auto inserted = channelIndex.try_emplace(
+                    std::make_tuple(packCommTag(call.comm, call.tag), src, dst), channels.size());
+                if (inserted.second)
+                    channels.push_back({&call});
+
+                Channel &channel = channels[inserted.first->second];
+                channel.calls++;
+                channel.volume += double(call.bytes) * call.frequency;
+                channel.exact &= call.exactFrequency && call.bytes != 0;
+            }
+            if (channels.empty())
+                return;
+
+            llvm::stable_sort(channels, [](const Channel &a, const Channel &b)
+                              { return a.volume > b.volume; });
+
+            const size_t maxChannels = 20;
+            writer.beginHotChannels();
+            for (size_t i = 0; i < channels.size() && i < maxChannels; i++)
+            {
+                const Channel &channel = channels[i];
+                writer.hotChannel(i + 1, *channel.send, channel.calls, channel.volume, channel.exact, rankIntervals, table);
+            }
+            writer.endHotChannels(channels.size() - std::min(channels.size(), maxChannels));
+        }
+
+        // Function to compute the load one call adds to each rank that executes it, if it executes frequency times
+        static MPIRankLoad getCallLoad(const MPICommunication &call, double frequency)
+        {
+            MPIRankLoad load;
+            bool blocking = false;
+            switch (call.kind)
+            {
+            case MPIOpKind::Send:
+            case MPIOpKind::Ssend:
+            case MPIOpKind::Bsend:
+            case MPIOpKind::Rsend:
+                blocking = true;
+                LLVM_FALLTHROUGH;
+            case MPIOpKind::Isend:
+            case MPIOpKind::Issend:
+            case MPIOpKind::Ibsend:
+            case MPIOpKind::Irsend:
+                load.sends = frequency;
+                break;
+            case MPIOpKind::Recv:
+                blocking = true;
+                LLVM_FALLTHROUGH;
+            case MPIOpKind::Irecv:
+                load.receives = frequency;
+                break;
+            case MPIOpKind::Sendrecv:
+            case MPIOpKind::SendrecvReplace:
+                load.sends = load.receives = frequency;
+                blocking = true;
+                break;
+            case MPIOpKind::Probe:
+            case MPIOpKind::Wait:
+            case MPIOpKind::Waitall:
+            case MPIOpKind::Waitany:
+            case MPIOpKind::Waitsome:
+                blocking = true;
+                break;
+            default:
+                // Blocking collectives precede the nonblocking ones in MPIOpKind
+                blocking = call.kind >= MPIOpKind::Barrier && call.kind <= MPIOpKind::Alltoallv;
+                break;
+            }
+            if (getEntryPoint(call.kind).opClass == MPIOpClass::Collective || load.messages() > 0)
+                load.bytes = double(call.bytes) * frequency * (load.sends && load.receives ? 2 : 1);
+            if (blocking)
+                load.blocking = frequency;
+            return load;
+        }
+
+        // Function to estimate the communication load of every world rank from the executing ranks of the calls,
+        // and to flag the ranks that carry at least twice the median load in messages or bytes. The job size
+        // is given by ranks=N, or inferred when all calls are guarded by concrete ranks.
+        void reportLoadProfile(ArrayRef<MPICommunication> mpiCalls, ArrayRef<RankInterval> rankIntervals,
+                               MPIReportWriter &writer)
+        {
+            int32_t ranks = options.ranks;
+            bool guarded = false, symbolic = false;
+            for (const MPICommunication &call : mpiCalls)
+            {
+                if (getCallLoad(call, call.frequency) == MPIRankLoad())
+                    continue;
+                guarded |= call.executingIntervals != 0;
+                for (const RankInterval &interval : getExecutingRanks(call, rankIntervals).getIntervals())
+                {
+                    symbolic |= interval.lastFromSize;
+                    if (!options.ranks && !interval.lastFromSize)
+                        ranks = std::max(ranks, interval.last + 1);
+                }
+            }
+            if (!guarded)
+                return; // Every rank makes every call
+            if (symbolic && !options.ranks)
+            {
+                errs() << "[INFO] The executing ranks are symbolic; pass mpi-analysis<ranks=N;...> for the "
+                          "communication load per rank of a job of N ranks\n";
+                return;
+            }
+
+            // Calls are added over their executing ranks with one difference array per stride
+            std::map<int32_t, std::vector<MPIRankLoad>> deltas;
+            for (const MPICommunication &call : mpiCalls)
+            {
+                // A loop over an interval of peers is estimated to run once per peer
+                double frequency = call.frequency;
+                if (call.peerKind == PeerKind::Interval && !call.exactFrequency)
+                {
+                    const RankInterval &peers = rankIntervals[call.rank];
+                    int64_t last = std::min<int64_t>(peers.lastFromSize ? int64_t(ranks) + peers.last : peers.last,
+                                                     ranks - 1);
+                    frequency = last < peers.first ? 0 : (last - peers.first) / peers.stride + 1;
+                }
+                MPIRankLoad load = getCallLoad(call, frequency);
+                if (load == MPIRankLoad())
+                    continue;
+
+                for (const RankInterval &interval : getExecutingRanks(call, rankIntervals).getIntervals())
+                {
+                    int64_t last = interval.lastFromSize ? int64_t(ranks) + interval.last : interval.last;
+                    last = std::min<int64_t>(last, ranks - 1);
+                    if (interval.first < 0 || last < interval.first)
+                        continue;
+                    std::vector<MPIRankLoad> &delta = deltas[interval.stride];
+                    delta.resize(ranks);
+                    auto add = [&](int64_t rank, double sign)
+                    {
+                        delta[rank].sends += sign * load.sends;
+                        delta[rank].receives += sign * load.receives;
+                        delta[rank].bytes += sign * load.bytes;
+                        delta[rank].blocking += sign * load.blocking;
+                    };
+                    add(interval.first, 1);
+                    int64_t end = last - (last - interval.first) % interval.stride + interval.stride;
+                    if (end < ranks)
+                        add(end, -1);
+                }
+            }
+
+            std::vector<MPIRankLoad> loads(ranks);
+            for (auto &entry : deltas)
+            {
+                int32_t stride = entry.first;
+                std::vector<MPIRankLoad> &delta = entry.second;
+                for (int32_t rank = 0; rank < ranks; rank++)
+                {
+                    if (rank >= stride)
+                    {
+                        delta[rank].sends += delta[rank - stride].sends;
+                        delta[rank].receives += delta[rank - stride].receives;
+                        delta[rank].bytes += delta[rank - stride].bytes;
+                        delta[rank].blocking += delta[rank - stride].blocking;
+                    }
+                    loads[rank].sends += delta[rank].sends;
+                    loads[rank].receives += delta[rank].receives;
+                    loads[rank].bytes += delta[rank].bytes;
+                    loads[rank].blocking += delta[rank].blocking;
+                }
+            }
+
+            // Outliers against the median rank; with a median of zero, every rank that communicates stands out
+            auto median = [&](function_ref<double(const MPIRankLoad &)> metric)
+            {
+                std::vector<double> values;
+                values.reserve(loads.size());
+                for (const MPIRankLoad &load : loads)
+                    values.push_back(metric(load));
+                std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+                return values[values.size() / 2];
+            };
+            MPIRankLoad typical;
+            typical.sends = median([](const MPIRankLoad &load)
+                                   { return load.sends; });
+            typical.receives = median([](const MPIRankLoad &load)
+                                      { return load.receives; });
+            typical.bytes = median([](const MPIRankLoad &load)
+                                   { return load.bytes; });
+            typical.blocking = median([](const MPIRankLoad &load)
+                                      { return load.blocking; });
+            std::vector<int32_t> outliers;
+            for (int32_t rank = 0; rank < ranks; rank++)
+            {
+                const MPIRankLoad &load = loads[rank];
+                if ((load.messages() >= 1 && load.messages() >= 2 * typical.messages()) ||
+                    (load.bytes > 0 && load.bytes >= 2 * typical.bytes))
+                    outliers.push_back(rank);
+            }
+            if (outliers.size() * 2 > loads.size())
+                outliers.clear(); // Half of the ranks or more: an even split, not an outlier
+            writer.loadProfile(loads, outliers, typical);
+        }
+
+        // Function to lint the pressure on the MPI matching queues: receives & probes with MPI_ANY_SOURCE or
+        // MPI_ANY_TAG, (comm, tag) contexts in which many messages can wait for one rank (up to depth*(depth+1)/2
+        // entries are searched to drain them), and receives that consume the tags of a matched sender in another
+        // order than it sent them, each overtaken message waiting in the unexpected queue. Symbolic rank sets are
+        // instantiated for ranks=N, or for a reference job of 1024 ranks.
+        void reportQueueLint(const DenseMap<const Function *, const MPIFunctionSummary *> &summaries,
+                             const MPIEntryPointTable &table, MPIReportWriter &writer)
+        {
+            const int32_t ranks = options.ranks ? options.ranks : 1024;
+            const double minQueueDepth = 16; // Contexts shallower than this are not reported
+
+            // A point-to-point call or probe with the function & intervals it belongs to
+            struct LintCall
+            {
+                const MPICommunication *call;
+                ArrayRef<RankInterval> rankIntervals;
+                StringRef function;
+            };
+            // The messages one round of a send leaves waiting for one receiving rank, and how many rounds it makes
+            struct Context
+            {
+                double depth = 0, rounds = 0, largest = 0;
+                const LintCall *send = nullptr;
+            };
+            std::vector<LintCall> calls;
+            for (Function *F : table.callers)
+            {
+                const MPIFunctionSummary &summary = *summaries.lookup(F);
+                for (const MPICommunication &call : summary.mpiCalls)
+                {
+                    MPIOpClass opClass = getEntryPoint(call.kind).opClass;
+                    if ((opClass == MPIOpClass::PointToPoint || opClass == MPIOpClass::Probe) &&
+                        getEntryPoint(call.kind).peerArg >= 0)
+                        calls.push_back({&call, summary.rankIntervals, F->getName()});
+                }
+            }
+            auto isSend = [](const MPICommunication &call)
+            { return getEntryPoint(call.kind).opClass == MPIOpClass::PointToPoint && !isReceive(call.kind); };
+
+            // Senders' messages per receiving rank: every executing rank targets a constant peer, one
+            // sender per rank shifts by a constant, and every executing rank loops over an interval of peers
+            std::map<uint64_t, Context> contexts;
+            for (const LintCall &lintCall : calls)
+            {
+                const MPICommunication &call = *lintCall.call;
+                if (!isSend(call))
+                    continue;
+                double senders = getExecutingRanks(call, lintCall.rankIntervals).count(ranks);
+                double depth = 0, rounds = call.frequency;
+                switch (call.peerKind)
+                {
+                case PeerKind::Constant:
+                    depth = call.rank >= 0 ? senders : 0; // Sends to MPI_PROC_NULL are dropped
+                    break;
+                case PeerKind::Relative:
+                case PeerKind::RelativeModSize:
+                    depth = 1;
+                    break;
+                case PeerKind::Interval:
+                {
+                    int64_t peers = lintCall.rankIntervals[call.rank].count(ranks);
+                    depth = peers ? senders : 0;
+                    rounds = call.exactFrequency && peers ? call.frequency / peers : 1;
+                    break;
+                }
+                case PeerKind::Unknown:
+                    break; // Could target any rank; not counted
+                }
+                if (!depth)
+                    continue;
+                Context &context = contexts[packCommTag(call.comm, call.tag)];
+                context.depth += depth;
+                context.rounds = std::max(context.rounds, rounds);
+                if (depth > context.largest)
+                {
+                    context.largest = depth;
+                    context.send = &lintCall;
+                }
+            }
+
+            std::vector<MPIQueueFinding> findings;
+            for (const auto &entry : contexts)
+            {
+                const Context &context = entry.second;
+                if (context.depth < minQueueDepth)
+                    continue;
+                MPIQueueFinding finding = {MPIQueueFinding::Kind::DeepQueue,
+                                           context.rounds * context.depth * (context.depth + 1) / 2,
+                                           context.depth, unpackComm(entry.first), unpackTag(entry.first),
+                                           context.send->call, context.send->rankIntervals, context.send->function};
+                findings.push_back(finding);
+            }
+
+            // A wildcard source searches the whole context (no per-source matching), a wildcard tag every
+            // context of the communicator; messages of unknown tag may be in any of them
+            for (const LintCall &lintCall : calls)
+            {
+                const MPICommunication &call = *lintCall.call;
+                bool anySource = call.peerKind == PeerKind::Constant && call.rank == table.getAnySource();
+                bool anyTag = call.tag == AnyTagValue;
+                if (isSend(call) || (!anySource && !anyTag))
+                    continue;
+                double depth = 0;
+                for (const auto &entry : contexts)
+                {
+                    int32_t tag = unpackTag(entry.first);
+                    if (unpackComm(entry.first) == call.comm && (anyTag || tag == call.tag || tag == UnknownTag))
+                        depth += entry.second.depth;
+                }
+                MPIQueueFinding finding = {MPIQueueFinding::Kind::WildcardReceive,
+                                           call.frequency * std::max(depth, 1.0), depth, call.comm, call.tag,
+                                           &call, lintCall.rankIntervals, lintCall.function};
+                findings.push_back(finding);
+            }
+
+            // Sequences of sends & receives that pair up: between two fixed ranks, or by matching shifts
+            // (a send to rank+k & a receive from rank-k). Each function contributes its calls in program order.
+            std::map<std::tuple<MPICommId, PeerKind, int32_t, int32_t>,
+                     std::pair<std::map<StringRef, std::vector<const LintCall *>>,
+                               std::map<StringRef, std::vector<const LintCall *>>>>
+                pairs; // (comm, shift kind, sender, receiver) or (comm, shift kind, offset) -> (sends, receives)
+            for (const LintCall &lintCall : calls)
+            {
+                const MPICommunication &call = *lintCall.call;
+                bool send = isSend(call);
+                if (!send && !isReceive(call.kind))
+                    continue;
+                if (call.peerKind == PeerKind::Constant && call.executingRank >= 0 && call.rank >= 0)
+                {
+                    int32_t sender = send ? call.executingRank : call.rank;
+                    int32_t receiver = send ? call.rank : call.executingRank;
+                    auto &sequences = pairs[std::make_tuple(call.comm, PeerKind::Constant, sender, receiver)];
+                    (send ? sequences.first : sequences.second)[lintCall.function].push_back(&lintCall);
+                }
+                else if (call.peerKind == PeerKind::Relative || call.peerKind == PeerKind::RelativeModSize)
+                {
+                    auto &sequences = pairs[std::make_tuple(call.comm, call.peerKind, send ? call.rank : -call.rank, 0)];
+                    (send ? sequences.first : sequences.second)[lintCall.function].push_back(&lintCall);
+                }
+            }
+            for (const auto &entry : pairs)
+            {
+                for (const auto &sends : entry.second.first)
+                {
+                    for (const auto &receives : entry.second.second)
+                    {
+                        // Match the receives to the sends in FIFO order per tag
+                        std::map<int32_t, std::vector<size_t>> sent; // Tag -> indices of its sends, in order
+                        bool wildcard = false;
+                        for (size_t i = 0; i < sends.second.size(); i++)
+                            sent[sends.second[i]->call->tag].push_back(i);
+                        std::vector<std::pair<size_t, const LintCall *>> matched; // Send index of each receive, in order
+                        std::map<int32_t, size_t> consumed;
+                        for (const LintCall *receive : receives.second)
+                        {
+                            int32_t tag = receive->call->tag;
+                            wildcard |= tag == AnyTagValue || tag == UnknownTag;
+                            auto it = sent.find(tag);
+                            if (it != sent.end() && consumed[tag] < it->second.size())
+                                matched.emplace_back(it->second[consumed[tag]++], receive);
+                        }
+                        if (wildcard || sent.count(UnknownTag))
+                            continue; // The order in which the messages match is not known
+
+                        // Every pair received in the opposite order keeps the earlier-sent message queued
+                        unsigned inversions = 0;
+                        const std::pair<size_t, const LintCall *> *overtaking = nullptr;
+                        size_t overtaken = 0;
+                        for (size_t i = 0; i < matched.size(); i++)
+                        {
+                            for (size_t j = i + 1; j < matched.size(); j++)
+                            {
+                                if (matched[j].first >= matched[i].first)
+                                    continue;
+                                inversions++;
+                                if (!overtaking || (overtaking == &matched[i] && matched[j].first < overtaken))
+                                {
+                                    overtaking = &matched[i]; // The first overtaking receive & the earliest send it overtakes
+                                    overtaken = matched[j].first;
+                                }
+                            }
+                        }
+                        if (!inversions)
+                            continue;
+                        const MPICommunication &receive = *overtaking->second->call;
+                        MPIQueueFinding finding = {MPIQueueFinding::Kind::TagReorder,
+                                                   receive.frequency * inversions, 0, receive.comm, receive.tag,
+                                                   &receive, overtaking->second->rankIntervals,
+                                                   overtaking->second->function};
+                        finding.sentFirstTag = sends.second[overtaken]->call->tag;
+                        finding.inversions = inversions;
+                        finding.sendFunction = sends.first;
+                        findings.push_back(finding);
+                    }
+                }
+            }
+
+            llvm::stable_sort(findings, [](const MPIQueueFinding &a, const MPIQueueFinding &b)
+                              { return a.severity > b.severity; });
+            writer.beginQueueLint(ranks);
+            for (const MPIQueueFinding &finding : findings)
+                writer.queueFinding(finding, table);
+            writer.endQueueLint(findings.size());
+        }
+
+        // Function to report the MPI calls that OpenMP threads can make, and the thread level they need. The body of
+        // a parallel region or task runs on several threads at once, and so do the functions it calls, except below
+        // a master guard (only the master thread) or in single & critical regions (one thread at a time). The level
+        // is checked against the one MPI_Init_thread requests, and the communicators that threads call at once are
+        // ranked by estimated calls: the lock contention hotspots of MPI_THREAD_MULTIPLE. Modules without OpenMP
+        // regions or MPI_Init_thread get no report.
+        void reportThreadSafety(Module &M, const DenseMap<const Function *, const MPIFunctionSummary *> &summaries,
+                                const MPIEntryPointTable &table, const SmallPtrSetImpl<Function *> &reachesMPI,
+                                FunctionAnalysisManager &FAM, MPIReportWriter &writer)
+        {
+            // Bodies of parallel regions & tasks that reach MPI run on several threads at once
+            DenseMap<const Function *, MPIThreadLevel> levels; // Functions that OpenMP threads run, and how
+            SmallVector<Function *, 8> worklist;
+            bool forks = false;
+            size_t regions = 0;
+            for (const OpenMPFork &fork : openMPForks)
+            {
+                Function *runtime = M.getFunction(fork.name);
+                if (!runtime)
+                    continue;
+                for (User *user : runtime->users())
+                {
+                    auto *call = dyn_cast<CallBase>(user);
+                    Function *body = call ? getForkedBody(*call) : nullptr;
+                    if (!body)
+                        continue;
+                    forks = true;
+                    if (!reachesMPI.count(body))
+                        continue;
+                    regions++;
+                    if (levels.insert({body, MPIThreadLevel::Multiple}).second)
+                        worklist.push_back(body);
+                }
+            }
+
+            // The level requested by MPI_Init_thread (MPI_Init: MPI_THREAD_SINGLE); the lowest one if there are several
+            Optional<MPIThreadLevel> requested;
+            bool initialized = false, initThread = false;
+            MPIValueResolver resolver(table);
+            for (Function *F : table.callers)
+            {
+                for (CallBase *call : table.callSites.find(F)->second)
+                {
+                    MPIOpKind kind = *table.lookup(*call);
+                    if (kind != MPIOpKind::Init && kind != MPIOpKind::InitThread)
+                        continue;
+                    Optional<MPIThreadLevel> level;
+                    if (kind == MPIOpKind::Init)
+                        level = MPIThreadLevel::Single;
+                    else if (call->arg_size() > 2)
+                    {
+                        ResolvedValue required = resolver.resolve(call->getArgOperand(2));
+                        if (required.kind == ResolvedValue::Constant && required.value >= 0 &&
+                            required.value <= int64_t(MPIThreadLevel::Multiple))
+                            level = MPIThreadLevel(required.value);
+                    }
+                    if (!initialized)
+                        requested = level;
+                    else if (requested && level)
+                        requested = std::min(*requested, *level);
+                    else
+                        requested = None;
+                    initialized = true;
+                    initThread |= kind == MPIOpKind::InitThread;
+                }
+            }
+            if (!forks && !initThread)
+                return;
+
+            // The functions that the bodies call run on the same threads, unless a guard restricts them
+            DenseMap<const Function *, SmallVector<std::pair<CallBase *, Function *>, 4>> callees;
+            for (Function *callee : reachesMPI)
+                forEachCallOf(*callee, [&](CallBase &call, bool forked)
+                              {
+                                  if (!forked)
+                                      callees[call.getFunction()].push_back({&call, callee}); });
+            DenseMap<const CallBase *, MPIThreadLevel> guards; // Memoized getThreadGuard results
+            auto guardOf = [&](CallBase *call)
+            {
+                auto it = guards.find(call);
+                if (it == guards.end())
+                    it = guards.insert({call, getThreadGuard(call, FAM)}).first;
+                return it->second;
+            };
+            while (!worklist.empty())
+            {
+                Function *caller = worklist.pop_back_val();
+                MPIThreadLevel callerLevel = levels.lookup(caller);
+                auto edges = callees.find(caller);
+                if (edges == callees.end())
+                    continue;
+                for (const auto &edge : edges->second)
+                {
+                    MPIThreadLevel level = std::min(callerLevel, guardOf(edge.first));
+                    auto inserted = levels.insert({edge.second, level});
+                    if (inserted.second || inserted.first->second < level)
+                    {
+                        inserted.first->second = level;
+                        worklist.push_back(edge.second);
+                    }
+                }
+            }
+
+            // Serial calls of a process that runs OpenMP threads need MPI_THREAD_FUNNELED
+            writer.beginThreadReport(requested, regions);
+            MPIThreadLevel needed = forks ? MPIThreadLevel::Funneled : MPIThreadLevel::Single;
+            std::map<uint32_t, MPIContentionHotspot> byComm; // Communicator (UINT32_MAX: none) -> hotspot
+            for (Function *F : table.callers)
+            {
+                auto level = levels.find(F);
+                if (level == levels.end())
+                    continue;
+                const MPIFunctionSummary &summary = *summaries.lookup(F);
+                const SmallVector<CallBase *, 4> &calls = table.callSites.find(F)->second;
+                for (size_t i = 0; i < calls.size(); i++)
+                {
+                    const MPICommunication &call = summary.mpiCalls[i];
+                    MPIThreadLevel callLevel = std::min(level->second, guardOf(calls[i]));
+                    needed = std::max(needed, callLevel);
+                    writer.threadedCall(call, F->getName(), callLevel, table);
+                    if (callLevel != MPIThreadLevel::Multiple)
+                        continue;
+
+                    bool hasComm = getEntryPoint(call.kind).commArg >= 0;
+                    MPIContentionHotspot &hotspot = byComm[hasComm ? call.comm : UINT32_MAX];
+                    if (hasComm)
+                        hotspot.comm = call.comm;
+                    hotspot.sites++;
+                    hotspot.calls += call.frequency;
+                    hotspot.exact &= call.exactFrequency;
+                    if (hotspot.function.empty() || call.frequency > hotspot.largest)
+                    {
+                        hotspot.function = F->getName();
+                        hotspot.largest = call.frequency;
+                    }
+                }
+            }
+
+            std::vector<MPIContentionHotspot> hotspots;
+            for (const auto &entry : byComm)
+                hotspots.push_back(entry.second);
+            llvm::stable_sort(hotspots, [](const MPIContentionHotspot &a, const MPIContentionHotspot &b)
+                              { return a.calls > b.calls; });
+            for (size_t i = 0; i < hotspots.size(); i++)
+                writer.contentionHotspot(i + 1, hotspots[i], table);
+            writer.endThreadReport(needed, hotspots.size());
+        }
+
+        // Function to find the most a call needs from the OpenMP guards around it: MPI_THREAD_FUNNELED below a
+        // master guard, MPI_THREAD_SERIALIZED in single & critical regions and MPI_THREAD_MULTIPLE otherwise.
+        // Guards are the dominating branches on a guard call's result, and the critical sections whose start
+        // dominates the call and whose end post-dominates it.
+        static MPIThreadLevel getThreadGuard(CallBase *call, FunctionAnalysisManager &FAM)
+        {
+            using namespace PatternMatch;
+            Function &F = *call->getFunction();
+            const DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+            auto calls = [](const Value *V, StringRef name)
+            {
+                auto *guardCall = dyn_cast<CallBase>(V);
+                return guardCall && guardCall->getCalledFunction() &&
+                       guardCall->getCalledFunction()->getName() == name;
+            };
+
+            MPIThreadLevel level = MPIThreadLevel::Multiple;
+            for (const DomTreeNode *node = DT.getNode(call->getParent()); node && node->getIDom(); node = node->getIDom())
+            {
+                BasicBlock *BB = node->getBlock();
+                BasicBlock *guard = BB->getSinglePredecessor();
+                auto *branch = guard ? dyn_cast<BranchInst>(guard->getTerminator()) : nullptr;
+                if (!branch || !branch->isConditional() || branch->getSuccessor(0) == branch->getSuccessor(1))
+                    continue;
+
+                // The guarded block is entered if the result is nonzero: the condition itself, or compared with 0
+                bool nonZero = branch->getSuccessor(0) == BB;
+                Value *result = branch->getCondition();
+                ICmpInst::Predicate predicate;
+                Value *compared;
+                if (match(result, m_ICmp(predicate, m_Value(compared), m_Zero())) && ICmpInst::isEquality(predicate))
+                {
+                    nonZero = nonZero == (predicate == ICmpInst::ICMP_NE);
+                    result = compared;
+                }
+                while (auto *cast = dyn_cast<CastInst>(result))
+                {
+                    if (!cast->isIntegerCast())
+                        break;
+                    result = cast->getOperand(0);
+                }
+                for (const OpenMPGuard &entry : openMPGuards)
+                {
+                    if (!entry.end && nonZero != entry.onZero && calls(result, entry.name))
+                        level = std::min(level, entry.level);
+                }
+            }
+
+            // Critical sections around the call
+            const PostDominatorTree *PDT = nullptr;
+            for (const OpenMPGuard &entry : openMPGuards)
+            {
+                Function *start = F.getParent()->getFunction(entry.name);
+                Function *end = entry.end ? F.getParent()->getFunction(entry.end) : nullptr;
+                if (!start || !end || level <= entry.level)
+                    continue;
+                bool entered = any_of(start->users(), [&](const User *user)
+                                      { return calls(user, entry.name) && cast<Instruction>(user)->getFunction() == &F &&
+                                               DT.dominates(user, call); });
+                if (!entered)
+                    continue;
+                if (!PDT)
+                    PDT = &FAM.getResult<PostDominatorTreeAnalysis>(F);
+                bool left = any_of(end->users(), [&](const User *user)
+                                   {
+                                       if (!calls(user, entry.end) || cast<Instruction>(user)->getFunction() != &F)
+                                           return false;
+                                       auto *endCall = cast<Instruction>(user);
+                                       return PDT->dominates(endCall, call) && !DT.dominates(endCall, call); });
+                if (left)
+                    level = entry.level;
+            }
+            return level;
+        }
+
+        // Function to analyze uniform participation patterns among MPI processes
+        void analyzeUniformParticipation(ArrayRef<MPICommunication> mpiCalls, ArrayRef<RankInterval> rankIntervals,
+                                         const MPIEntryPointTable &table, MPIReportWriter &writer)
+        {
+            writer.beginParticipation();
+
+            // Flat participation index of (packed (comm, tag) key, call) entries. Sorting it groups the
+            // calls by (comm, tag); each group's ranks are then combined into one symbolic RankSet.
+            std::vector<std::pair<uint64_t, const MPICommunication *>> participation;
+            participation.reserve(mpiCalls.size());
+
+            // Populate the index with the calls involved in each (comm, tag) pair
+            for (const MPICommunication &call : mpiCalls)
+            {
+                const MPIEntryPoint &entry = getEntryPoint(call.kind);
+                if (entry.opClass != MPIOpClass::PointToPoint || entry.tagArg < 0 || call.tag == UnknownTag)
+                    continue; // Only point-to-point messages with a known tag participate in (comm, tag) groups
+
+                participation.emplace_back(packCommTag(call.comm, call.tag), &call);
+            }
+            llvm::stable_sort(participation, [](const auto &a, const auto &b)
+                              { return a.first < b.first; });
+
+            // Iterate over the (comm, tag) groups to identify and report uniform participation
+            for (auto groupBegin = participation.begin(); groupBegin != participation.end();)
+            {
+                uint64_t key = groupBegin->first;
+                auto groupEnd = std::find_if(groupBegin, participation.end(),
+                                             [key](const auto &e)
+                                             { return e.first != key; });
+                ArrayRef<std::pair<uint64_t, const MPICommunication *>> calls(&*groupBegin, groupEnd - groupBegin);
+                groupBegin = groupEnd;
+
+                RankSet ranks, worldRanks;
+                bool translated = true; // Whether every peer could be translated to world ranks
+                for (const auto &entry : calls)
+                {
+                    const MPICommunication &call = *entry.second;
+                    ranks = ranks.unionWith(getPeerRanks(call, rankIntervals));
+                    if (call.comm == WorldCommId)
+                        continue;
+
+                    RankSet world;
+                    if (call.peerKind == PeerKind::Constant)
+                        world = table.toWorldRanks(call.comm, call.rank, call.executingRank);
+                    translated &= !world.empty();
+                    worldRanks = worldRanks.unionWith(world);
+                }
+
+                StringRef comm = table.getCommName(unpackComm(key));
+                int32_t tag = unpackTag(key);
+
+                // If more than one rank is involved in a (comm, tag) pair, report it as uniform participation.
+                // Communicator-local ranks are reported together with their MPI_COMM_WORLD ranks.
+                if (!ranks.empty() && !ranks.isSingleton())
+                {
+                    if (!translated)
+                        worldRanks = RankSet();
+                    writer.participation(comm, tag, ranks, unpackComm(key) != WorldCommId ? &worldRanks : nullptr);
+                    NumParticipationGroups++;
+                }
+
+                reportUnmatchedShifts(calls, comm, writer);
+            }
+        }
+
+        // Function to match rank-relative sends & receives symbolically
+        void reportUnmatchedShifts(ArrayRef<std::pair<uint64_t, const MPICommunication *>> calls,
+                                   StringRef comm, MPIReportWriter &writer)
+        {
+            SmallVector<const MPICommunication *, 4> sends, recvs;
+            for (const auto &entry : calls)
+            {
+                const MPICommunication *call = entry.second;
+                if (call->peerKind != PeerKind::Relative && call->peerKind != PeerKind::RelativeModSize)
+                    continue;
+                (isReceive(call->kind) ? recvs : sends).push_back(call);
+            }
+
+            auto reportUnmatched = [&](ArrayRef<const MPICommunication *> from, ArrayRef<const MPICommunication *> to)
+            {
+                for (const MPICommunication *call : from)
+                {
+                    bool matched = any_of(to, [call](const MPICommunication *other)
+                                          { return isMatchingShift(call->peerKind, call->rank, other->peerKind, other->rank); });
+                    if (!matched)
+                        writer.unmatchedShift(*call, comm);
+                }
+            };
+            if (sends.empty() || recvs.empty())
+                return; // One-sided groups are matched by constant-rank calls we cannot pair symbolically
+            reportUnmatched(sends, recvs);
+            reportUnmatched(recvs, sends);
+        }
+
+        // Indicates whether the pass is required to run again.
+        static bool isRequired() { return true; }
+    };
+
+    // Transform pass that wraps MPI call sites with cycle-counter probes for the runtime in
+    // MPIInstrumentRuntime.c. Call site N of a module is its Nth call record in the mpi-analysis report
+    // (functions in module order, calls in program order), so mpi_instrument_join can join the runtime
+    // records of each site with its static results. MPI calls themselves are left untouched. Only the
+    // calls that communicate or wait are timed (point-to-point, collectives & completions), unless
+    // mpi-instrument<all> times the setup, communicator & probe calls too; the sites of untimed calls
+    // keep their IDs and report no calls.
+    struct MPIInstrumentPass : public PassInfoMixin<MPIInstrumentPass>
+    {
+        bool all; // Time every MPI call site
+
+        explicit MPIInstrumentPass(bool all = false) : all(all) {}
+
+        // Checks whether calls to an entry point are timed
+        bool isTimed(const MPIEntryPoint &entry) const
+        {
+            return all || entry.opClass == MPIOpClass::PointToPoint || entry.opClass == MPIOpClass::Collective ||
+                   entry.opClass == MPIOpClass::Completion;
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            const MPIEntryPointTable &table = MAM.getResult<MPIEntryPointAnalysis>(M);
+            if (table.callers.empty() || M.getNamedGlobal("mpi_instrument.sites"))
+                return PreservedAnalyses::all(); // Nothing to instrument, or already instrumented
+
+            std::vector<CallBase *> sites;
+            for (Function *F : table.callers)
+            {
+                const SmallVector<CallBase *, 4> &calls = table.callSites.find(F)->second;
+                sites.insert(sites.end(), calls.begin(), calls.end());
+            }
+
+            // Layouts of struct mpi_instrument_site & struct mpi_instrument_module of the runtime
+            LLVMContext &C = M.getContext();
+            Type *int32Ty = Type::getInt32Ty(C);
+            Type *int64Ty = Type::getInt64Ty(C);
+            Type *stringTy = Type::getInt8PtrTy(C);
+            StructType *siteTy = StructType::create(C, {int64Ty, int64Ty, int32Ty, int32Ty, stringTy, stringTy},
+                                                    "mpi_instrument.site");
+            StructType *moduleTy = StructType::create(C, "mpi_instrument.module");
+            moduleTy->setBody({stringTy, siteTy->getPointerTo(), int32Ty, int32Ty, moduleTy->getPointerTo()});
+
+            // Static description of the call sites: the runtime fills in the counters
+            StringMap<Constant *> strings;
+            auto getString = [&](StringRef text)
+            {
+                Constant *&string = strings[text];
+                if (!string)
+                {
+                    auto *global = new GlobalVariable(M, ArrayType::get(Type::getInt8Ty(C), text.size() + 1), true,
+                                                      GlobalValue::PrivateLinkage,
+                                                      ConstantDataArray::getString(C, text), "mpi_instrument.str");
+                    global->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+                    string = ConstantExpr::getPointerCast(global, stringTy);
+                }
+                return string;
+            };
+            std::vector<Constant *> siteInits;
+            siteInits.reserve(sites.size());
+            for (CallBase *call : sites)
+            {
+                siteInits.push_back(ConstantStruct::get(
+                    siteTy, {ConstantInt::get(int64Ty, 0), ConstantInt::get(int64Ty, 0), ConstantInt::get(int32Ty, 0),
+                             ConstantInt::get(int32Ty, siteInits.size()), getString(call->getFunction()->getName()),
+                             getString(getEntryPoint(*table.lookup(*call)).name)}));
+            }
+            ArrayType *sitesTy = ArrayType::get(siteTy, sites.size());
+            auto *sitesGlobal = new GlobalVariable(M, sitesTy, false, GlobalValue::InternalLinkage,
+                                                   ConstantArray::get(sitesTy, siteInits), "mpi_instrument.sites");
+            auto getSite = [&](size_t index)
+            {
+                Constant *indices[] = {ConstantInt::get(int32Ty, 0), ConstantInt::get(int32Ty, index)};
+                return ConstantExpr::getInBoundsGetElementPtr(sitesTy, sitesGlobal, indices);
+            };
+            auto *moduleGlobal = new GlobalVariable(
+                M, moduleTy, false, GlobalValue::InternalLinkage,
+                ConstantStruct::get(moduleTy, {getString(M.getSourceFileName()), getSite(0),
+                                               ConstantInt::get(int32Ty, sites.size()), ConstantInt::get(int32Ty, 0),
+                                               ConstantPointerNull::get(moduleTy->getPointerTo())}),
+                "mpi_instrument.module");
+
+            // The module registers its sites with the runtime before main
+            Type *voidTy = Type::getVoidTy(C);
+            FunctionCallee registerModule =
+                M.getOrInsertFunction("__mpi_instrument_register", voidTy, moduleTy->getPointerTo());
+            Function *ctor = Function::Create(FunctionType::get(voidTy, false), GlobalValue::InternalLinkage,
+                                              "mpi_instrument.ctor", M);
+            IRBuilder<> B(BasicBlock::Create(C, "entry", ctor));
+            B.CreateCall(registerModule, moduleGlobal);
+            B.CreateRetVoid();
+            appendToGlobalCtors(M, ctor, 0);
+
+            // Each call is timed by a cycle-counter read on either side; the runtime records the site,
+            // the cycles and the peer & tag the call was actually made with
+            Function *readCycleCounter = Intrinsic::getDeclaration(&M, Intrinsic::readcyclecounter);
+            FunctionCallee record = M.getOrInsertFunction("__mpi_instrument_record", voidTy, siteTy->getPointerTo(),
+                                                          int64Ty, int64Ty, int32Ty, int32Ty);
+            FunctionCallee finalize = M.getOrInsertFunction("__mpi_instrument_finalize", voidTy);
+            FunctionCallee initThread = M.getOrInsertFunction("__mpi_instrument_init_thread", voidTy,
+                                                              Type::getInt32PtrTy(C));
+            for (size_t index = 0; index < sites.size(); index++)
+            {
+                CallBase *call = sites[index];
+                const MPIEntryPoint &entry = getEntryPoint(*table.lookup(*call));
+                B.SetInsertPoint(call);
+                if (entry.kind == MPIOpKind::Finalize)
+                {
+                    B.CreateCall(finalize); // The buffers are written while MPI is still available
+                    continue;
+                }
+
+                // Invokes are timed in their normal destination, unless it is shared with other edges
+                Instruction *after = call->getNextNode();
+                if (auto *invoke = dyn_cast<InvokeInst>(call))
+                {
+                    BasicBlock *normal = invoke->getNormalDest();
+                    if (!normal->getSinglePredecessor())
+                        continue;
+                    after = &*normal->getFirstInsertionPt();
+                }
+
+                if (isTimed(entry))
+                {
+                    Value *start = B.CreateCall(readCycleCounter);
+                    B.SetInsertPoint(after);
+                    Value *end = B.CreateCall(readCycleCounter);
+                    auto intArg = [&](int8_t arg) -> Value *
+                    {
+                        Value *value = arg >= 0 ? call->getArgOperand(arg) : nullptr;
+                        if (!value || !value->getType()->isIntegerTy())
+                            return ConstantInt::get(int32Ty, -1);
+                        return B.CreateSExtOrTrunc(value, int32Ty);
+                    };
+                    B.CreateCall(record, {getSite(index), start, end, intArg(entry.peerArg), intArg(entry.tagArg)});
+                    NumInstrumentedSites++;
+                }
+
+                // The runtime only updates its buffers atomically if MPI provides MPI_THREAD_MULTIPLE
+                if (entry.kind == MPIOpKind::InitThread && call->arg_size() > 3)
+                {
+                    B.SetInsertPoint(after);
+                    B.CreateCall(initThread, call->getArgOperand(3));
+                }
+            }
+
+            // Only calls to the runtime were added, so the MPI call sites are unchanged
+            PreservedAnalyses PA = PreservedAnalyses::none();
+            PA.preserve<MPIEntryPointAnalysis>();
+            return PA;
+        }
+
+        static bool isRequired() { return true; }
+    };
+
+    // Transform pass that merges back-to-back small MPI_Send calls to the same peer (comm, tag & datatype)
+    // into one packed message, and the matching back-to-back MPI_Recv calls into one receive that is
+    // unpacked in place. The module is assumed to be the whole program. A (comm, tag) group is only
+    // rewritten if every send & receive of the group belongs to such a run, all runs have the same
+    // counts (so MPI's non-overtaking order pairs them), receives name their source exactly, and no
+    // wildcard tag or probe could observe the individual messages. Runs that cannot be proven safe are
+    // reported with the reason.
+    struct MPICoalescePass : public PassInfoMixin<MPICoalescePass>
+    {
+        uint64_t maxBytes; // Largest packed message
+
+        explicit MPICoalescePass(uint64_t maxBytes = 4096) : maxBytes(maxBytes) {}
+
+        // Adjacent MPI_Send or MPI_Recv calls of one basic block with the same comm, tag, peer & datatype
+        struct Run
+        {
+            SmallVector<CallBase *, 4> calls;
+            SmallVector<uint64_t, 4> counts; // Constant element counts (empty if any count is not constant)
+            MPICommunication first;          // Analysis of the first call
+            ArrayRef<RankInterval> rankIntervals; // Intervals of the function's summary (for Interval peers)
+            unsigned datatypeSize = 0;
+            StringRef reason;                // Why the run cannot be rewritten (empty if it can)
+        };
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            const MPIEntryPointTable &table = MAM.getResult<MPIEntryPointAnalysis>(M);
+
+            // Collect the runs of every function, and the (comm, tag) groups that cannot be rewritten at all
+            std::vector<Run> runs;
+            DenseMap<const CallBase *, size_t> runOf;           // Send/receive -> index of its run
+            DenseMap<uint64_t, StringRef> blockedGroups;        // packCommTag(comm, tag) -> reason
+            DenseMap<MPICommId, StringRef> blockedComms;        // Comm -> reason, for every tag
+            std::map<uint64_t, SmallVector<const CallBase *, 8>> groupCalls; // Point-to-point calls per (comm, tag)
+            for (Function *F : table.callers)
+            {
+                const MPIFunctionSummary &summary = FAM.getResult<MPIFunctionAnalysis>(*F);
+                const SmallVector<CallBase *, 4> &calls = table.callSites.find(F)->second;
+                for (size_t i = 0; i < calls.size(); i++)
+                {
+                    const MPICommunication &call = summary.mpiCalls[i];
+                    const MPIEntryPoint &entry = getEntryPoint(call.kind);
+                    if (entry.opClass == MPIOpClass::Probe)
+                    {
+                        if (call.tag < 0)
+                            blockedComms[call.comm] = "a probe with a wildcard or non-constant tag could observe the message sizes";
+                        else
+                            blockedGroups[packCommTag(call.comm, call.tag)] = "a probe could observe the message sizes";
+                        continue;
+                    }
+                    if (entry.opClass != MPIOpClass::PointToPoint)
+                        continue;
+                    if (call.tag < 0)
+                    {
+                        blockedComms[call.comm] = "the communicator has a send or receive with a wildcard or non-constant tag";
+                        continue;
+                    }
+                    groupCalls[packCommTag(call.comm, call.tag)].push_back(calls[i]);
+                    if (call.kind != MPIOpKind::Send && call.kind != MPIOpKind::Recv)
+                    {
+                        blockedGroups[packCommTag(call.comm, call.tag)] =
+                            "the tag is also used by other point-to-point calls than MPI_Send & MPI_Recv";
+                        continue;
+                    }
+
+                    // Extend the current run, or start a new one
+                    if (i > 0 && runOf.count(calls[i - 1]) && extends(runs[runOf[calls[i - 1]]], calls[i], call))
+                        runs[runOf[calls[i - 1]]].calls.push_back(calls[i]);
+                    else
+                    {
+                        runs.emplace_back();
+                        runs.back().calls.push_back(calls[i]);
+                        runs.back().first = call;
+                        runs.back().rankIntervals = summary.rankIntervals;
+                    }
+                    runOf[calls[i]] = runs.size() - 1;
+                }
+            }
+
+            // Every run must be rewritable on its own...
+            for (Run &run : runs)
+                run.reason = checkRun(run, table);
+
+            // ...and the sends & receives of a group must all be runs of the same counts
+            DenseMap<uint64_t, StringRef> groupReasons;
+            for (const auto &group : groupCalls)
+            {
+                StringRef reason = blockedGroups.lookup(group.first);
+                if (reason.empty())
+                    reason = blockedComms.lookup(unpackComm(group.first));
+                const Run *signature = nullptr;
+                bool hasSend = false, hasRecv = false;
+                for (const CallBase *call : group.second)
+                {
+                    auto it = runOf.find(call);
+                    if (!reason.empty() || it == runOf.end())
+                        break;
+                    const Run &run = runs[it->second];
+                    hasSend |= run.first.kind == MPIOpKind::Send;
+                    hasRecv |= run.first.kind == MPIOpKind::Recv;
+                    if (run.calls.size() < 2)
+                        reason = run.first.kind == MPIOpKind::Send
+                                     ? "a single MPI_Send of the tag would be received by a coalesced receive"
+                                     : "a single MPI_Recv of the tag would receive part of a coalesced message";
+                    else if (!run.reason.empty())
+                        reason = run.first.kind == MPIOpKind::Send ? "another run of sends of the tag is not coalesced"
+                                                                   : "a run of receives of the tag is not coalesced";
+                    else if (!signature)
+                        signature = &run;
+                    else if (run.counts != signature->counts || run.datatypeSize != signature->datatypeSize)
+                        reason = "the runs of the tag have different counts or datatypes";
+                }
+                if (reason.empty() && (!hasSend || !hasRecv))
+                    reason = hasSend ? "the matching receives are not in the module" : "the matching sends are not in the module";
+                groupReasons[group.first] = reason;
+            }
+
+            // Rewrite the proven groups & report the runs of sends that were left alone
+            Type *int8Ty = Type::getInt8Ty(M.getContext());
+            DenseMap<Function *, AllocaInst *> packBuffers;
+            size_t coalesced = 0;
+            for (Run &run : runs)
+            {
+                if (run.calls.size() < 2 || run.first.kind != MPIOpKind::Send)
+                    continue;
+                uint64_t key = packCommTag(run.first.comm, run.first.tag);
+                StringRef reason = run.reason.empty() ? groupReasons.lookup(key) : run.reason;
+                errs() << (reason.empty() ? "[INFO] Coalesced " : "[WARN] Not coalesced: ") << run.calls.size()
+                       << " MPI_Send calls to ";
+                printPeer(errs(), run.first, run.rankIntervals);
+                errs() << " in Comm " << table.getCommName(run.first.comm) << " with Tag ";
+                printTag(errs(), run.first.tag);
+                errs() << " (" << run.calls.front()->getFunction()->getName() << ")";
+                if (!reason.empty())
+                {
+                    errs() << ": " << reason << "\n";
+                    continue;
+                }
+                errs() << " into one message of " << totalCount(run) * run.datatypeSize << " bytes\n";
+                coalesced++;
+            }
+            for (Run &run : runs)
+            {
+                if (run.calls.size() < 2 || !run.reason.empty() ||
+                    !groupReasons.lookup(packCommTag(run.first.comm, run.first.tag)).empty())
+                    continue;
+
+                // Every function packs through one buffer in its entry block, as large as its largest run
+                Function *F = run.calls.front()->getFunction();
+                uint64_t bytes = totalCount(run) * run.datatypeSize;
+                AllocaInst *&buffer = packBuffers[F];
+                if (!buffer || cast<ConstantInt>(buffer->getArraySize())->getZExtValue() < bytes)
+                {
+                    IRBuilder<> B(&*F->getEntryBlock().getFirstInsertionPt());
+                    AllocaInst *larger = B.CreateAlloca(int8Ty, B.getInt64(bytes), "mpi.coalesce.buf");
+                    larger->setAlignment(Align(16));
+                    if (buffer)
+                    {
+                        buffer->replaceAllUsesWith(larger);
+                        buffer->eraseFromParent();
+                    }
+                    buffer = larger;
+                }
+                rewrite(run, buffer);
+            }
+            errs() << "[INFO] " << coalesced << " run(s) of MPI_Send calls coalesced\n";
+            NumCoalescedRuns += coalesced;
+            if (!coalesced)
+                return PreservedAnalyses::all();
+
+            // MPI calls were removed & retargeted
+            PreservedAnalyses PA = PreservedAnalyses::none();
+            PA.abandon<MPIEntryPointAnalysis>();
+            return PA;
+        }
+
+        // Checks whether a call continues a run: the next MPI call of the same basic block, with no other
+        // call in between, of the same kind, comm, tag, peer & datatype
+        static bool extends(const Run &run, const CallBase *call, const MPICommunication &analysis)
+        {
+            const CallBase *last = run.calls.back();
+            const MPICommunication &first = run.first;
+            if (last->getParent() != call->getParent() || analysis.kind != first.kind ||
+                analysis.comm != first.comm || analysis.tag != first.tag ||
+                last->getArgOperand(2) != call->getArgOperand(2))
+                return false;
+            // Different peer operands only name the same peer if both are the same constant or rank-relative
+            // peer (for Interval peers, rank indexes the summary's intervals rather than being a rank)
+            if (last->getArgOperand(3) != call->getArgOperand(3) &&
+                (first.peerKind == PeerKind::Unknown || first.peerKind == PeerKind::Interval ||
+                 analysis.peerKind != first.peerKind || analysis.rank != first.rank))
+                return false;
+            for (const Instruction *I = last->getNextNode(); I != call; I = I->getNextNode())
+            {
+                if (isa<CallBase>(I) && !isa<DbgInfoIntrinsic>(I) && !I->isLifetimeStartOrEnd())
+                    return false; // Delaying a send past other calls could deadlock or reorder messages
+            }
+            return true;
+        }
+
+        // Function to check the conditions a run must meet on its own
+        StringRef checkRun(Run &run, const MPIEntryPointTable &table) const
+        {
+            bool send = run.first.kind == MPIOpKind::Send;
+            if (run.first.comm == UnresolvedCommId)
+                return "the communicator is not resolved";
+            run.datatypeSize = getDatatypeSize(run.calls.front()->getArgOperand(2));
+            if (!run.datatypeSize)
+                return "the datatype is not a predefined one of known size";
+            for (CallBase *call : run.calls)
+            {
+                auto *count = dyn_cast<ConstantInt>(call->getArgOperand(1));
+                if (!count || count->isNegative())
+                {
+                    run.counts.clear();
+                    return "a count is not constant";
+                }
+                run.counts.push_back(count->getZExtValue());
+                if (send && call != run.calls.back() && !call->use_empty())
+                    return "the result of an earlier send is used";
+                if (!send && !isa<ConstantPointerNull>(call->getArgOperand(6)->stripPointerCasts()))
+                    return "a receive status is used";
+            }
+            if (!send && ((run.first.peerKind != PeerKind::Constant && run.first.peerKind != PeerKind::RelativeModSize) ||
+                          (run.first.peerKind == PeerKind::Constant && run.first.rank == table.getAnySource())))
+                return "the source of the receives may be MPI_ANY_SOURCE";
+            if (!send && run.first.peerKind == PeerKind::Constant && run.first.rank == table.getProcNull())
+                return "the receives from MPI_PROC_NULL leave their buffers unchanged";
+            if (totalCount(run) * run.datatypeSize > maxBytes)
+                return "the packed message would exceed max-bytes";
+            return "";
+        }
+
+        static uint64_t totalCount(const Run &run)
+        {
+            uint64_t total = 0;
+            for (uint64_t count : run.counts)
+                total += count;
+            return total;
+        }
+
+        // Function to rewrite a run through the pack buffer: the sends copy their data into it at their
+        // original positions & the last one sends it; the first receive receives into it & every receive
+        // copies its part out at its original position
+        static void rewrite(Run &run, AllocaInst *buffer)
+        {
+            bool send = run.first.kind == MPIOpKind::Send;
+            CallBase *message = send ? run.calls.back() : run.calls.front();
+            IRBuilder<> B(message);
+            uint64_t offset = 0;
+            auto part = [&]() -> Value *
+            { return offset ? B.CreateConstInBoundsGEP1_64(B.getInt8Ty(), buffer, offset) : buffer; };
+            for (size_t i = 0; i < run.calls.size(); i++)
+            {
+                CallBase *call = run.calls[i];
+                uint64_t bytes = run.counts[i] * run.datatypeSize;
+                Value *data = call->getArgOperand(0);
+                if (send)
+                {
+                    B.SetInsertPoint(call);
+                    B.CreateMemCpy(part(), Align(1), data, Align(1), bytes);
+                }
+                else
+                {
+                    B.SetInsertPoint(call == message ? call->getNextNode() : call);
+                    B.CreateMemCpy(data, Align(1), part(), Align(1), bytes);
+                }
+                offset += bytes;
+                if (call != message)
+                {
+                    call->replaceAllUsesWith(message);
+                    call->eraseFromParent();
+                }
+            }
+
+            B.SetInsertPoint(message);
+            message->setArgOperand(0, B.CreatePointerCast(buffer, message->getArgOperand(0)->getType()));
+            message->setArgOperand(1, ConstantInt::get(message->getArgOperand(1)->getType(), totalCount(run)));
+        }
+
+        static bool isRequired() { return true; }
+    };
+
+    // Function to get the request & status types for the nonblocking or persistent form of a blocking send
+    // or receive: from the module's MPI declarations, or following the handle type of the communicator
+    // (an integer in MPICH, a pointer in Open MPI & LAM)
+    std::pair<Type *, Type *> getRequestStatusTypes(const CallBase *call, bool receive, StringRef prefix)
+    {
+        const Module &M = *call->getModule();
+        LLVMContext &C = M.getContext();
+        Type *requestTy = Type::getInt8PtrTy(C);
+        if (call->getArgOperand(5)->getType()->isIntegerTy())
+            requestTy = Type::getInt32Ty(C);
+        Type *statusTy = receive ? call->getArgOperand(6)->getType() : Type::getInt8PtrTy(C);
+        if (Function *recv = M.getFunction((prefix + "MPI_Recv").str()))
+            if (recv->arg_size() == 7)
+                statusTy = recv->getFunctionType()->getParamType(6);
+        if (Function *wait = M.getFunction((prefix + "MPI_Wait").str()))
+        {
+            requestTy = wait->getFunctionType()->getParamType(0)->getPointerElementType();
+            statusTy = wait->getFunctionType()->getParamType(1);
+        }
+        return {requestTy, statusTy};
+    }
+
+    // Function to get MPI_STATUS_IGNORE for the wait of a converted send: (MPI_Status *)1 where handles
+    // are integers (MPICH), a null pointer in Open MPI & LAM
+    Constant *getStatusIgnore(const CallBase *call, Type *statusTy)
+    {
+        if (call->getArgOperand(5)->getType()->isIntegerTy() && statusTy->isPointerTy())
+            return ConstantExpr::getIntToPtr(ConstantInt::get(Type::getInt64Ty(call->getContext()), 1), statusTy);
+        return Constant::getNullValue(statusTy);
+    }
+
+    // Transform pass that turns blocking sends & receives into their nonblocking form and sinks the
+    // MPI_Wait as far as the buffer allows, so the communication overlaps the computation that follows.
+    // The wait moves forward through the block and then over whole single-entry regions to the block's
+    // immediate post-dominator, until an instruction may access the buffer (or the receive status),
+    // uses the call's result, or is a call that could communicate. Other blocking sends & receives may be
+    // passed if their buffers do not conflict, as in an exchange posted as MPI_Isend, MPI_Recv, MPI_Wait.
+    // Calls with no computation to overlap stay blocking.
+    struct MPIOverlapPass : public PassInfoMixin<MPIOverlapPass>
+    {
+        // Memory a blocking send or receive accesses while in flight
+        struct Access
+        {
+            SmallVector<MemoryLocation, 2> locations; // The buffer, & the status of a receive
+            bool receive = false;                     // Whether the locations are written
+        };
+
+        // Where the wait of a call goes, and the computation placed between the post & the wait
+        struct WaitPoint
+        {
+            Instruction *point = nullptr;   // The wait is inserted before this instruction
+            Instruction *blocker = nullptr; // The instruction that stopped the sinking, if any
+            const char *reason = "";        // Otherwise, what stopped it
+            uint64_t instructions = 0;      // Instructions between post & wait, other MPI calls excluded
+            double executed = 0;            // Estimated instructions executed between them per call
+        };
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            const MPIEntryPointTable &table = MAM.getResult<MPIEntryPointAnalysis>(M);
+
+            // Collect the sites first: the rewrite invalidates the function analyses
+            struct Site
+            {
+                CallBase *call;
+                MPIOpKind kind;
+                WaitPoint wait;
+            };
+            std::vector<Site> sites;
+            for (Function *F : table.callers)
+            {
+                const MPIFunctionSummary &summary = FAM.getResult<MPIFunctionAnalysis>(*F);
+                AAResults &AA = FAM.getResult<AAManager>(*F);
+                const DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(*F);
+                const PostDominatorTree &PDT = FAM.getResult<PostDominatorTreeAnalysis>(*F);
+                BlockFrequencyInfo &BFI = FAM.getResult<BlockFrequencyAnalysis>(*F);
+                const SmallVector<CallBase *, 4> &calls = table.callSites.find(F)->second;
+                DenseMap<const CallBase *, Access> accesses;
+                for (size_t i = 0; i < calls.size(); i++)
+                    if (getNonblockingName(summary.mpiCalls[i].kind) && !isa<InvokeInst>(calls[i]))
+                        accesses[calls[i]] = getAccess(calls[i], summary.mpiCalls[i]);
+                for (size_t i = 0; i < calls.size(); i++)
+                    if (accesses.count(calls[i]))
+                        sites.push_back({calls[i], summary.mpiCalls[i].kind,
+                                         findWaitPoint(calls[i], accesses, AA, DT, PDT, BFI)});
+            }
 
-namespace
-{
-    // Structure to hold MPI communication details such as type, communicator, tag, and rank.
-    struct MPICommunication
+            // Post & wait first, and only then remove the blocking calls: a wait may go right before one
+            size_t converted = 0;
+            SmallVector<std::pair<CallBase *, CallInst *>, 8> replaced;
+            for (Site &site : sites)
+            {
+                const char *name = getEntryPoint(site.kind).name;
+                errs() << "[INFO] " << name << " in " << site.call->getFunction()->getName();
+                if (!site.wait.instructions)
+                {
+                    errs() << " stays blocking: nothing to overlap before ";
+                    describe(errs(), site.call, site.wait);
+                    errs() << "\n";
+                    continue;
+                }
+                errs() << " -> " << getNonblockingName(site.kind) << " + MPI_Wait after " << site.wait.instructions
+                       << " instruction(s), ~" << format("%.0f", site.wait.executed) << " executed per call";
+                errs() << ", before ";
+                describe(errs(), site.call, site.wait);
+                errs() << "\n";
+                replaced.push_back({site.call, convert(site.call, site.kind, site.wait.point)});
+                converted++;
+            }
+            for (auto &call : replaced)
+            {
+                // The call's status is the status of the wait
+                call.first->replaceAllUsesWith(call.second);
+                call.first->eraseFromParent();
+            }
+            errs() << "[INFO] " << converted << " of " << sites.size() << " blocking call(s) overlapped with computation\n";
+            NumOverlappedCalls += converted;
+            if (!converted)
+                return PreservedAnalyses::all();
+
+            // MPI calls were replaced
+            PreservedAnalyses PA = PreservedAnalyses::none();
+            PA.abandon<MPIEntryPointAnalysis>();
+            return PA;
+        }
+
+        // Returns the nonblocking counterpart of a blocking call, or null if the pass does not convert it
+        static const char *getNonblockingName(MPIOpKind kind)
+        {
+            switch (kind)
+            {
+            case MPIOpKind::Send:
+                return "MPI_Isend";
+            case MPIOpKind::Ssend:
+                return "MPI_Issend";
+            case MPIOpKind::Bsend:
+                return "MPI_Ibsend";
+            case MPIOpKind::Rsend:
+                return "MPI_Irsend";
+            case MPIOpKind::Recv:
+                return "MPI_Irecv";
+            default:
+                return nullptr;
+            }
+        }
+
+        // Function to get the memory a blocking send or receive accesses: the message size bounds the
+        // buffer when it is known
+        static Access getAccess(const CallBase *call, const MPICommunication &analysis)
+        {
+            Access access;
+            access.receive = isReceive(analysis.kind);
+            bool sized = analysis.bytes && analysis.bytes != UINT32_MAX;
+            access.locations.push_back(MemoryLocation(call->getArgOperand(0),
+                                                      sized ? LocationSize::precise(analysis.bytes)
+                                                            : LocationSize::beforeOrAfterPointer()));
+            if (access.receive && !isa<ConstantPointerNull>(call->getArgOperand(6)->stripPointerCasts()))
+                access.locations.push_back(MemoryLocation::getBeforeOrAfter(call->getArgOperand(6)));
+            return access;
+        }
+
+        // Checks whether an instruction may run while the communication of call is in flight:
+        // it must not touch the buffer (sends may still read it) or the status, use the call's
+        // result, or call anything that could communicate, synchronize or not return, except
+        // for a blocking send or receive whose own buffers do not conflict
+        static bool canOverlap(const Instruction &I, const CallBase *call,
+                               const DenseMap<const CallBase *, Access> &accesses, AAResults &AA)
+        {
+            if (isa<DbgInfoIntrinsic>(I))
+                return true;
+            if (is_contained(I.operands(), call) || I.isAtomic())
+                return false;
+            const Access &access = accesses.find(call)->second;
+            auto other = accesses.find(dyn_cast<CallBase>(&I));
+            if (other != accesses.end())
+            {
+                if (!access.receive && !other->second.receive)
+                    return true;
+                for (const MemoryLocation &location : access.locations)
+                    for (const MemoryLocation &otherLocation : other->second.locations)
+                        if (!AA.isNoAlias(location, otherLocation))
+                            return false;
+                return true;
+            }
+            if (I.mayThrow())
+                return false;
+            if (auto *otherCall = dyn_cast<CallBase>(&I))
+                if (!isa<IntrinsicInst>(otherCall) && !otherCall->onlyReadsMemory())
+                    return false;
+            for (const MemoryLocation &location : access.locations)
+            {
+                ModRefInfo accessed = AA.getModRefInfo(&I, location);
+                if (access.receive ? !isNoModRef(accessed) : isModSet(accessed))
+                    return false;
+            }
+            return true;
+        }
+
+        // Function to find how far the wait of a blocking call can be sunk
+        static WaitPoint findWaitPoint(CallBase *call, const DenseMap<const CallBase *, Access> &accesses,
+                                       AAResults &AA, const DominatorTree &DT, const PostDominatorTree &PDT,
+                                       BlockFrequencyInfo &BFI)
+        {
+            WaitPoint wait;
+            BasicBlock *postBlock = call->getParent();
+            double postFrequency = std::max<uint64_t>(BFI.getBlockFreq(postBlock).getFrequency(), 1);
+            auto count = [&](const BasicBlock *BB, uint64_t instructions)
+            {
+                wait.instructions += instructions;
+                wait.executed += instructions * (BFI.getBlockFreq(BB).getFrequency() / postFrequency);
+            };
+            // Instructions that count as computation
+            auto isComputation = [&](const Instruction &I)
+            { return !isa<DbgInfoIntrinsic>(I) && !accesses.count(dyn_cast<CallBase>(&I)); };
+
+            BasicBlock *BB = postBlock;
+            Instruction *I = call->getNextNode();
+            while (true)
+            {
+                // Sink through the rest of the block
+                uint64_t instructions = 0;
+                for (; !I->isTerminator(); I = I->getNextNode())
+                {
+                    if (!canOverlap(*I, call, accesses, AA))
+                    {
+                        count(BB, instructions);
+                        wait.point = wait.blocker = I;
+                        return wait;
+                    }
+                    instructions += isComputation(*I);
+                }
+                count(BB, instructions);
+                wait.point = I;
+                if (!canOverlap(*I, call, accesses, AA))
+                {
+                    wait.blocker = I;
+                    return wait;
+                }
+
+                // Then over the region up to the immediate post-dominator, if the post dominates all of
+                // it (so every path through it starts at the post) and it does not loop back to the post
+                DomTreeNode *exitNode = PDT.getNode(BB) ? PDT.getNode(BB)->getIDom() : nullptr;
+                BasicBlock *exit = exitNode ? exitNode->getBlock() : nullptr;
+                wait.reason = !exit ? "the exits of the function" : "a join with paths that skip the call";
+                if (!exit || !DT.dominates(postBlock, exit))
+                    return wait;
+                SmallVector<BasicBlock *, 8> worklist(succ_begin(BB), succ_end(BB));
+                SmallPtrSet<BasicBlock *, 16> region;
+                uint64_t before = wait.instructions;
+                double executedBefore = wait.executed;
+                while (!worklist.empty())
+                {
+                    BasicBlock *block = worklist.pop_back_val();
+                    if (block == exit || !region.insert(block).second)
+                        continue;
+                    auto blocker = find_if(*block, [&](const Instruction &inner)
+                                           { return !canOverlap(inner, call, accesses, AA); });
+                    if (block == postBlock || !DT.dominates(postBlock, block) || blocker != block->end())
+                    {
+                        if (block == postBlock)
+                            wait.reason = "the loop around the call";
+                        else if (blocker != block->end() && DT.dominates(postBlock, block))
+                            wait.blocker = &*blocker;
+                        wait.instructions = before;
+                        wait.executed = executedBefore;
+                        return wait;
+                    }
+                    count(block, count_if(*block, isComputation));
+                    worklist.append(succ_begin(block), succ_end(block));
+                }
+                wait.reason = "a phi of the call's result";
+                if (any_of(exit->phis(), [call](const PHINode &phi)
+                           { return is_contained(phi.incoming_values(), call); }))
+                    return wait;
+                BB = exit;
+                I = &*exit->getFirstInsertionPt();
+            }
+        }
+
+        // Prints what keeps the wait from sinking further
+        static void describe(raw_ostream &OS, const CallBase *call, const WaitPoint &wait)
+        {
+            const Instruction *I = wait.blocker;
+            if (!I)
+                OS << wait.reason;
+            else if (is_contained(I->operands(), call))
+                OS << "a use of the call's result";
+            else if (auto *other = dyn_cast<CallBase>(I))
+            {
+                Function *callee = other->getCalledFunction();
+                OS << "a call to " << (callee ? callee->getName() : "a function pointer");
+            }
+            else if (I->isAtomic())
+                OS << "an atomic " << I->getOpcodeName();
+            else
+                OS << "a " << I->getOpcodeName() << " that may access the buffer";
+        }
+
+        // Function to post the nonblocking form of a blocking call & wait for it before point
+        static CallInst *convert(CallBase *call, MPIOpKind kind, Instruction *point)
+        {
+            Module &M = *call->getModule();
+            bool receive = isReceive(kind);
+            StringRef prefix = call->getCalledFunction()->getName().startswith("PMPI_") ? "P" : "";
+            Type *requestTy, *statusTy;
+            std::tie(requestTy, statusTy) = getRequestStatusTypes(call, receive, prefix);
+
+            Function *F = call->getFunction();
+            IRBuilder<> B(&*F->getEntryBlock().getFirstInsertionPt());
+            AllocaInst *request = B.CreateAlloca(requestTy, nullptr, "mpi.request");
+
+            SmallVector<Value *, 7> args(call->arg_begin(), call->arg_begin() + 6);
+            SmallVector<Type *, 7> params;
+            for (Value *arg : args)
+                params.push_back(arg->getType());
+            args.push_back(request);
+            params.push_back(request->getType());
+            FunctionCallee post = M.getOrInsertFunction((prefix + getNonblockingName(kind)).str(),
+                                                        FunctionType::get(call->getType(), params, false));
+            FunctionCallee wait = M.getOrInsertFunction((prefix + "MPI_Wait").str(), call->getType(),
+                                                        request->getType(), statusTy);
+
+            B.SetInsertPoint(call);
+            CallInst *posted = B.CreateCall(post, args);
+            B.SetInsertPoint(point);
+            Value *status = receive ? B.CreatePointerCast(call->getArgOperand(6), statusTy)
+                                    : getStatusIgnore(call, statusTy);
+            CallInst *completed = B.CreateCall(wait, {request, status});
+            posted->setDebugLoc(call->getDebugLoc());
+            completed->setDebugLoc(call->getDebugLoc());
+            return completed;
+        }
+
+        static bool isRequired() { return true; }
+    };
+
+    // Advisor & transform pass that recognizes collective operations built from point-to-point calls,
+    // unrolled or in loops: fan-outs (a root sends to many ranks), fan-ins (a root receives from many),
+    // all-to-all exchanges (every rank sends to many) and ring shifts repeated in a loop. Each pattern is
+    // reported with the collective that does the same in O(log P) steps instead of O(P). With
+    // mpi-collectives<rewrite>, a fan-out loop of MPI_Send on rank 0 and the MPI_Recv of the other ranks
+    // are replaced by MPI_Bcast where the pass can prove that every rank of the communicator takes part
+    // exactly once and no other message or collective could be reordered by the substitution.
+    struct MPICollectivePass : public PassInfoMixin<MPICollectivePass>
     {
-        std::string type; // type of MPI call: "Send" or "Recv"
-        std::string comm; // Communicator name, assumed as "MPI_COMM_WORLD" for simplicity
-        int tag;          // Tag associated with the MPI call
-        int rank;         // Rank involved in the MPI call
+        bool rewrite; // Replace the proven fan-outs by MPI_Bcast
+
+        explicit MPICollectivePass(bool rewrite = false) : rewrite(rewrite) {}
+
+        // A send or receive with its analysis
+        struct Site
+        {
+            CallBase *call;
+            const MPICommunication *analysis;
+            ArrayRef<RankInterval> rankIntervals;
+        };
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            const MPIEntryPointTable &table = MAM.getResult<MPIEntryPointAnalysis>(M);
+
+            // Group the sends & receives by (comm, tag); wildcard tags & probes block rewrites on their communicator
+            std::map<uint64_t, SmallVector<Site, 8>> groups;
+            DenseMap<MPICommId, StringRef> blockedComms;
+            for (Function *F : table.callers)
+            {
+                const MPIFunctionSummary &summary = FAM.getResult<MPIFunctionAnalysis>(*F);
+                const SmallVector<CallBase *, 4> &calls = table.callSites.find(F)->second;
+                for (size_t i = 0; i < calls.size(); i++)
+                {
+                    const MPICommunication &call = summary.mpiCalls[i];
+                    if (getEntryPoint(call.kind).opClass == MPIOpClass::Probe)
+                        blockedComms[call.comm] = "a probe on the communicator could observe the messages";
+                    if (!isMessage(call.kind))
+                        continue;
+                    if (call.tag < 0)
+                        blockedComms[call.comm] = "the communicator has a send or receive with a wildcard or non-constant tag";
+                    else
+                        groups[packCommTag(call.comm, call.tag)].push_back({calls[i], &call, summary.rankIntervals});
+                }
+            }
+
+            SmallPtrSet<Function *, 32> reachesMPI = getFunctionsReachingMPI(table);
+            size_t patterns = 0, rewritten = 0;
+            bool simplified = false; // A fan-out loop was put into simplified form
+            for (const auto &group : groups)
+            {
+                MPICommId comm = unpackComm(group.first);
+                int32_t tag = unpackTag(group.first);
+                StringRef commName = table.getCommName(comm);
+
+                // Sends & receives by the world rank that executes them; -1 holds the calls without a rank guard
+                std::map<int32_t, SmallVector<const Site *, 4>> sends, recvs;
+                for (const Site &site : group.second)
+                    (isReceive(site.analysis->kind) ? recvs : sends)[site.analysis->executingRank].push_back(&site);
+
+                for (const auto &root : sends)
+                {
+                    RankSet peers = getPeers(root.second, root.first);
+                    if (root.first < 0 || peers.empty() || peers.isSingleton())
+                        continue;
+
+                    // Fan-out: the root sends to many ranks
+                    bool same = sameBuffer(root.second, FAM);
+                    errs() << "[INFO] Fan-out in Comm " << commName << " with Tag " << tag << " ("
+                           << root.second.front()->call->getFunction()->getName() << "): rank " << root.first << " sends "
+                           << (same ? "the same buffer" : "distinct buffers") << " to ";
+                    peers.print(errs());
+                    errs() << " through " << root.second.size() << " " << getEntryPoint(root.second.front()->analysis->kind).name
+                           << " site(s) -> " << (same ? "MPI_Bcast" : "MPI_Scatter") << " with root " << root.first;
+                    printCommunicatorCondition(errs(), peers, root.first);
+                    errs() << ", O(log P) instead of O(P) steps on the root\n";
+                    patterns++;
+
+                    if (rewrite && same)
+                    {
+                        StringRef reason = rewriteFanOut(group.second, table, FAM, blockedComms, reachesMPI, simplified);
+                        if (reason.empty())
+                            rewritten++;
+                        errs() << (reason.empty() ? "[INFO] Rewrote the fan-out into MPI_Bcast\n" : "[WARN] Not rewritten: ");
+                        if (!reason.empty())
+                            errs() << reason << "\n";
+                    }
+                }
+
+                for (const auto &root : recvs)
+                {
+                    RankSet peers = getPeers(root.second, root.first);
+                    if (root.first < 0 || peers.empty() || peers.isSingleton())
+                        continue;
+
+                    // Fan-in: the root receives from many ranks
+                    bool same = sameBuffer(root.second, FAM);
+                    errs() << "[INFO] Fan-in in Comm " << commName << " with Tag " << tag << " ("
+                           << root.second.front()->call->getFunction()->getName() << "): rank " << root.first
+                           << " receives from ";
+                    peers.print(errs());
+                    errs() << " into " << (same ? "the same buffer" : "distinct buffers") << " -> "
+                           << (same ? "MPI_Reduce (if the root combines the values) or MPI_Gather" : "MPI_Gather")
+                           << " with root " << root.first;
+                    printCommunicatorCondition(errs(), peers, root.first);
+                    errs() << ", O(log P) instead of O(P) steps on the root\n";
+                    patterns++;
+                }
+
+                // Calls without a rank guard run on every rank
+                auto unguarded = sends.find(-1);
+                if (unguarded == sends.end())
+                    continue;
+                for (const Site *site : unguarded->second)
+                {
+                    const MPICommunication &send = *site->analysis;
+                    if (send.peerKind == PeerKind::Interval && !getPeerRanks(send, site->rankIntervals).isSingleton())
+                    {
+                        // All-to-all: every rank sends to many ranks
+                        SmallVector<const Site *, 1> one{site};
+                        bool same = sameBuffer(one, FAM);
+                        errs() << "[INFO] All-to-all in Comm " << commName << " with Tag " << tag << " ("
+                               << site->call->getFunction()->getName() << "): every rank sends "
+                               << (same ? "the same buffer" : "distinct buffers") << " to ";
+                        printPeer(errs(), send, site->rankIntervals);
+                        errs() << " -> " << (same ? "MPI_Allgather" : "MPI_Alltoall")
+                               << ", which the MPI library schedules without O(P) serialized messages per rank\n";
+                        patterns++;
+                    }
+                    else if (send.peerKind == PeerKind::RelativeModSize && (send.frequency > 1 || !send.exactFrequency))
+                    {
+                        // Ring: a shift around the communicator, repeated in a loop
+                        auto partner = recvs.find(-1);
+                        if (partner == recvs.end() ||
+                            none_of(partner->second, [&](const Site *recv)
+                                    { return isMatchingShift(send.peerKind, send.rank, recv->analysis->peerKind, recv->analysis->rank); }))
+                            continue;
+                        errs() << "[INFO] Ring exchange in Comm " << commName << " with Tag " << tag << " ("
+                               << site->call->getFunction()->getName() << "): every rank sends to ";
+                        printPeer(errs(), send, site->rankIntervals);
+                        errs() << ", " << (send.exactFrequency ? "" : "~") << format("%g", send.frequency)
+                               << " time(s) per call -> MPI_Allgather if every rank's block travels around the ring "
+                                  "(P-1 steps), MPI_Sendrecv for a single shift\n";
+                        patterns++;
+                    }
+                }
+            }
+            errs() << "[INFO] " << patterns << " collective pattern(s) built from point-to-point calls";
+            if (rewrite)
+                errs() << ", " << rewritten << " rewritten";
+            errs() << "\n";
+            NumRewrittenCollectives += rewritten;
+            if (!rewritten)
+                return simplified ? PreservedAnalyses::none() : PreservedAnalyses::all();
+
+            // MPI calls were replaced
+            PreservedAnalyses PA = PreservedAnalyses::none();
+            PA.abandon<MPIEntryPointAnalysis>();
+            return PA;
+        }
+
+        // Checks whether a call sends or receives one message per execution
+        static bool isMessage(MPIOpKind kind)
+        {
+            switch (kind)
+            {
+            case MPIOpKind::Send:
+            case MPIOpKind::Ssend:
+            case MPIOpKind::Bsend:
+            case MPIOpKind::Rsend:
+            case MPIOpKind::Recv:
+            case MPIOpKind::Isend:
+            case MPIOpKind::Issend:
+            case MPIOpKind::Ibsend:
+            case MPIOpKind::Irsend:
+            case MPIOpKind::Irecv:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // Function to get the ranks a group of calls executed by rank root names as their peers;
+        // rank-relative peers are concrete once the executing rank is known
+        static RankSet getPeers(ArrayRef<const Site *> sites, int32_t root)
+        {
+            RankSet peers;
+            for (const Site *site : sites)
+            {
+                const MPICommunication &call = *site->analysis;
+                if (root >= 0 && call.peerKind == PeerKind::Relative)
+                {
+                    if (root + call.rank >= 0)
+                        peers = peers.unionWith(RankInterval::single(root + call.rank));
+                }
+                else
+                    peers = peers.unionWith(getPeerRanks(call, site->rankIntervals));
+            }
+            return peers;
+        }
+
+        // Checks whether every call of a group uses one buffer that does not change from one iteration
+        // of the call's loop to the next
+        static bool sameBuffer(ArrayRef<const Site *> sites, FunctionAnalysisManager &FAM)
+        {
+            const Value *buffer = sites.front()->call->getArgOperand(0)->stripPointerCasts();
+            for (const Site *site : sites)
+            {
+                const Value *other = site->call->getArgOperand(0)->stripPointerCasts();
+                if (other != buffer)
+                    return false;
+                const LoopInfo &LI = FAM.getResult<LoopAnalysis>(*site->call->getFunction());
+                const Loop *L = LI.getLoopFor(site->call->getParent());
+                if (L && !L->isLoopInvariant(other))
+                    return false;
+            }
+            return true;
+        }
+
+        // Prints on which communicator a pattern over concrete ranks is the collective: one holding exactly
+        // the root & its peers (symbolic sets such as {1..size-1} already span the communicator)
+        static void printCommunicatorCondition(raw_ostream &OS, const RankSet &peers, int32_t root)
+        {
+            RankSet members = peers.unionWith(RankInterval::single(root));
+            if (any_of(members.getIntervals(), [](const RankInterval &i)
+                       { return i.lastFromSize; }))
+                return;
+            OS << " (on a communicator of exactly the ranks ";
+            members.print(OS);
+            OS << ")";
+        }
+
+        // Function to replace the fan-out of a (comm, tag) group by MPI_Bcast. The group must consist of
+        // one MPI_Send in a loop over the peers {1..size-1} guarded by `rank == 0`, and one MPI_Recv from rank
+        // 0 that every other rank executes once on the other side of the guard, with the same count & datatype.
+        // The loop is put into simplified form first, as LoopSimplify would (setting simplified), so a loop
+        // entered straight from an `if (size > 1)` test gets the preheader the root's broadcast goes in.
+        // Returns why the group cannot be rewritten (empty if it was rewritten).
+        static StringRef rewriteFanOut(ArrayRef<Site> group, const MPIEntryPointTable &table, FunctionAnalysisManager &FAM,
+                                       const DenseMap<MPICommId, StringRef> &blockedComms,
+                                       const SmallPtrSetImpl<Function *> &reachesMPI, bool &simplified)
+        {
+            const MPICommunication &first = *group.front().analysis;
+            if (first.comm != WorldCommId)
+                return "only fan-outs on MPI_COMM_WORLD are rewritten";
+            StringRef blocked = blockedComms.lookup(first.comm);
+            if (!blocked.empty())
+                return blocked;
+            if (count_if(group, [](const Site &site)
+                         { return !isReceive(site.analysis->kind); }) != 1)
+                return "the root does not send through one loop over the whole communicator";
+            if (group.size() != 2)
+                return "the tag is used by other sends or receives than one fan-out loop & one receive";
+            const Site &sendSite = isReceive(group[0].analysis->kind) ? group[1] : group[0];
+            const Site &recvSite = isReceive(group[0].analysis->kind) ? group[0] : group[1];
+            const MPICommunication &send = *sendSite.analysis, &recv = *recvSite.analysis;
+            CallBase *sendCall = sendSite.call, *recvCall = recvSite.call;
+            if (send.kind != MPIOpKind::Send || recv.kind != MPIOpKind::Recv)
+                return "only a fan-out of MPI_Send received by MPI_Recv is rewritten";
+            if (send.executingRank != 0 || send.peerKind != PeerKind::Interval)
+                return "the root is not rank 0 sending in a loop";
+            const RankInterval &peers = sendSite.rankIntervals[send.rank];
+            if (peers.first != 1 || peers.stride != 1 || !peers.lastFromSize || peers.last != -1)
+                return "the loop does not send to every rank {1..size-1}";
+            if (recv.peerKind != PeerKind::Constant || recv.rank != 0)
+                return "the receive does not name rank 0 as its source";
+            if (recvCall->getFunction() != sendCall->getFunction())
+                return "the send & the receive are in different functions";
+            if (!isa<ConstantPointerNull>(recvCall->getArgOperand(6)->stripPointerCasts()))
+                return "the receive status is used";
+            if (!sendCall->use_empty() || !recvCall->use_empty())
+                return "the result of the send or receive is used";
+            if (sendCall->getArgOperand(2) != recvCall->getArgOperand(2) ||
+                (sendCall->getArgOperand(1) != recvCall->getArgOperand(1) &&
+                 (!isa<ConstantInt>(sendCall->getArgOperand(1)) || !isa<ConstantInt>(recvCall->getArgOperand(1)) ||
+                  cast<ConstantInt>(sendCall->getArgOperand(1))->getSExtValue() !=
+                      cast<ConstantInt>(recvCall->getArgOperand(1))->getSExtValue())))
+                return "the send & the receive differ in count or datatype";
+
+            Function &F = *sendCall->getFunction();
+            DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+            LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+            ScalarEvolution &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+            Loop *L = LI.getLoopFor(sendCall->getParent());
+            if (L && !L->isLoopSimplifyForm() &&
+                simplifyLoop(L, &DT, &LI, &SE, &FAM.getResult<AssumptionAnalysis>(F), nullptr, false))
+            {
+                // Only blocks & phis were added: the summaries stay valid, the analyses simplifyLoop
+                // updated are kept, and the others are recomputed
+                simplified = true;
+                PreservedAnalyses PA;
+                PA.preserve<MPIFunctionAnalysis>();
+                PA.preserve<DominatorTreeAnalysis>();
+                PA.preserve<LoopAnalysis>();
+                PA.preserve<ScalarEvolutionAnalysis>();
+                PA.preserve<AssumptionAnalysis>();
+                FAM.invalidate(F, PA);
+            }
+            const PostDominatorTree &PDT = FAM.getResult<PostDominatorTreeAnalysis>(F);
+            AAResults &AA = FAM.getResult<AAManager>(F);
+
+            // The loop sends the unchanged buffer on every iteration, and its trip count is the communicator's size
+            BasicBlock *preheader = L ? L->getLoopPreheader() : nullptr;
+            if (!preheader || !L->getLoopLatch() || !DT.dominates(sendCall->getParent(), L->getLoopLatch()))
+                return "the send does not run on every iteration of a loop in simplified form";
+            if (!L->isLoopInvariant(sendCall->getArgOperand(0)) || !L->isLoopInvariant(sendCall->getArgOperand(1)) ||
+                !L->isLoopInvariant(sendCall->getArgOperand(2)))
+                return "the buffer, count or datatype changes in the loop";
+            const SCEV *tripCount = SE.getBackedgeTakenCount(L);
+            if (isa<SCEVCouldNotCompute>(tripCount) ||
+                SCEVExprContains(tripCount, [&](const SCEV *S)
+                                 {
+                                     auto *unknown = dyn_cast<SCEVUnknown>(S);
+                                     MPICommId queried;
+                                     return unknown && !(table.isCommQueryResult(unknown->getValue(), MPIOpKind::CommSize, &queried) &&
+                                                         queried == send.comm); }))
+                return "the trip count is not derived from the size of the communicator";
+            MemoryLocation buffer(sendCall->getArgOperand(0), send.bytes && send.bytes != UINT32_MAX
+                                                                  ? LocationSize::precise(send.bytes)
+                                                                  : LocationSize::beforeOrAfterPointer());
+            for (BasicBlock *BB : L->blocks())
+                for (Instruction &I : *BB)
+                {
+                    if (&I == sendCall || isa<DbgInfoIntrinsic>(I) || I.isLifetimeStartOrEnd())
+                        continue;
+                    if (isa<CallBase>(I) && !isa<IntrinsicInst>(I))
+                        return "the loop makes other calls than the send";
+                    if (I.mayWriteToMemory() && isModSet(AA.getModRefInfo(&I, buffer)))
+                        return "the loop may write the buffer";
+                }
+
+            // Each time the guard is evaluated, rank 0 enters the loop at most once (if it skips the loop while
+            // there are other ranks, their receives never complete either) & every other rank runs the receive once.
+            // The summary gave the send the executing ranks {0}; the guard that admits only rank 0 splits the ranks.
+            BasicBlock *rootBB = nullptr;
+            MPIFunctionAnalysis::forEachRankGuard(preheader, DT, table, [&](BasicBlock *BB, const RankSet &allowed)
+                                                  {
+                                                      if (allowed.isSingleton() && allowed.contains(0))
+                                                          rootBB = BB;
+                                                      return !rootBB; });
+            if (!rootBB)
+                return "the loop is not under an `if (rank == 0)` guard";
+            BasicBlock *guardBB = rootBB->getSinglePredecessor();
+            auto *guard = cast<BranchInst>(guardBB->getTerminator());
+            BasicBlock *otherBB = guard->getSuccessor(0) == rootBB ? guard->getSuccessor(1) : guard->getSuccessor(0);
+            const Loop *guardLoop = LI.getLoopFor(guardBB);
+            if (L->getParentLoop() != guardLoop)
+                return "rank 0 may run the loop more than once under the guard";
+            if (otherBB->getSinglePredecessor() != guardBB || !DT.dominates(otherBB, recvCall->getParent()) ||
+                !PDT.dominates(recvCall->getParent(), otherBB) || LI.getLoopFor(recvCall->getParent()) != guardLoop)
+                return "the other ranks do not all run the receive exactly once";
+
+            // Nothing else on either side of the guard may communicate, so every rank reaches the broadcast
+            // with the same collectives & messages before it
+            for (BasicBlock &BB : F)
+            {
+                if (!DT.dominates(rootBB, &BB) && !DT.dominates(otherBB, &BB))
+                    continue;
+                for (Instruction &I : BB)
+                {
+                    auto *call = dyn_cast<CallBase>(&I);
+                    if (!call || call == sendCall || call == recvCall || isa<IntrinsicInst>(call))
+                        continue;
+                    if (mayCommunicate(*call, table, reachesMPI))
+                        return "another call that may communicate is on a side of the rank guard";
+                }
+            }
+
+            // Broadcast from rank 0 before the loop, and in place of the receive
+            Module &M = *F.getParent();
+            StringRef prefix = sendCall->getCalledFunction()->getName().startswith("PMPI_") ? "P" : "";
+            SmallVector<Type *, 5> params;
+            for (unsigned arg : {0, 1, 2, 3, 5})
+                params.push_back(sendCall->getArgOperand(arg)->getType());
+            FunctionCallee bcast = M.getOrInsertFunction((prefix + "MPI_Bcast").str(),
+                                                         FunctionType::get(sendCall->getType(), params, false));
+            auto broadcast = [&](Instruction *point, CallBase *call)
+            {
+                IRBuilder<> B(point);
+                FunctionType *type = bcast.getFunctionType();
+                Value *args[] = {call->getArgOperand(0), call->getArgOperand(1), call->getArgOperand(2),
+                                 ConstantInt::get(params[3], 0), call->getArgOperand(5)};
+                for (unsigned i = 0; i < 5; i++)
+                    args[i] = args[i]->getType()->isPointerTy() ? B.CreatePointerCast(args[i], type->getParamType(i))
+                                                                : B.CreateSExtOrTrunc(args[i], type->getParamType(i));
+                B.CreateCall(bcast, args)->setDebugLoc(call->getDebugLoc());
+            };
+            broadcast(preheader->getTerminator(), sendCall);
+            broadcast(recvCall, recvCall);
+            sendCall->eraseFromParent(); // The emptied loop is left to loop deletion
+            recvCall->eraseFromParent();
+            return "";
+        }
+
+        static bool isRequired() { return true; }
     };
 
-    // Main analysis pass that analyzes MPI communication patterns in a function
-    struct MPIAnalysisPass : public PassInfoMixin<MPIAnalysisPass>
+    // Transform pass that fuses independent back-to-back MPI_Allreduce calls with the same communicator,
+    // datatype & reduction op (or MPI_Bcast calls with the same communicator, datatype & root) into one
+    // vector collective. Every call copies its input into a pack buffer where it used to be, the last
+    // call reduces (or broadcasts) the whole buffer, and the results are scattered back to the calls'
+    // output buffers right after it. Calls are fused only if nothing between them reads or writes an
+    // earlier call's output buffer, uses its result or could communicate, so each synchronization they
+    // saved changes no value the program observes. Collectives that cannot be fused are reported with the reason.
+    struct MPIFusePass : public PassInfoMixin<MPIFusePass>
     {
-        std::vector<MPICommunication> mpiCalls; // Vector to store detected MPI calls in the function
+        uint64_t maxBytes; // Largest fused message
 
-        // Function that runs the analysis pass on the given function F
-        PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM)
+        explicit MPIFusePass(uint64_t maxBytes = 4096) : maxBytes(maxBytes) {}
+
+        // Back-to-back fusable collectives of one basic block
+        struct Run
+        {
+            SmallVector<CallBase *, 4> calls;
+            SmallVector<uint64_t, 4> counts; // Constant element counts
+            MPICommunication first;          // Analysis of the first call
+            unsigned datatypeSize = 0;
+        };
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
         {
-            errs() << "MPIAnalysisPass running on function: " << F.getName() << "\n";
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            const MPIEntryPointTable &table = MAM.getResult<MPIEntryPointAnalysis>(M);
+            SmallPtrSet<Function *, 32> reachesMPI = getFunctionsReachingMPI(table);
 
-            for (auto &BB : F) // Each basic block in the function
+            // Collect the runs first: the rewrite invalidates the function analyses
+            std::vector<Run> runs;
+            for (Function *F : table.callers)
             {
-                for (auto &I : BB) // Each instruction in the basic block
+                const MPIFunctionSummary &summary = FAM.getResult<MPIFunctionAnalysis>(*F);
+                AAResults &AA = FAM.getResult<AAManager>(*F);
+                const SmallVector<CallBase *, 4> &calls = table.callSites.find(F)->second;
+                Optional<Run> current;
+                for (size_t i = 0; i < calls.size(); i++)
                 {
-                    if (auto *call = dyn_cast<CallInst>(&I)) // Check if the instruction is a function call
+                    const MPICommunication &call = summary.mpiCalls[i];
+                    if (call.kind != MPIOpKind::Allreduce && call.kind != MPIOpKind::Bcast)
+                        continue;
+
+                    // Extend the current run with the next collective of its kind, block & communicator
+                    if (current && isNext(*current, calls[i], call))
                     {
-                        // Get the called function and its name
-                        if (Function *calledFunc = call->getCalledFunction())
+                        StringRef reason = extends(*current, calls[i], call, AA, table, reachesMPI);
+                        if (reason.empty())
                         {
-                            StringRef funcName = calledFunc->getName();
-                            // If the function is MPI_Send or MPI_Recv, analyze the call
-                            if (funcName.equals("MPI_Send") || funcName.equals("MPI_Recv"))
-                            {
-                                analyzeMPICall(call, funcName);
-                            }
+                            current->calls.push_back(calls[i]);
+                            current->counts.push_back(
+                                cast<ConstantInt>(calls[i]->getArgOperand(countArg(call.kind)))->getZExtValue());
+                            continue;
                         }
+                        errs() << "[WARN] Not fused: " << getEntryPoint(call.kind).name << " in Comm "
+                               << table.getCommName(call.comm) << " (" << F->getName() << ") with the one before it: "
+                               << reason << "\n";
                     }
+                    if (current && current->calls.size() > 1)
+                        runs.push_back(std::move(*current));
+                    current.reset();
+
+                    // Start a new run with a call of constant count & predefined datatype
+                    auto *count = dyn_cast<ConstantInt>(calls[i]->getArgOperand(countArg(call.kind)));
+                    unsigned size = getDatatypeSize(calls[i]->getArgOperand(countArg(call.kind) + 1));
+                    if (!count || count->isNegative() || !size || call.comm == UnresolvedCommId ||
+                        isa<InvokeInst>(calls[i]))
+                        continue;
+                    current.emplace();
+                    current->calls.push_back(calls[i]);
+                    current->counts.push_back(count->getZExtValue());
+                    current->first = call;
+                    current->datatypeSize = size;
                 }
+                if (current && current->calls.size() > 1)
+                    runs.push_back(std::move(*current));
+            }
+
+            for (Run &run : runs)
+            {
+                errs() << "[INFO] Fused " << run.calls.size() << " " << getEntryPoint(run.first.kind).name
+                       << " calls in Comm " << table.getCommName(run.first.comm) << " ("
+                       << run.calls.front()->getFunction()->getName() << ") into one of "
+                       << totalCount(run) * run.datatypeSize << " bytes\n";
+                rewrite(run);
             }
+            errs() << "[INFO] " << runs.size() << " run(s) of collectives fused\n";
+            NumFusedRuns += runs.size();
+            if (runs.empty())
+                return PreservedAnalyses::all();
+
+            // MPI calls were removed & retargeted
+            PreservedAnalyses PA = PreservedAnalyses::none();
+            PA.abandon<MPIEntryPointAnalysis>();
+            return PA;
+        }
 
-            analyzeUniformParticipation();   // Analyze uniform participation patterns (generates report)
-            return PreservedAnalyses::all(); // Indicate that all analyses are preserved
+        // Position of the count argument; the datatype follows it
+        static unsigned countArg(MPIOpKind kind) { return kind == MPIOpKind::Allreduce ? 2 : 1; }
+
+        // Checks whether a send buffer argument is MPI_IN_PLACE, a small integer constant cast to a pointer
+        static bool isInPlace(const Value *buffer)
+        {
+            auto *expr = dyn_cast<ConstantExpr>(buffer->stripPointerCasts());
+            return expr && expr->getOpcode() == Instruction::IntToPtr && isa<ConstantInt>(expr->getOperand(0));
         }
 
-        // Function to analyze an MPI call (either MPI_Send or MPI_Recv)
-        void analyzeMPICall(CallInst *call, StringRef funcName)
+        // Memory a collective writes its result to: the receive buffer of MPI_Allreduce, the buffer of MPI_Bcast
+        static MemoryLocation getOutput(const CallBase *call, MPIOpKind kind, uint64_t bytes)
         {
-            MPICommunication mpiComm;      // Create an MPICommunication object to store MPI call details
-            mpiComm.type = funcName.str(); // Store the type of MPI call (MPI_Send or MPI_Recv)
+            return MemoryLocation(call->getArgOperand(kind == MPIOpKind::Allreduce ? 1 : 0), LocationSize::precise(bytes));
+        }
 
-            mpiComm.comm = "MPI_COMM_WORLD"; // Assuming the communicator is always MPI_COMM_WORLD
+        // Memory a collective reads its input from
+        static MemoryLocation getInput(const CallBase *call, MPIOpKind kind, uint64_t bytes)
+        {
+            const Value *buffer = call->getArgOperand(0);
+            if (kind == MPIOpKind::Allreduce && isInPlace(buffer))
+                buffer = call->getArgOperand(1);
+            return MemoryLocation(buffer, LocationSize::precise(bytes));
+        }
 
-            // Extract the tag, which is the 5th argument (4th index) in both MPI_Send & MPI_Recv
-            if (auto *tagArg = dyn_cast<ConstantInt>(call->getArgOperand(4)))
-            {
-                mpiComm.tag = tagArg->getSExtValue();
-            }
+        // Checks whether a collective is a candidate to continue a run: the same operation on the same
+        // communicator, later in the same basic block
+        static bool isNext(const Run &run, const CallBase *call, const MPICommunication &analysis)
+        {
+            return run.calls.back()->getParent() == call->getParent() && analysis.kind == run.first.kind &&
+                   analysis.comm == run.first.comm;
+        }
+
+        // Function to check whether a candidate can join a run; returns why not (empty if it can)
+        StringRef extends(const Run &run, CallBase *call, const MPICommunication &analysis, AAResults &AA,
+                          const MPIEntryPointTable &table, const SmallPtrSetImpl<Function *> &reachesMPI) const
+        {
+            const CallBase *last = run.calls.back();
+            const CallBase *first = run.calls.front();
+            MPIOpKind kind = run.first.kind;
+            unsigned count = countArg(kind);
+            if (first->getArgOperand(count + 1) != call->getArgOperand(count + 1))
+                return "the datatypes differ";
+            if (kind == MPIOpKind::Allreduce && first->getArgOperand(4) != call->getArgOperand(4))
+                return "the reduction ops differ";
+            if (kind == MPIOpKind::Bcast && first->getArgOperand(3) != call->getArgOperand(3))
+                return "the roots differ";
+            auto *countValue = dyn_cast<ConstantInt>(call->getArgOperand(count));
+            if (!countValue || countValue->isNegative())
+                return "the count is not constant";
+            if ((totalCount(run) + countValue->getZExtValue()) * run.datatypeSize > maxBytes)
+                return "the fused message would exceed max-bytes";
 
-            // Extract the rank, which is the 4th argument (3rd index) in both MPI_Send & MPI_Recv
-            int rankArgIndex = 3;
-            if (auto *rankArg = dyn_cast<ConstantInt>(call->getArgOperand(rankArgIndex)))
+            // Nothing between the calls may depend on or change an earlier call's output, which the fused
+            // call only writes after the last of them
+            SmallVector<MemoryLocation, 4> outputs;
+            for (size_t i = 0; i < run.calls.size(); i++)
+                outputs.push_back(getOutput(run.calls[i], kind, run.counts[i] * run.datatypeSize));
+            for (const Instruction *I = last->getNextNode(); I != call; I = I->getNextNode())
             {
-                mpiComm.rank = rankArg->getSExtValue();
+                if (isa<DbgInfoIntrinsic>(I) || I->isLifetimeStartOrEnd())
+                    continue;
+                if (any_of(run.calls, [I](const CallBase *earlier)
+                           { return is_contained(I->operands(), earlier); }))
+                    return "the result of an earlier call is checked in between";
+                if (auto *other = dyn_cast<CallBase>(I))
+                {
+                    if (mayCommunicate(*other, table, reachesMPI))
+                        return "a call that may communicate is in between";
+                }
+                if (I->mayThrow())
+                    return "an instruction in between may throw";
+                for (const MemoryLocation &output : outputs)
+                    if (!isNoModRef(AA.getModRefInfo(I, output)))
+                        return "an instruction in between accesses the output of an earlier call";
             }
 
-            // Store the analyzed MPI call in the mpiCalls vector
-            mpiCalls.push_back(mpiComm);
+            // The call's own buffers must be independent of the earlier outputs
+            uint64_t bytes = countValue->getZExtValue() * run.datatypeSize;
+            MemoryLocation input = getInput(call, kind, bytes), output = getOutput(call, kind, bytes);
+            for (const MemoryLocation &earlier : outputs)
+                if (!AA.isNoAlias(input, earlier) || !AA.isNoAlias(output, earlier))
+                    return "its buffer may depend on the output of an earlier call";
+            return "";
+        }
 
-            // Output the detected MPI call details for debugging
-            errs() << "[INFO] Detected MPI " << mpiComm.type << ": comm=" << mpiComm.comm
-                   << ", tag=" << mpiComm.tag << ", rank=" << mpiComm.rank << "\n";
+        static uint64_t totalCount(const Run &run)
+        {
+            uint64_t total = 0;
+            for (uint64_t count : run.counts)
+                total += count;
+            return total;
         }
 
-        // Function to analyze uniform participation patterns among MPI processes
-        void analyzeUniformParticipation()
+        // Function to rewrite a run: each call copies its input into the pack buffer at its own position,
+        // the last call runs on the whole buffer, and the results are copied out right after it
+        static void rewrite(Run &run)
         {
-            errs() << "\n[INFO] Analyzing Uniform Participation Patterns...\n\n";
+            MPIOpKind kind = run.first.kind;
+            CallBase *fused = run.calls.back();
+            Function *F = fused->getFunction();
+            uint64_t bytes = totalCount(run) * run.datatypeSize;
 
-            // Map to store ranks involved in each (comm, tag) pair
-            std::map<std::pair<std::string, int>, std::set<int>> participationMap; // (comm, tag) -> {ranks}
+            // MPI_Allreduce needs separate send & receive halves; MPI_Bcast works in place
+            IRBuilder<> B(&*F->getEntryBlock().getFirstInsertionPt());
+            uint64_t halves = kind == MPIOpKind::Allreduce ? 2 : 1;
+            AllocaInst *pack = B.CreateAlloca(B.getInt8Ty(), B.getInt64(bytes * halves), "mpi.fuse.buf");
+            pack->setAlignment(Align(16));
+            auto part = [&](uint64_t offset) -> Value *
+            { return offset ? B.CreateConstInBoundsGEP1_64(B.getInt8Ty(), pack, offset) : pack; };
+            uint64_t resultOffset = kind == MPIOpKind::Allreduce ? bytes : 0;
 
-            // Populate participationMap with ranks involved in each (comm, tag) pair
-            for (const auto &call : mpiCalls)
+            uint64_t offset = 0;
+            SmallVector<std::pair<Value *, uint64_t>, 4> outputs; // Output buffer & its offset in the pack
+            for (size_t i = 0; i < run.calls.size(); i++)
             {
-                participationMap[{call.comm, call.tag}].insert(call.rank);
+                CallBase *call = run.calls[i];
+                uint64_t callBytes = run.counts[i] * run.datatypeSize;
+                B.SetInsertPoint(call);
+                Value *input = const_cast<Value *>(getInput(call, kind, callBytes).Ptr);
+                B.CreateMemCpy(part(offset), Align(1), input, Align(1), callBytes);
+                outputs.push_back({const_cast<Value *>(getOutput(call, kind, callBytes).Ptr), offset});
+                offset += callBytes;
+                if (call != fused)
+                {
+                    call->replaceAllUsesWith(fused);
+                    call->eraseFromParent();
+                }
             }
 
-            // Iterate over the participationMap to identify and report uniform participation
-            for (const auto &entry : participationMap)
+            B.SetInsertPoint(fused);
+            fused->setArgOperand(0, B.CreatePointerCast(pack, fused->getArgOperand(0)->getType()));
+            if (kind == MPIOpKind::Allreduce)
+                fused->setArgOperand(1, B.CreatePointerCast(part(resultOffset), fused->getArgOperand(1)->getType()));
+            unsigned count = countArg(kind);
+            fused->setArgOperand(count, ConstantInt::get(fused->getArgOperand(count)->getType(), totalCount(run)));
+
+            // Scatter the results back
+            B.SetInsertPoint(fused->getNextNode());
+            for (size_t i = 0; i < outputs.size(); i++)
+                B.CreateMemCpy(outputs[i].first, Align(1), part(resultOffset + outputs[i].second), Align(1),
+                               run.counts[i] * run.datatypeSize);
+        }
+
+        static bool isRequired() { return true; }
+    };
+
+    // Transform pass that turns the sends & receives repeated on every iteration of a loop with the same
+    // buffer, count, datatype, peer, tag & communicator into a persistent request. The arguments must be
+    // loop-invariant: defined outside the loop, computed in it without side effects from invariant values,
+    // or loaded from memory that nothing in the loop may write. The request is created by MPI_Send_init
+    // (or MPI_Recv_init...) on the first execution of the call in the loop, so a loop that never makes the
+    // call creates none; every execution becomes MPI_Start & MPI_Wait, and the loop's exits free the
+    // request. The outermost loop in which the arguments stay invariant is used.
+    struct MPIPersistentPass : public PassInfoMixin<MPIPersistentPass>
+    {
+        // A call to convert, the loop its request lives in and the loop's exits
+        struct Site
+        {
+            CallBase *call;
+            MPIOpKind kind;
+            SmallVector<BasicBlock *, 4> exits;
+        };
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            const MPIEntryPointTable &table = MAM.getResult<MPIEntryPointAnalysis>(M);
+
+            // Collect the sites first: the rewrite changes the control flow
+            std::vector<Site> sites;
+            size_t candidates = 0;
+            for (Function *F : table.callers)
             {
-                // If more than one rank is involved in a (comm, tag) pair, report it as uniform participation
-                if (entry.second.size() > 1)
+                const MPIFunctionSummary &summary = FAM.getResult<MPIFunctionAnalysis>(*F);
+                AAResults &AA = FAM.getResult<AAManager>(*F);
+                const LoopInfo &LI = FAM.getResult<LoopAnalysis>(*F);
+                const SmallVector<CallBase *, 4> &calls = table.callSites.find(F)->second;
+                for (size_t i = 0; i < calls.size(); i++)
                 {
-                    errs() << "[INFO] Uniform Participation Detected in Comm " << entry.first.first
-                           << " with Tag " << entry.first.second << " involving Ranks: ";
-                    for (int rank : entry.second) // Output the ranks involved in the uniform participation
+                    MPIOpKind kind = summary.mpiCalls[i].kind;
+                    const Loop *innermost = LI.getLoopFor(calls[i]->getParent());
+                    if (!getPersistentName(kind) || !innermost)
+                        continue;
+                    candidates++;
+
+                    const char *name = getEntryPoint(kind).name;
+                    errs() << "[INFO] " << name << " in " << F->getName();
+                    std::string reason = isa<InvokeInst>(calls[i]) ? "the call may throw" : "";
+                    const Loop *L = nullptr;
+                    for (const Loop *candidate = innermost; candidate && reason.empty();
+                         candidate = candidate->getParentLoop())
                     {
-                        errs() << rank << " ";
+                        std::string failed = checkLoop(calls[i], kind, candidate, table, AA);
+                        if (!failed.empty())
+                        {
+                            if (!L)
+                                reason = failed;
+                            break;
+                        }
+                        L = candidate;
                     }
-                    errs() << "\n";
-
-                    // Output a detailed uniform participation report.
-                    errs() << "Uniform Participation Report:\n";
-                    errs() << "------------------------------------\n";
-                    errs() << "- Communicator: " << entry.first.first << "\n";
-                    errs() << "- Tag: " << entry.first.second << "\n";
-                    errs() << "- Participating Ranks: {";
-                    for (auto it = entry.second.begin(); it != entry.second.end(); it++)
+                    if (!L)
                     {
-                        if (it != entry.second.begin())
-                            errs() << ", ";
-                        errs() << *it;
+                        errs() << " stays as is: " << reason << "\n";
+                        continue;
                     }
-                    errs() << "}\n";
-                    errs() << "This indicates that both MPI_Send and MPI_Recv operations with tag "
-                           << entry.first.second << " in communicator\n"
-                           << entry.first.first
-                           << " involve these ranks.\n\n";
+
+                    Site site = {calls[i], kind, {}};
+                    L->getUniqueExitBlocks(site.exits);
+                    errs() << " -> " << getPersistentName(kind) << " + MPI_Start/MPI_Wait in the loop at "
+                           << L->getHeader()->getName() << " (depth " << L->getLoopDepth() << ")\n";
+                    sites.push_back(std::move(site));
                 }
             }
+
+            SmallVector<std::pair<CallBase *, CallInst *>, 8> replaced;
+            for (Site &site : sites)
+                replaced.push_back({site.call, convert(site)});
+            for (auto &call : replaced)
+            {
+                // The call's result & status are those of the wait
+                call.first->replaceAllUsesWith(call.second);
+                call.first->eraseFromParent();
+            }
+            errs() << "[INFO] " << sites.size() << " of " << candidates
+                   << " send(s) & receive(s) in loops turned into persistent requests\n";
+            NumPersistentRequests += sites.size();
+            if (sites.empty())
+                return PreservedAnalyses::all();
+
+            // MPI calls were replaced
+            PreservedAnalyses PA = PreservedAnalyses::none();
+            PA.abandon<MPIEntryPointAnalysis>();
+            return PA;
+        }
+
+        // Returns the persistent counterpart of a blocking call, or null if the pass does not convert it
+        static const char *getPersistentName(MPIOpKind kind)
+        {
+            switch (kind)
+            {
+            case MPIOpKind::Send:
+                return "MPI_Send_init";
+            case MPIOpKind::Ssend:
+                return "MPI_Ssend_init";
+            case MPIOpKind::Bsend:
+                return "MPI_Bsend_init";
+            case MPIOpKind::Rsend:
+                return "MPI_Rsend_init";
+            case MPIOpKind::Recv:
+                return "MPI_Recv_init";
+            default:
+                return nullptr;
+            }
+        }
+
+        // Function to check whether the request of call can live across the iterations of L: returns
+        // an empty string if so, or why not
+        static std::string checkLoop(const CallBase *call, MPIOpKind kind, const Loop *L,
+                                     const MPIEntryPointTable &table, AAResults &AA)
+        {
+            static const char *const arguments[] = {"buffer", "count", "datatype", "peer", "tag", "communicator"};
+            DenseMap<const Value *, bool> invariant;
+            for (unsigned arg = 0; arg < 6; arg++)
+            {
+                if (!isInvariant(call->getArgOperand(arg), L, table, AA, invariant))
+                    return (Twine("the ") + (arg == 3 && isReceive(kind) ? "source" : arguments[arg]) +
+                            " may change between iterations")
+                        .str();
+            }
+            for (const BasicBlock *BB : L->blocks())
+            {
+                // Without an exit block the request could not be freed
+                if (succ_empty(BB))
+                    return "the loop can leave the function";
+                for (const BasicBlock *succ : successors(BB))
+                    if (!L->contains(succ) && succ->isEHPad() && !succ->isLandingPad())
+                        return "the loop exits to a funclet";
+            }
+            return "";
+        }
+
+        // Checks whether V has the same value on every iteration of L: defined outside L, computed in L without
+        // side effects from such values, or loaded from memory that no instruction in L may write. MPI calls
+        // only write memory passed to them, except the completion calls, which finish earlier receives.
+        static bool isInvariant(const Value *V, const Loop *L, const MPIEntryPointTable &table, AAResults &AA,
+                                DenseMap<const Value *, bool> &memo)
+        {
+            if (L->isLoopInvariant(V))
+                return true;
+            auto cached = memo.find(V);
+            if (cached != memo.end())
+                return cached->second;
+            memo[V] = false; // Values that depend on themselves are loop-carried
+
+            const auto *I = cast<Instruction>(V);
+            bool result = false;
+            if (auto *load = dyn_cast<LoadInst>(I))
+            {
+                MemoryLocation location = MemoryLocation::get(load);
+                auto writes = [&](const Instruction &other)
+                {
+                    if (!other.mayWriteToMemory())
+                        return false;
+                    auto *otherCall = dyn_cast<CallBase>(&other);
+                    Optional<MPIOpKind> kind = otherCall ? table.lookup(*otherCall) : None;
+                    if (kind && getEntryPoint(*kind).opClass != MPIOpClass::Completion)
+                        return any_of(otherCall->args(), [&](const Use &arg)
+                                      { return arg->getType()->isPointerTy() &&
+                                               !AA.isNoAlias(MemoryLocation::getBeforeOrAfter(arg), location); });
+                    return isModSet(AA.getModRefInfo(&other, location));
+                };
+                result = load->isSimple() && isInvariant(load->getPointerOperand(), L, table, AA, memo) &&
+                         none_of(L->blocks(), [&](const BasicBlock *BB)
+                                 { return any_of(*BB, writes); });
+            }
+            else if (auto *phi = dyn_cast<PHINode>(I))
+            {
+                // A phi outside the headers of L's loops merges the same value from every predecessor
+                const Value *incoming = phi->hasConstantValue();
+                result = incoming && isInvariant(incoming, L, table, AA, memo);
+            }
+            else if (isa<CastInst>(I) || isa<BinaryOperator>(I) || isa<GetElementPtrInst>(I) || isa<CmpInst>(I) ||
+                     isa<SelectInst>(I))
+            {
+                result = !I->mayHaveSideEffects() && all_of(I->operands(), [&](const Value *operand)
+                                                            { return isInvariant(operand, L, table, AA, memo); });
+            }
+            memo[V] = result;
+            return result;
+        }
+
+        // Function to create the request of a site on the first execution of its call, replace the call by
+        // MPI_Start & MPI_Wait, and free the request on the exits of the loop. Returns the wait.
+        static CallInst *convert(const Site &site)
+        {
+            CallBase *call = site.call;
+            Module &M = *call->getModule();
+            bool receive = isReceive(site.kind);
+            StringRef prefix = call->getCalledFunction()->getName().startswith("PMPI_") ? "P" : "";
+            Type *requestTy, *statusTy;
+            std::tie(requestTy, statusTy) = getRequestStatusTypes(call, receive, prefix);
+
+            // The request & whether it exists, cleared on entry & whenever a loop exit frees it
+            Function *F = call->getFunction();
+            IRBuilder<> B(&*F->getEntryBlock().getFirstInsertionPt());
+            AllocaInst *request = B.CreateAlloca(requestTy, nullptr, "mpi.persistent");
+            AllocaInst *created = B.CreateAlloca(B.getInt1Ty(), nullptr, "mpi.persistent.created");
+            B.CreateStore(B.getFalse(), created);
+
+            SmallVector<Value *, 7> args(call->arg_begin(), call->arg_begin() + 6);
+            SmallVector<Type *, 7> params;
+            for (Value *arg : args)
+                params.push_back(arg->getType());
+            args.push_back(request);
+            params.push_back(request->getType());
+            FunctionCallee init = M.getOrInsertFunction((prefix + getPersistentName(site.kind)).str(),
+                                                        FunctionType::get(call->getType(), params, false));
+            FunctionCallee start = M.getOrInsertFunction((prefix + "MPI_Start").str(), call->getType(),
+                                                         request->getType());
+            FunctionCallee wait = M.getOrInsertFunction((prefix + "MPI_Wait").str(), call->getType(),
+                                                        request->getType(), statusTy);
+            FunctionCallee release = M.getOrInsertFunction((prefix + "MPI_Request_free").str(), call->getType(),
+                                                           request->getType());
+
+            // First execution: create the request from this iteration's (invariant) arguments
+            B.SetInsertPoint(call);
+            Value *exists = B.CreateLoad(B.getInt1Ty(), created);
+            B.SetInsertPoint(SplitBlockAndInsertIfThen(B.CreateNot(exists), call, false));
+            B.CreateCall(init, args)->setDebugLoc(call->getDebugLoc());
+            B.CreateStore(B.getTrue(), created);
+
+            B.SetInsertPoint(call);
+            B.CreateCall(start, {request})->setDebugLoc(call->getDebugLoc());
+            Value *status = receive ? B.CreatePointerCast(call->getArgOperand(6), statusTy)
+                                    : getStatusIgnore(call, statusTy);
+            CallInst *completed = B.CreateCall(wait, {request, status});
+            completed->setDebugLoc(call->getDebugLoc());
+
+            // Leaving the loop frees the request, if this visit of the loop created one
+            for (BasicBlock *exit : site.exits)
+            {
+                B.SetInsertPoint(&*exit->getFirstInsertionPt());
+                Value *live = B.CreateLoad(B.getInt1Ty(), created);
+                B.SetInsertPoint(SplitBlockAndInsertIfThen(live, &*B.GetInsertPoint(), false));
+                B.CreateCall(release, {request})->setDebugLoc(call->getDebugLoc());
+                B.CreateStore(B.getFalse(), created);
+            }
+            return completed;
         }
 
-        // Indicates whether the pass is required to run again.
         static bool isRequired() { return true; }
     };
 }
@@ -145,16 +5327,92 @@ llvmGetPassPluginInfo()
         LLVM_PLUGIN_API_VERSION, "MPIAnalysisPass", LLVM_VERSION_STRING,
         [](PassBuilder &PB)
         {
+            // Register the MPI entry point table & per-function MPI summary so the module pass can query (and cache) them
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM)
+                {
+                    MAM.registerPass([]
+                                     { return MPIEntryPointAnalysis(); });
+                });
+            PB.registerAnalysisRegistrationCallback(
+                [](FunctionAnalysisManager &FAM)
+                {
+                    FAM.registerPass([]
+                                     { return MPIFunctionAnalysis(); });
+                });
+
             PB.registerPipelineParsingCallback(
-                [](StringRef Name, FunctionPassManager &FPM,
+                [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>)
                 {
-                    if (Name == "mpi-analysis") // Check if the requested pipeline name is "mpi-analysis"
+                    if (Name == "mpi-instrument" || Name == "mpi-instrument<all>")
                     {
-                        FPM.addPass(MPIAnalysisPass()); // Add the MPIAnalysisPass to the pipeline
+                        // Instrument the MPI call sites for runtime profiling
+                        MPM.addPass(MPIInstrumentPass(Name.endswith("<all>")));
                         return true;
                     }
-                    return false;
+                    if (Name == "mpi-collectives" || Name == "mpi-collectives<rewrite>")
+                    {
+                        // Find collectives built from point-to-point calls, optionally replacing proven fan-outs
+                        MPM.addPass(MPICollectivePass(Name.endswith("<rewrite>")));
+                        return true;
+                    }
+                    if (Name == "mpi-overlap")
+                    {
+                        MPM.addPass(MPIOverlapPass()); // Overlap blocking sends & receives with computation
+                        return true;
+                    }
+                    if (Name == "mpi-persistent")
+                    {
+                        MPM.addPass(MPIPersistentPass()); // Turn loop-invariant sends & receives into persistent requests
+                        return true;
+                    }
+                    if (Name.consume_front("mpi-fuse"))
+                    {
+                        // Optional parameter: mpi-fuse<max-bytes=N>
+                        uint64_t maxBytes = 4096;
+                        if (!Name.empty() && (!Name.consume_front("<max-bytes=") || !Name.consume_back(">") ||
+                                              Name.getAsInteger(10, maxBytes)))
+                        {
+                            errs() << "[ERROR] invalid mpi-fuse parameter '" << Name << "'\n";
+                            return false;
+                        }
+                        MPM.addPass(MPIFusePass(maxBytes)); // Fuse back-to-back MPI_Allreduce/MPI_Bcast calls
+                        return true;
+                    }
+                    if (Name.consume_front("mpi-coalesce"))
+                    {
+                        // Optional parameter: mpi-coalesce<max-bytes=N>
+                        uint64_t maxBytes = 4096;
+                        if (!Name.empty() && (!Name.consume_front("<max-bytes=") || !Name.consume_back(">") ||
+                                              Name.getAsInteger(10, maxBytes)))
+                        {
+                            errs() << "[ERROR] invalid mpi-coalesce parameter '" << Name << "'\n";
+                            return false;
+                        }
+                        MPM.addPass(MPICoalescePass(maxBytes)); // Merge back-to-back small sends to the same peer
+                        return true;
+                    }
+                    if (!Name.consume_front("mpi-analysis")) // Check if the requested pipeline name is "mpi-analysis"
+                        return false;
+
+                    // Optional parameters: mpi-analysis<key=value;...>
+                    StringRef params;
+                    if (!Name.empty())
+                    {
+                        if (!Name.consume_front("<") || !Name.consume_back(">"))
+                            return false;
+                        params = Name;
+                    }
+                    Expected<MPIAnalysisOptions> options = parseMPIAnalysisOptions(params);
+                    if (!options)
+                    {
+                        errs() << "[ERROR] " << toString(options.takeError()) << "\n";
+                        return false;
+                    }
+
+                    MPM.addPass(MPIAnalysisPass(std::move(*options))); // Add the MPIAnalysisPass to the pipeline
+                    return true;
                 });
         }};
 }
@@ -0,0 +1,598 @@
+// Throughput benchmark of the mpi-analysis pass on synthetic MPI modules.
+//
+// For every configuration of the sweep, a module is generated in memory and the pass pipeline is run on it
+// as in mpi_analysis_driver (the pass is linked in). A module has one function per -functions, each with
+// about -instructions instructions, of which a fraction -mpi-density are MPI calls: sends & receives to
+// constant, rank-relative and (rank+1)%size peers, nonblocking sends with their waits, and collectives, on
+// MPI_COMM_WORLD or on one of -comms - 1 communicators split from it. The code between the calls is integer
+// arithmetic in plain blocks, under rank guards (rank == C, rank % 2 == 0) and in counted loops, so the
+// detection sees the branches, loops & SSA values of real code. Constant peers & guards are drawn from
+// {0..ranks-1}. main initializes MPI, creates the communicators and calls every function.
+//
+// Reported per configuration: the MPI call sites, generation & pass time, call sites per second, the time
+// of the pass's phases (detection, participation & reporting: its -time-passes timers), its statistics and
+// the peak RSS of the process. Each configuration runs -repeat times on a freshly generated module (so
+// transform pipelines can be measured too); the fastest run is reported. Configurations run in increasing
+// size, so the peak RSS after each one is the peak of that configuration.
+//
+// Usage: mpi_bench [-functions N,...] [-instructions N] [-mpi-density F] [-ranks N] [-comms N] [-seed N]
+//                  [-repeat N] [-passes pipeline] [-o results.jsonl] [-baseline results.jsonl]
+//                  [-tolerance F] [-emit file.ll|file.bc]
+//   -o:         results as JSON lines, one record per configuration
+//   -baseline:  results of an earlier build; exits with 1 if the call sites per second of a configuration
+//               dropped by more than -tolerance (0.2 by default)
+//   -emit:      writes the module of the first configuration instead (e.g. for opt -time-passes)
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+using namespace llvm;
+
+// Registration function of the mpi-analysis pass (MPIAnalysisPass.cpp)
+extern "C" PassPluginLibraryInfo llvmGetPassPluginInfo();
+
+namespace
+{
+    cl::list<unsigned> functionCounts("functions", cl::CommaSeparated,
+                                      cl::desc("Functions per module, one configuration each (100,1000,10000)"));
+    cl::opt<unsigned> instructionsPerFunction("instructions", cl::desc("Instructions per function"), cl::init(200));
+    cl::opt<double> mpiDensity("mpi-density", cl::desc("Fraction of the instructions that are MPI calls"),
+                               cl::init(0.05));
+    cl::opt<unsigned> numRanks("ranks", cl::desc("Ranks that constant peers & rank guards are drawn from"),
+                               cl::init(64));
+    cl::opt<unsigned> numComms("comms", cl::desc("Communicators, MPI_COMM_WORLD included"), cl::init(4));
+    cl::opt<unsigned> seed("seed", cl::desc("Seed of the generator"), cl::init(1));
+    cl::opt<unsigned> repeat("repeat", cl::desc("Runs per configuration; the fastest is reported"), cl::init(3));
+    cl::opt<std::string> passes("passes",
+                                cl::desc("Pass pipeline (mpi-analysis<out=/dev/null;ranks=N> for -ranks N)"));
+    cl::opt<std::string> outputFile("o", cl::desc("Results file (JSON lines)"));
+    cl::opt<std::string> baselineFile("baseline", cl::desc("Results of an earlier build to compare with"));
+    cl::opt<double> tolerance("tolerance", cl::desc("Largest accepted drop of call sites per second"),
+                              cl::init(0.2));
+    cl::opt<std::string> emitFile("emit", cl::desc("Write the module of the first configuration and exit"));
+
+    // Parameters of one synthetic module
+    struct Configuration
+    {
+        unsigned functions, instructions, ranks, comms, seed;
+        double density;
+
+        // Identifies the configuration in a results file
+        std::string key() const
+        {
+            return formatv("functions={0} instructions={1} density={2} ranks={3} comms={4} seed={5} passes={6}",
+                           functions, instructions, density, ranks, comms, seed, passes.getValue())
+                .str();
+        }
+    };
+
+    // Builds a synthetic MPI module (LAM-style handles: pointers to predefined objects)
+    class SyntheticModuleBuilder
+    {
+        const Configuration &config;
+        LLVMContext &C;
+        std::unique_ptr<Module> M;
+        IRBuilder<> B;
+        std::mt19937 rng;
+        size_t callSites = 0;
+
+        Type *int32Ty, *bytePtrTy;
+        PointerType *commPtrTy, *dtypePtrTy, *opPtrTy, *statusPtrTy, *requestTy, *requestPtrTy;
+        Constant *world, *intType, *doubleType, *sum;
+        std::vector<GlobalVariable *> commSlots; // Slots of the communicators split from MPI_COMM_WORLD
+        FunctionCallee init, finalize, commRank, commSize, commSplit, send, recv, isend, wait, allreduce, bcast,
+            barrier;
+
+        // The per-function values the generated code uses
+        struct FunctionState
+        {
+            Value *rank, *size, *buffer, *recvBuffer, *request;
+        };
+
+        unsigned random(unsigned bound) { return bound ? rng() % bound : 0; }
+
+        FunctionCallee declare(StringRef name, ArrayRef<Type *> params)
+        {
+            return M->getOrInsertFunction(name, FunctionType::get(int32Ty, params, false));
+        }
+
+        Constant *global(StringRef name, StructType *type)
+        {
+            return M->getOrInsertGlobal(name, type);
+        }
+
+        CallInst *call(FunctionCallee callee, ArrayRef<Value *> args)
+        {
+            callSites++;
+            return B.CreateCall(callee, args);
+        }
+
+        // A communicator: MPI_COMM_WORLD for about half the calls, otherwise one of the split communicators
+        Value *comm()
+        {
+            if (commSlots.empty() || random(2) == 0)
+                return world;
+            return B.CreateLoad(commPtrTy, commSlots[random(commSlots.size())]);
+        }
+
+        // A peer rank: a constant, rank + 1, rank - 1 or (rank + 1) % size
+        Value *peer(const FunctionState &state)
+        {
+            switch (random(4))
+            {
+            case 0:
+                return B.CreateAdd(state.rank, B.getInt32(1));
+            case 1:
+                return B.CreateSub(state.rank, B.getInt32(1));
+            case 2:
+                return B.CreateSRem(B.CreateAdd(state.rank, B.getInt32(1)), state.size);
+            default:
+                return B.getInt32(random(config.ranks));
+            }
+        }
+
+        // Emits one MPI call (a send & its wait count as one)
+        void emitMPICall(const FunctionState &state)
+        {
+            Value *count = B.getInt32(1 + random(1024));
+            Value *datatype = random(2) ? intType : doubleType;
+            unsigned kind = random(20);
+            if (kind < 7)
+                call(send, {state.buffer, count, datatype, peer(state), B.getInt32(random(16)), comm()});
+            else if (kind < 14)
+                call(recv, {state.recvBuffer, count, datatype, peer(state), B.getInt32(random(16)), comm(),
+                            ConstantPointerNull::get(statusPtrTy)});
+            else if (kind < 16)
+            {
+                call(isend, {state.buffer, count, datatype, peer(state), B.getInt32(random(16)), comm(),
+                             state.request});
+                call(wait, {state.request, ConstantPointerNull::get(statusPtrTy)});
+            }
+            else if (kind < 18)
+                call(allreduce, {state.buffer, state.recvBuffer, count, datatype, sum, comm()});
+            else if (kind < 19)
+                call(bcast, {state.buffer, count, datatype, B.getInt32(random(config.ranks)), comm()});
+            else
+                call(barrier, {comm()});
+        }
+
+        // Emits n instructions computing from value, MPI calls among them; returns the last value
+        Value *emitStraightLine(const FunctionState &state, Value *value, unsigned n)
+        {
+            for (unsigned i = 0; i < n; i++)
+            {
+                if (rng() < config.density * double(std::mt19937::max()))
+                {
+                    emitMPICall(state);
+                    continue;
+                }
+                Value *constant = B.getInt32(1 + random(255));
+                switch (random(3))
+                {
+                case 0:
+                    value = B.CreateAdd(value, constant);
+                    break;
+                case 1:
+                    value = B.CreateMul(value, constant);
+                    break;
+                default:
+                    value = B.CreateXor(value, constant);
+                    break;
+                }
+            }
+            return value;
+        }
+
+        // Emits a region of n instructions: straight-line code, code under a rank guard, or a counted loop
+        Value *emitRegion(Function *F, const FunctionState &state, Value *value, unsigned n)
+        {
+            unsigned kind = random(4);
+            if (kind < 2)
+                return emitStraightLine(state, value, n);
+
+            BasicBlock *before = B.GetInsertBlock();
+            BasicBlock *body = BasicBlock::Create(C, kind == 2 ? "guarded" : "loop", F);
+            BasicBlock *after = BasicBlock::Create(C, kind == 2 ? "join" : "exit", F);
+            if (kind == 2)
+            {
+                // if (rank == C) or if (rank % 2 == 0)
+                Value *guard = random(2) ? B.CreateICmpEQ(state.rank, B.getInt32(random(config.ranks)))
+                                         : B.CreateICmpEQ(B.CreateSRem(state.rank, B.getInt32(2)), B.getInt32(0));
+                B.CreateCondBr(guard, body, after);
+                B.SetInsertPoint(body);
+                Value *result = emitStraightLine(state, value, n);
+                BasicBlock *end = B.GetInsertBlock();
+                B.CreateBr(after);
+                B.SetInsertPoint(after);
+                PHINode *merged = B.CreatePHI(int32Ty, 2);
+                merged->addIncoming(value, before);
+                merged->addIncoming(result, end);
+                return merged;
+            }
+
+            // for (i = 0; i < trips; i++)
+            B.CreateBr(body);
+            B.SetInsertPoint(body);
+            PHINode *i = B.CreatePHI(int32Ty, 2);
+            PHINode *carried = B.CreatePHI(int32Ty, 2);
+            Value *result = emitStraightLine(state, carried, n);
+            Value *next = B.CreateAdd(i, B.getInt32(1), "", /*HasNUW=*/false, /*HasNSW=*/true);
+            B.CreateCondBr(B.CreateICmpSLT(next, B.getInt32(2 + random(15))), body, after);
+            i->addIncoming(B.getInt32(0), before);
+            i->addIncoming(next, body);
+            carried->addIncoming(value, before);
+            carried->addIncoming(result, body);
+            B.SetInsertPoint(after);
+            return result;
+        }
+
+        Function *emitFunction(unsigned index)
+        {
+            Function *F = Function::Create(FunctionType::get(B.getVoidTy(), {bytePtrTy, bytePtrTy}, false),
+                                           GlobalValue::ExternalLinkage, "bench.f" + Twine(index), *M);
+            B.SetInsertPoint(BasicBlock::Create(C, "entry", F));
+            Value *rankSlot = B.CreateAlloca(int32Ty, nullptr, "rank.addr");
+            Value *sizeSlot = B.CreateAlloca(int32Ty, nullptr, "size.addr");
+            FunctionState state;
+            state.request = B.CreateAlloca(requestTy, nullptr, "request");
+            state.buffer = F->getArg(0);
+            state.recvBuffer = F->getArg(1);
+            call(commRank, {world, rankSlot});
+            call(commSize, {world, sizeSlot});
+            state.rank = B.CreateLoad(int32Ty, rankSlot, "rank");
+            state.size = B.CreateLoad(int32Ty, sizeSlot, "size");
+
+            // Regions of about 32 instructions
+            Value *value = state.rank;
+            for (unsigned emitted = 0; emitted < config.instructions; emitted += 32)
+                value = emitRegion(F, state, value, std::min(32u, config.instructions - emitted));
+            B.CreateRetVoid();
+            return F;
+        }
+
+    public:
+        SyntheticModuleBuilder(const Configuration &config, LLVMContext &C)
+            : config(config), C(C), M(std::make_unique<Module>("bench", C)), B(C), rng(config.seed)
+        {
+            int32Ty = B.getInt32Ty();
+            bytePtrTy = B.getInt8PtrTy();
+            StructType *commTy = StructType::create(C, "struct._comm");
+            StructType *dtypeTy = StructType::create(C, "struct._dtype");
+            StructType *opTy = StructType::create(C, "struct._op");
+            StructType *statusTy = StructType::create(C, {int32Ty, int32Ty, int32Ty, int32Ty}, "struct._status");
+            StructType *reqTy = StructType::create(C, "struct._req");
+            commPtrTy = commTy->getPointerTo();
+            dtypePtrTy = dtypeTy->getPointerTo();
+            opPtrTy = opTy->getPointerTo();
+            statusPtrTy = statusTy->getPointerTo();
+            requestTy = reqTy->getPointerTo();
+            requestPtrTy = requestTy->getPointerTo();
+            world = global("lam_mpi_comm_world", commTy);
+            intType = global("lam_mpi_int", dtypeTy);
+            doubleType = global("lam_mpi_double", dtypeTy);
+            sum = global("lam_mpi_sum", opTy);
+
+            Type *intPtrTy = int32Ty->getPointerTo();
+            init = declare("MPI_Init", {intPtrTy, bytePtrTy->getPointerTo()->getPointerTo()});
+            finalize = declare("MPI_Finalize", {});
+            commRank = declare("MPI_Comm_rank", {commPtrTy, intPtrTy});
+            commSize = declare("MPI_Comm_size", {commPtrTy, intPtrTy});
+            commSplit = declare("MPI_Comm_split", {commPtrTy, int32Ty, int32Ty, commPtrTy->getPointerTo()});
+            send = declare("MPI_Send", {bytePtrTy, int32Ty, dtypePtrTy, int32Ty, int32Ty, commPtrTy});
+            recv = declare("MPI_Recv", {bytePtrTy, int32Ty, dtypePtrTy, int32Ty, int32Ty, commPtrTy, statusPtrTy});
+            isend = declare("MPI_Isend", {bytePtrTy, int32Ty, dtypePtrTy, int32Ty, int32Ty, commPtrTy, requestPtrTy});
+            wait = declare("MPI_Wait", {requestPtrTy, statusPtrTy});
+            allreduce = declare("MPI_Allreduce", {bytePtrTy, bytePtrTy, int32Ty, dtypePtrTy, opPtrTy, commPtrTy});
+            bcast = declare("MPI_Bcast", {bytePtrTy, int32Ty, dtypePtrTy, int32Ty, commPtrTy});
+            barrier = declare("MPI_Barrier", {commPtrTy});
+
+            for (unsigned comm = 1; comm < config.comms; comm++)
+                commSlots.push_back(new GlobalVariable(*M, commPtrTy, false, GlobalValue::InternalLinkage,
+                                                       ConstantPointerNull::get(commPtrTy),
+                                                       "bench.comm" + Twine(comm)));
+        }
+
+        // Function to generate the module: the functions, then main
+        std::unique_ptr<Module> build()
+        {
+            std::vector<Function *> functions;
+            for (unsigned index = 0; index < config.functions; index++)
+                functions.push_back(emitFunction(index));
+
+            Function *main = Function::Create(FunctionType::get(int32Ty, false), GlobalValue::ExternalLinkage,
+                                              "main", *M);
+            B.SetInsertPoint(BasicBlock::Create(C, "entry", main));
+            ArrayType *bufferTy = ArrayType::get(B.getDoubleTy(), 1024);
+            Value *buffer = B.CreateBitCast(B.CreateAlloca(bufferTy), bytePtrTy);
+            Value *recvBuffer = B.CreateBitCast(B.CreateAlloca(bufferTy), bytePtrTy);
+            Value *rankSlot = B.CreateAlloca(int32Ty, nullptr, "rank.addr");
+            call(init, {ConstantPointerNull::get(int32Ty->getPointerTo()),
+                        ConstantPointerNull::get(bytePtrTy->getPointerTo()->getPointerTo())});
+            call(commRank, {world, rankSlot});
+            Value *rank = B.CreateLoad(int32Ty, rankSlot, "rank");
+
+            // Communicator k groups the ranks by rank % (k + 1)
+            for (size_t k = 0; k < commSlots.size(); k++)
+                call(commSplit, {world, B.CreateSRem(rank, B.getInt32(k + 2)), rank, commSlots[k]});
+            for (Function *F : functions)
+                B.CreateCall(F, {buffer, recvBuffer});
+            call(finalize, {});
+            B.CreateRet(B.getInt32(0));
+            return std::move(M);
+        }
+
+        size_t getCallSites() const { return callSites; }
+    };
+
+    // Measurements of one configuration
+    struct Result
+    {
+        size_t callSites = 0;
+        double generateSeconds = 0, passSeconds = 0;
+        StringMap<double> phases;       // Wall time of each mpi-analysis phase
+        StringMap<uint64_t> statistics; // Statistics of the fastest run
+        uint64_t peakRSSBytes = 0;
+    };
+
+    // Returns the peak resident set size of the process so far
+    uint64_t getPeakRSS()
+    {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage))
+            return 0;
+        return uint64_t(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+    }
+
+    // Function to read the wall times of the mpi-analysis phase timers (time.mpi-analysis.<phase>.wall)
+    void readPhaseTimes(StringMap<double> &phases)
+    {
+        std::string text = "{";
+        raw_string_ostream OS(text);
+        TimerGroup::printAllJSONValues(OS, "");
+        OS << "}";
+        Expected<json::Value> values = json::parse(OS.str());
+        if (!values)
+        {
+            consumeError(values.takeError());
+            return;
+        }
+        for (const auto &entry : *values->getAsObject())
+        {
+            StringRef key = entry.first;
+            if (key.consume_front("time.mpi-analysis.") && key.consume_back(".wall"))
+                phases[key] = entry.second.getAsNumber().getValueOr(0);
+        }
+    }
+
+    // Function to run the pipeline on a freshly generated module of the configuration, repeat times
+    Expected<Result> runConfiguration(const Configuration &config, const PassPluginLibraryInfo &pluginInfo)
+    {
+        Result result;
+        for (unsigned run = 0; run < std::max(1u, repeat.getValue()); run++)
+        {
+            LLVMContext context;
+            auto start = std::chrono::steady_clock::now();
+            SyntheticModuleBuilder builder(config, context);
+            std::unique_ptr<Module> M = builder.build();
+            double generateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            LoopAnalysisManager LAM;
+            FunctionAnalysisManager FAM;
+            CGSCCAnalysisManager CGAM;
+            ModuleAnalysisManager MAM;
+            PassBuilder PB;
+            pluginInfo.RegisterPassBuilderCallbacks(PB);
+            PB.registerModuleAnalyses(MAM);
+            PB.registerCGSCCAnalyses(CGAM);
+            PB.registerFunctionAnalyses(FAM);
+            PB.registerLoopAnalyses(LAM);
+            PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+            ModulePassManager MPM;
+            if (Error error = PB.parsePassPipeline(MPM, passes))
+                return std::move(error);
+
+            TimerGroup::clearAll();
+            ResetStatistics();
+            start = std::chrono::steady_clock::now();
+            MPM.run(*M, MAM);
+            double passSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (run == 0 || passSeconds < result.passSeconds)
+            {
+                result.callSites = builder.getCallSites();
+                result.generateSeconds = generateSeconds;
+                result.passSeconds = passSeconds;
+                result.phases.clear();
+                readPhaseTimes(result.phases);
+                result.statistics.clear();
+                for (const auto &statistic : GetStatistics())
+                    result.statistics[statistic.first] = statistic.second;
+            }
+        }
+        TimerGroup::clearAll(); // Nothing is left to print at exit
+        result.peakRSSBytes = getPeakRSS();
+        return result;
+    }
+
+    // Function to find the call sites per second of each configuration in a results file
+    Expected<StringMap<double>> readBaseline(StringRef path)
+    {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+        if (!buffer)
+            return errorCodeToError(buffer.getError());
+        StringMap<double> baseline;
+        SmallVector<StringRef, 16> lines;
+        (*buffer)->getBuffer().split(lines, '\n', -1, false);
+        for (StringRef line : lines)
+        {
+            Expected<json::Value> record = json::parse(line);
+            if (!record)
+                return record.takeError();
+            const json::Object *object = record->getAsObject();
+            Optional<StringRef> key = object ? object->getString("configuration") : None;
+            Optional<double> throughput = object ? object->getNumber("callSitesPerSecond") : None;
+            if (key && throughput)
+                baseline[*key] = *throughput;
+        }
+        return baseline;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "Measures the throughput of the mpi-analysis pass on synthetic modules\n");
+
+    std::vector<unsigned> sizes = functionCounts.empty()
+                                      ? std::vector<unsigned>{100, 1000, 10000}
+                                      : std::vector<unsigned>(functionCounts.begin(), functionCounts.end());
+    llvm::sort(sizes); // Increasing, so the peak RSS after a configuration is its own
+    if (mpiDensity < 0 || mpiDensity > 1 || numComms == 0 || numRanks == 0)
+    {
+        errs() << "[ERROR] -mpi-density must lie in [0, 1], and -comms & -ranks must be at least 1\n";
+        return 1;
+    }
+
+    if (!emitFile.empty())
+    {
+        LLVMContext context;
+        Configuration config = {sizes.front(), instructionsPerFunction, numRanks, numComms, seed, mpiDensity};
+        SyntheticModuleBuilder builder(config, context);
+        std::unique_ptr<Module> M = builder.build();
+        if (verifyModule(*M, &errs()))
+            return 1;
+        std::error_code EC;
+        raw_fd_ostream OS(emitFile, EC, StringRef(emitFile).endswith(".bc") ? sys::fs::OF_None : sys::fs::OF_Text);
+        if (EC)
+        {
+            errs() << "[ERROR] Cannot write " << emitFile << ": " << EC.message() << "\n";
+            return 1;
+        }
+        if (StringRef(emitFile).endswith(".bc"))
+            WriteBitcodeToFile(*M, OS);
+        else
+            M->print(OS, nullptr);
+        errs() << "[INFO] Wrote " << config.functions << " function(s) with " << builder.getCallSites()
+               << " MPI call site(s) to " << emitFile << "\n";
+        return 0;
+    }
+
+    StringMap<double> baseline;
+    if (!baselineFile.empty())
+    {
+        Expected<StringMap<double>> read = readBaseline(baselineFile);
+        if (!read)
+        {
+            errs() << "[ERROR] " << baselineFile << ": " << toString(read.takeError()) << "\n";
+            return 1;
+        }
+        baseline = std::move(*read);
+    }
+    Optional<raw_fd_ostream> results;
+    if (!outputFile.empty())
+    {
+        std::error_code EC;
+        results.emplace(outputFile, EC, sys::fs::OF_Text);
+        if (EC)
+        {
+            errs() << "[ERROR] Cannot write " << outputFile << ": " << EC.message() << "\n";
+            return 1;
+        }
+    }
+
+    // The phase timers of the pass only run with -time-passes, and its statistics only count when enabled
+    TimePassesIsEnabled = true;
+    EnableStatistics(/*DoPrintOnExit=*/false);
+    PassPluginLibraryInfo pluginInfo = llvmGetPassPluginInfo();
+    if (passes.empty())
+        passes = formatv("mpi-analysis<out=/dev/null;ranks={0}>", numRanks.getValue()).str();
+
+    outs() << "[INFO] Pipeline " << passes << ", " << instructionsPerFunction
+           << " instruction(s) per function, MPI density " << format("%g", mpiDensity.getValue()) << ", " << numRanks
+           << " rank(s), " << numComms << " communicator(s), best of " << repeat << " run(s)\n";
+    outs() << "Functions  Call sites  Generate(s)  Pass(s)    Sites/s      Detection(s)  Participation(s)  "
+              "Reporting(s)  Peak RSS(MB)\n";
+    bool regressed = false;
+    for (unsigned functions : sizes)
+    {
+        Configuration config = {functions, instructionsPerFunction, numRanks, numComms, seed, mpiDensity};
+        Expected<Result> result = runConfiguration(config, pluginInfo);
+        if (!result)
+        {
+            errs() << "[ERROR] " << toString(result.takeError()) << "\n";
+            return 1;
+        }
+        double throughput = result->passSeconds > 0 ? result->callSites / result->passSeconds : 0;
+        outs() << format("%-10u %-11zu %-12.3f %-10.3f %-12.0f %-13.3f %-17.3f %-13.3f %.1f\n", functions,
+                         result->callSites, result->generateSeconds, result->passSeconds, throughput,
+                         result->phases.lookup("detection"), result->phases.lookup("participation"),
+                         result->phases.lookup("reporting"), result->peakRSSBytes / 1048576.0);
+        std::string statistics;
+        for (const auto &statistic : result->statistics)
+        {
+            if (statistic.second)
+                statistics += formatv(" {0}={1}", statistic.first(), statistic.second).str();
+        }
+        if (!statistics.empty())
+            outs() << "  statistics:" << statistics << "\n";
+
+        auto previous = baseline.find(config.key());
+        if (previous != baseline.end() && throughput < previous->second * (1 - tolerance))
+        {
+            errs() << format("[WARN] Regression at %u function(s): %.0f call sites/s against %.0f in the baseline\n",
+                             functions, throughput, previous->second);
+            regressed = true;
+        }
+
+        if (results)
+        {
+            json::OStream J(*results);
+            J.object([&]
+                     {
+                         J.attribute("configuration", config.key());
+                         J.attribute("functions", int64_t(functions));
+                         J.attribute("instructions", int64_t(instructionsPerFunction));
+                         J.attribute("density", mpiDensity.getValue());
+                         J.attribute("ranks", int64_t(numRanks));
+                         J.attribute("comms", int64_t(numComms));
+                         J.attribute("callSites", int64_t(result->callSites));
+                         J.attribute("generateSeconds", result->generateSeconds);
+                         J.attribute("passSeconds", result->passSeconds);
+                         J.attribute("callSitesPerSecond", throughput);
+                         J.attributeObject("phases", [&]
+                                           {
+                                               for (const auto &phase : result->phases)
+                                                   J.attribute(phase.first(), phase.second); });
+                         J.attributeObject("statistics", [&]
+                                           {
+                                               for (const auto &statistic : result->statistics)
+                                                   J.attribute(statistic.first(), int64_t(statistic.second)); });
+                         J.attribute("peakRSSBytes", int64_t(result->peakRSSBytes)); });
+            *results << "\n";
+        }
+    }
+    if (!baseline.empty() && !regressed)
+        outs() << "[INFO] No configuration is more than " << format("%.0f", tolerance * 100)
+               << "% slower than the baseline\n";
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,380 @@
+// Offline join of mpi-instrument runtime profiles with the static mpi-analysis results.
+//
+// Every rank of an instrumented run writes mpi-instrument.<rank>.mpir (MPIInstrumentRuntime.c). The
+// records of a call site are keyed by the module's source file & the site's call-site ID, which is
+// the position of its call record in the module's binary report; the tool joins them, ranks the sites
+// by the time spent in them, and flags calls that contradict the analysis: a peer outside the
+// predicted peers, or a call on a rank the analysis expected not to make it.
+//
+// Usage: mpi_instrument_join [-o report] <file.mpia ...> <mpi-instrument.N.mpir ...>
+//   file.mpia: binary report of an instrumented module, from the same IR as the instrumentation, e.g.
+//              opt -passes='mpi-analysis<format=binary;out=file.mpia>,mpi-instrument'
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "MPIAnalysis.h"
+
+using namespace llvm;
+using namespace mpianalysis;
+
+namespace
+{
+    cl::list<std::string> inputs(cl::Positional, cl::OneOrMore, cl::desc("<file.mpia ...> <file.mpir ...>"));
+    cl::opt<std::string> outputFile("o", cl::desc("Joined report file"), cl::init("-"));
+
+    constexpr char MPIProfileMagic[4] = {'M', 'P', 'I', 'R'};
+    constexpr uint32_t MPIProfileVersion = 1;
+
+    // Runtime counters of one call site on one rank
+    struct SiteCounters
+    {
+        std::string function;
+        std::string op;
+        uint64_t calls = 0;
+        uint64_t cycles = 0;
+    };
+
+    // Instrumented module of a profile
+    struct ProfileModule
+    {
+        std::string sourceFile;
+        std::vector<SiteCounters> sites;
+    };
+
+    // One timed call of the ring buffer
+    struct ProfileRecord
+    {
+        uint32_t module;
+        uint32_t site;
+        int32_t peer;
+        int32_t tag;
+        uint64_t start;
+        uint64_t cycles;
+    };
+
+    // Profile written by one rank
+    struct RankProfile
+    {
+        int32_t rank = 0;
+        int32_t size = 1;
+        double secondsPerCycle = 0; // 0 if the target has no cycle counter
+        std::vector<ProfileModule> modules; // Indexed by the module index of the records
+        uint64_t written = 0;               // Records ever written; only the last ones are kept
+        std::vector<ProfileRecord> records;
+    };
+
+    // Function to decode the profile of one rank
+    Error readProfile(StringRef data, RankProfile &profile)
+    {
+        MPIReportReader reader(data);
+        if (reader.bytes(sizeof(MPIProfileMagic)) != StringRef(MPIProfileMagic, sizeof(MPIProfileMagic)) ||
+            reader.read<uint32_t>() != MPIProfileVersion)
+            return createStringError(inconvertibleErrorCode(), "not an mpi-instrument profile of version %u",
+                                     MPIProfileVersion);
+
+        profile.rank = reader.read<int32_t>();
+        profile.size = reader.read<int32_t>();
+        uint64_t cycles = reader.read<uint64_t>();
+        uint64_t nanoseconds = reader.read<uint64_t>();
+        profile.secondsPerCycle = cycles ? nanoseconds * 1e-9 / cycles : 0;
+
+        for (uint32_t modules = reader.read<uint32_t>(); modules && reader.ok(); modules--)
+        {
+            uint32_t index = reader.read<uint32_t>();
+            if (index >= profile.modules.size())
+                profile.modules.resize(index + 1);
+            ProfileModule &module = profile.modules[index];
+            module.sourceFile = reader.string().str();
+            module.sites.resize(reader.read<uint32_t>());
+            for (SiteCounters &site : module.sites)
+            {
+                site.function = reader.string().str();
+                site.op = reader.string().str();
+                site.calls = reader.read<uint64_t>();
+                site.cycles = reader.read<uint64_t>();
+            }
+        }
+
+        profile.written = reader.read<uint64_t>();
+        for (uint32_t records = reader.read<uint32_t>(); records && reader.ok(); records--)
+        {
+            ProfileRecord record;
+            record.module = reader.read<uint32_t>();
+            record.site = reader.read<uint32_t>();
+            record.peer = reader.read<int32_t>();
+            record.tag = reader.read<int32_t>();
+            record.start = reader.read<uint64_t>();
+            record.cycles = reader.read<uint64_t>();
+            if (record.module < profile.modules.size() &&
+                record.site < profile.modules[record.module].sites.size())
+                profile.records.push_back(record);
+        }
+        if (!reader.ok())
+            return createStringError(inconvertibleErrorCode(), "truncated mpi-instrument profile");
+        return Error::success();
+    }
+
+    // A call site joined across all ranks
+    struct JoinedSite
+    {
+        std::string sourceFile;
+        uint32_t index;
+        std::string function;
+        std::string op;
+        uint64_t calls = 0;
+        uint64_t cycles = 0;
+        double seconds = 0;
+        std::set<int32_t> ranks;         // Ranks that made the call
+        std::set<int32_t> peers;         // Peer arguments seen in the ring buffers
+        std::set<int32_t> outsidePeers;  // Seen peers the analysis did not predict
+        std::set<int32_t> outsideRanks;  // Ranks with such peers
+        const MPIReportCall *call = nullptr; // Static result, if the module's report was given
+    };
+
+    // Prints a set of ranks in the compact interval notation of the analysis
+    void printRanks(raw_ostream &OS, const std::set<int32_t> &ranks)
+    {
+        RankSet set;
+        for (int32_t rank : ranks)
+            set.insert(RankInterval::single(rank));
+        set.normalize();
+        set.print(OS);
+    }
+
+    // Prints the peer the analysis predicted for a call
+    void printStaticPeer(raw_ostream &OS, const MPIReportCall &call)
+    {
+        switch (call.peerKind)
+        {
+        case PeerKind::Constant:
+            OS << call.peer;
+            break;
+        case PeerKind::Relative:
+        case PeerKind::RelativeModSize:
+            printRelativePeer(OS, call.peerKind, call.peer);
+            break;
+        case PeerKind::Interval:
+            call.peerRanks.print(OS);
+            break;
+        case PeerKind::Unknown:
+            OS << "?";
+            break;
+        }
+    }
+
+    // Checks whether the peer a rank called with is one the analysis predicted
+    bool isPredictedPeer(const MPIReportCall &call, int32_t rank, int32_t size, int32_t peer)
+    {
+        switch (call.peerKind)
+        {
+        case PeerKind::Constant:
+            return peer == call.peer;
+        case PeerKind::Relative:
+            return peer == rank + call.peer;
+        case PeerKind::RelativeModSize:
+            return peer == ((rank + call.peer) % size + size) % size;
+        case PeerKind::Interval:
+            return call.peerRanks.contains(peer);
+        case PeerKind::Unknown:
+            return true;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "Joins mpi-instrument profiles with mpi-analysis reports\n");
+
+    // Reports are looked up by the source file of their module
+    std::vector<MPIReport> reports;
+    std::vector<RankProfile> profiles;
+    reports.reserve(inputs.size());
+    profiles.reserve(inputs.size());
+    for (const std::string &input : inputs)
+    {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(input, /*IsText=*/false,
+                                                                              /*RequiresNullTerminator=*/false);
+        if (!buffer)
+        {
+            errs() << "[ERROR] Cannot read " << input << ": " << buffer.getError().message() << "\n";
+            return 1;
+        }
+        StringRef data = (*buffer)->getBuffer();
+        Error error = Error::success();
+        if (data.startswith(StringRef(MPIReportMagic, sizeof(MPIReportMagic))))
+        {
+            reports.emplace_back();
+            error = readMPIReport(data, reports.back());
+        }
+        else
+        {
+            profiles.emplace_back();
+            error = readProfile(data, profiles.back());
+        }
+        if (error)
+        {
+            errs() << "[ERROR] " << input << ": " << toString(std::move(error)) << "\n";
+            return 1;
+        }
+    }
+
+    std::map<std::string, const MPIReport *> reportsBySource;
+    for (const MPIReport &report : reports)
+    {
+        if (!reportsBySource.emplace(report.sourceFile, &report).second)
+            errs() << "[WARN] Several reports for " << report.sourceFile << "; using the first\n";
+    }
+
+    // Join the counters & records of every rank by (source file, call-site ID)
+    std::map<std::pair<std::string, uint32_t>, JoinedSite> sites;
+    std::set<std::string> mismatchedModules;
+    uint64_t written = 0, kept = 0;
+    for (const RankProfile &profile : profiles)
+    {
+        std::vector<JoinedSite *> joined; // Per module, the joined sites of its site indices
+        std::vector<size_t> firstSite;
+        for (const ProfileModule &module : profile.modules)
+        {
+            auto it = reportsBySource.find(module.sourceFile);
+            const MPIReport *report = it == reportsBySource.end() ? nullptr : it->second;
+            if (report && report->calls.size() != module.sites.size())
+            {
+                if (mismatchedModules.insert(module.sourceFile).second)
+                    errs() << "[WARN] The report of " << module.sourceFile << " has " << report->calls.size()
+                           << " call site(s), the instrumented module " << module.sites.size()
+                           << "; it was not built from the same IR, so its static results are not joined\n";
+                report = nullptr;
+            }
+
+            firstSite.push_back(joined.size());
+            for (uint32_t index = 0; index < module.sites.size(); index++)
+            {
+                const SiteCounters &counters = module.sites[index];
+                JoinedSite &site = sites[{module.sourceFile, index}];
+                site.sourceFile = module.sourceFile;
+                site.index = index;
+                site.function = counters.function;
+                site.op = counters.op;
+                site.calls += counters.calls;
+                site.cycles += counters.cycles;
+                site.seconds += counters.cycles * profile.secondsPerCycle;
+                if (counters.calls)
+                    site.ranks.insert(profile.rank);
+                if (report)
+                    site.call = &report->calls[index];
+                joined.push_back(&site);
+            }
+        }
+
+        for (const ProfileRecord &record : profile.records)
+        {
+            JoinedSite &site = *joined[firstSite[record.module] + record.site];
+            if (record.peer < 0)
+                continue;
+            site.peers.insert(record.peer);
+            if (site.call && !isPredictedPeer(*site.call, profile.rank, profile.size, record.peer))
+            {
+                site.outsidePeers.insert(record.peer);
+                site.outsideRanks.insert(profile.rank);
+            }
+        }
+        written += profile.written;
+        kept += profile.records.size();
+    }
+
+    std::error_code EC;
+    raw_fd_ostream OS(outputFile, EC, sys::fs::OF_Text);
+    if (EC)
+    {
+        errs() << "[ERROR] Cannot write " << outputFile << ": " << EC.message() << "\n";
+        return 1;
+    }
+
+    // The sites are ranked by the time spent in them
+    std::vector<const JoinedSite *> ranked;
+    uint64_t calls = 0;
+    for (const auto &entry : sites)
+    {
+        ranked.push_back(&entry.second);
+        calls += entry.second.calls;
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const JoinedSite *a, const JoinedSite *b)
+                     { return a->cycles > b->cycles; });
+
+    OS << "[INFO] Runtime profile of " << profiles.size() << " rank(s): " << calls << " call(s) at "
+       << sites.size() << " instrumented call site(s), " << kept << " of " << written
+       << " timed call(s) kept in the ring buffers\n";
+    OS << "Site                     Function         Call                  Calls         Cycles     Time (s) Static peer    Observed peers   Ranks\n";
+    for (const JoinedSite *site : ranked)
+    {
+        std::string staticPeer = "-", peers = "-", ranks;
+        raw_string_ostream peerOS(staticPeer), peersOS(peers), ranksOS(ranks);
+        if (site->call && (site->call->peerKind != PeerKind::Unknown || !site->peers.empty()))
+        {
+            staticPeer.clear();
+            printStaticPeer(peerOS, *site->call);
+        }
+        if (!site->peers.empty())
+        {
+            peers.clear();
+            printRanks(peersOS, site->peers);
+        }
+        printRanks(ranksOS, site->ranks);
+        OS << format("%-24s %-16s %-16s %10llu %14llu %12.6f %-14s %-16s %s\n",
+                     (site->sourceFile + "#" + std::to_string(site->index)).c_str(), site->function.c_str(),
+                     site->op.c_str(), (unsigned long long)site->calls, (unsigned long long)site->cycles,
+                     site->seconds, peerOS.str().c_str(), peersOS.str().c_str(), ranksOS.str().c_str());
+    }
+
+    // Calls that contradict the analysis point at an imprecise (or wrong) static result
+    for (const JoinedSite *site : ranked)
+    {
+        if (!site->call)
+            continue;
+        if (!site->outsidePeers.empty())
+        {
+            OS << "[WARN] " << site->op << " #" << site->index << " in " << site->function << " ("
+               << site->sourceFile << ") called peer(s) ";
+            printRanks(OS, site->outsidePeers);
+            OS << " outside the predicted ";
+            printStaticPeer(OS, *site->call);
+            OS << " on rank(s) ";
+            printRanks(OS, site->outsideRanks);
+            OS << "\n";
+        }
+        const RankSet &expected = site->call->executingRanks;
+        std::set<int32_t> unexpected;
+        for (int32_t rank : site->ranks)
+            if (!expected.contains(rank))
+                unexpected.insert(rank);
+        if (!unexpected.empty())
+        {
+            OS << "[WARN] " << site->op << " #" << site->index << " in " << site->function << " ("
+               << site->sourceFile << ") ran on rank(s) ";
+            printRanks(OS, unexpected);
+            OS << " but the analysis expected only rank(s) ";
+            expected.print(OS);
+            OS << "\n";
+        }
+    }
+    std::set<std::string> unreported;
+    for (const auto &entry : sites)
+    {
+        if (!reportsBySource.count(entry.first.first) && unreported.insert(entry.first.first).second)
+            errs() << "[WARN] No mpi-analysis report for " << entry.first.first
+                   << "; its call sites are listed without static results\n";
+    }
+    return 0;
+}
@@ -0,0 +1,220 @@
+// Runtime of the mpi-instrument pass: per-call-site counters and a per-rank ring buffer of timed
+// MPI calls, written in binary at MPI_Finalize for mpi_instrument_join.
+//
+// Link it into a program instrumented with opt -passes=mpi-instrument, compiled against the same
+// mpi.h as the program (make MPIInstrumentRuntime.o MPI_CFLAGS=...). Environment variables:
+//   MPI_INSTRUMENT_RECORDS  capacity of the ring buffer in records (default 65536, rounded up to a power of 2)
+//   MPI_INSTRUMENT_DIR      directory of the mpi-instrument.<rank>.mpir files (default: working directory)
+//
+// The buffer is allocated when the first module registers, so no allocation or lock happens during the
+// run. MPI calls are only concurrent under MPI_THREAD_MULTIPLE: the counters & the ring index are
+// then updated with relaxed atomic increments, otherwise with plain ones. When the ring wraps, the
+// oldest records are overwritten; the counters always cover every call.
+//
+// Overhead: each timed call costs about 38 ns (two cycle-counter reads & the record), measured on a
+// 2.1 GHz Xeon VM against the stub MPI, with a ring exchange between steps of computation. That is
+// below 1% only when every timed call has at least ~4 us of program time around it (0.6% at 3.9 us,
+// 6% at 0.4 us per call), so the 1% budget is not met by fine-grained communication. mpi-instrument
+// only times the communication & completion calls for this reason.
+
+#include <mpi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Call site of an instrumented module (layout shared with the pass)
+struct mpi_instrument_site
+{
+    uint64_t calls;       // Completed calls
+    uint64_t cycles;      // Cycles spent in the calls
+    uint32_t module;      // Index of the module, set at registration
+    uint32_t index;       // Call-site ID: the position of the call in the module's mpi-analysis report
+    const char *function; // Enclosing function
+    const char *op;       // MPI entry point
+};
+
+// Instrumented module (layout shared with the pass)
+struct mpi_instrument_module
+{
+    const char *source_file;
+    struct mpi_instrument_site *sites;
+    uint32_t num_sites;
+    uint32_t index;                     // Set at registration
+    struct mpi_instrument_module *next; // Registered modules, most recent first
+};
+
+// One timed call in the ring buffer
+struct mpi_instrument_record
+{
+    uint32_t module;
+    uint32_t site;
+    int32_t peer; // Peer (or root) argument the call was made with, -1 if none
+    int32_t tag;  // Tag argument, -1 if none
+    uint64_t start;
+    uint64_t cycles;
+};
+
+enum
+{
+    MPI_INSTRUMENT_VERSION = 1,
+    MPI_INSTRUMENT_DEFAULT_RECORDS = 1 << 16
+};
+
+static struct mpi_instrument_module *modules;
+static uint32_t num_modules;
+static struct mpi_instrument_record *ring;
+static uint64_t ring_mask;
+static uint64_t ring_next; // Records ever written; the ring holds the last ring_mask + 1 of them
+static int finalized;
+static int thread_multiple; // Whether MPI calls may be concurrent, so the updates must be atomic
+
+// Cycle counter & wall clock at the first registration, used to convert cycles to seconds
+static uint64_t start_cycles;
+static struct timespec start_time;
+
+static uint64_t read_cycle_counter(void)
+{
+#if defined(__clang__)
+    return __builtin_readcyclecounter();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0; // No cycle counter; llvm.readcyclecounter also returns 0 on such targets
+#endif
+}
+
+// Called by the constructor of every instrumented module, before main
+void __mpi_instrument_register(struct mpi_instrument_module *module)
+{
+    if (!ring)
+    {
+        uint64_t capacity = MPI_INSTRUMENT_DEFAULT_RECORDS;
+        const char *records = getenv("MPI_INSTRUMENT_RECORDS");
+        if (records && strtoull(records, NULL, 10) > 0)
+            capacity = strtoull(records, NULL, 10);
+        uint64_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        ring = calloc(size, sizeof(struct mpi_instrument_record));
+        ring_mask = ring ? size - 1 : 0;
+        start_cycles = read_cycle_counter();
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+    }
+
+    module->index = num_modules++;
+    module->next = modules;
+    modules = module;
+    for (uint32_t i = 0; i < module->num_sites; i++)
+        module->sites[i].module = module->index;
+}
+
+// Called after an instrumented MPI_Init_thread with the thread level MPI provides
+void __mpi_instrument_init_thread(const int *provided)
+{
+    thread_multiple = *provided == MPI_THREAD_MULTIPLE;
+}
+
+// Called after every instrumented MPI call with the cycle counter read around it
+void __mpi_instrument_record(struct mpi_instrument_site *site, uint64_t start, uint64_t end, int32_t peer,
+                             int32_t tag)
+{
+    uint64_t cycles = end - start;
+    uint64_t next;
+    if (__builtin_expect(thread_multiple, 0))
+    {
+        __atomic_fetch_add(&site->calls, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&site->cycles, cycles, __ATOMIC_RELAXED);
+        next = __atomic_fetch_add(&ring_next, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        site->calls++;
+        site->cycles += cycles;
+        next = ring_next++;
+    }
+    if (!ring || __atomic_load_n(&finalized, __ATOMIC_RELAXED))
+        return;
+
+    struct mpi_instrument_record *record = &ring[next & ring_mask];
+    record->module = site->module;
+    record->site = site->index;
+    record->peer = peer;
+    record->tag = tag;
+    record->start = start;
+    record->cycles = cycles;
+}
+
+static void write_u32(FILE *file, uint32_t value) { fwrite(&value, sizeof(value), 1, file); }
+static void write_u64(FILE *file, uint64_t value) { fwrite(&value, sizeof(value), 1, file); }
+
+static void write_string(FILE *file, const char *text)
+{
+    uint32_t size = text ? strlen(text) : 0;
+    write_u32(file, size);
+    fwrite(text, 1, size, file);
+}
+
+// Called before every MPI_Finalize: writes the counters & the ring buffer of this rank.
+//
+// File format (host byte order): "MPIR", u32 version, i32 rank, i32 size, u64 cycles, u64 nanoseconds
+// (elapsed since registration, to convert cycles to time), u32 modules, then per module: u32 index,
+// str sourceFile, u32 sites & per site: str function, str op, u64 calls, u64 cycles. Then u64 records
+// written, u32 records kept & the kept records, oldest first: u32 module, u32 site, i32 peer, i32 tag,
+// u64 start, u64 cycles. Strings are a u32 length & bytes.
+void __mpi_instrument_finalize(void)
+{
+    if (__atomic_exchange_n(&finalized, 1, __ATOMIC_RELAXED))
+        return;
+
+    uint64_t end_cycles = read_cycle_counter();
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+    int rank = 0, size = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const char *dir = getenv("MPI_INSTRUMENT_DIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/mpi-instrument.%d.mpir", dir && *dir ? dir : ".", rank);
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "[ERROR] mpi-instrument: cannot write %s\n", path);
+        return;
+    }
+
+    fwrite("MPIR", 1, 4, file);
+    write_u32(file, MPI_INSTRUMENT_VERSION);
+    write_u32(file, (uint32_t)rank);
+    write_u32(file, (uint32_t)size);
+    write_u64(file, end_cycles - start_cycles);
+    write_u64(file, (uint64_t)(end_time.tv_sec - start_time.tv_sec) * 1000000000u + end_time.tv_nsec -
+                        start_time.tv_nsec);
+
+    write_u32(file, num_modules);
+    for (struct mpi_instrument_module *module = modules; module; module = module->next)
+    {
+        write_u32(file, module->index);
+        write_string(file, module->source_file);
+        write_u32(file, module->num_sites);
+        for (uint32_t i = 0; i < module->num_sites; i++)
+        {
+            struct mpi_instrument_site *site = &module->sites[i];
+            write_string(file, site->function);
+            write_string(file, site->op);
+            write_u64(file, __atomic_load_n(&site->calls, __ATOMIC_RELAXED));
+            write_u64(file, __atomic_load_n(&site->cycles, __ATOMIC_RELAXED));
+        }
+    }
+
+    uint64_t written = __atomic_load_n(&ring_next, __ATOMIC_RELAXED);
+    uint64_t kept = written < ring_mask + 1 ? written : ring_mask + 1;
+    write_u64(file, written);
+    write_u32(file, ring ? (uint32_t)kept : 0);
+    for (uint64_t i = written - kept; ring && i < written; i++)
+        fwrite(&ring[i & ring_mask], sizeof(struct mpi_instrument_record), 1, file);
+    fclose(file);
+}
@@ -0,0 +1,868 @@
+// Offline LogGP simulation of the communication extracted by mpi-analysis.
+//
+// Every rank replays the call records of the binary reports in report order (functions in module
+// order, calls in program order), restricted to the calls its rank executes. A record is repeated
+// by its estimated frequency; consecutive records with the same repeat count are iterated together
+// as one loop body, and interval peers such as {1..size-1} are walked one member per iteration.
+// Messages are sent eagerly and matched in order per (source, tag); collectives synchronize all
+// ranks of MPI_COMM_WORLD. Time is charged with the LogGP parameters:
+//   send:       the sender is busy for o; consecutive sends are at least max(g, o + (k-1)G) apart
+//   arrival:    send start + o + (k-1)G + L
+//   receive:    completes at max(posted, arrival) + o
+//   collective: completes when the last rank arrives, plus the cost of a binomial-tree algorithm
+// The ranks are split into contiguous blocks, one per worker thread. A worker advances its ranks
+// until they all block; messages between blocks are exchanged at the end of each round. Per rank
+// only a cursor into the shared call list, the clocks & its queued messages are kept.
+//
+// Usage: mpi_loggp_sim -ranks N [-latency us] [-overhead us] [-gap us] [-gap-per-byte us]
+//                      [-j N] [-per-rank] [-o report] <file.mpia ...>
+//   file.mpia: binary report written by mpi-analysis<format=binary;out=file.mpia>
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "MPIAnalysis.h"
+
+using namespace llvm;
+using namespace mpianalysis;
+
+namespace
+{
+    cl::list<std::string> inputs(cl::Positional, cl::OneOrMore, cl::desc("<file.mpia ...>"));
+    cl::opt<unsigned> numRanks("ranks", cl::Required, cl::desc("Number of ranks of MPI_COMM_WORLD"));
+    cl::opt<double> latency("latency", cl::desc("L: network latency in microseconds"), cl::init(1.0));
+    cl::opt<double> overhead("overhead", cl::desc("o: CPU overhead per send & receive in microseconds"),
+                             cl::init(0.2));
+    cl::opt<double> gap("gap", cl::desc("g: minimum time between two sends in microseconds"), cl::init(0.3));
+    cl::opt<double> gapPerByte("gap-per-byte", cl::desc("G: time per byte of a message in microseconds"),
+                               cl::init(0.0001));
+    cl::opt<unsigned> jobs("j", cl::desc("Number of worker threads (all cores by default)"), cl::init(0));
+    cl::opt<bool> perRank("per-rank", cl::desc("List the completion time of every rank"));
+    cl::opt<unsigned> maxHops("max-hops", cl::desc("Number of critical-path hops listed"), cl::init(20));
+    cl::opt<std::string> outputFile("o", cl::desc("Simulation report file"), cl::init("-"));
+
+    // What a call does in the simulation
+    enum class Role : uint8_t
+    {
+        None,      // No communication cost (communicator management, probes, tests, ...)
+        Unmodeled, // Communication the simulation cannot replay; skipped with a warning
+        Send,      // Blocking or nonblocking send (sent eagerly)
+        Recv,
+        Irecv,    // Completed by the next wait
+        SendRecv, // Send to the peer, then receive from the mirrored peer
+        Wait,     // Completes all posted receives
+        Collective
+    };
+
+    Role getRole(MPIOpKind kind)
+    {
+        switch (kind)
+        {
+        case MPIOpKind::Send:
+        case MPIOpKind::Ssend:
+        case MPIOpKind::Bsend:
+        case MPIOpKind::Rsend:
+        case MPIOpKind::Isend:
+        case MPIOpKind::Issend:
+        case MPIOpKind::Ibsend:
+        case MPIOpKind::Irsend:
+            return Role::Send;
+        case MPIOpKind::Recv:
+            return Role::Recv;
+        case MPIOpKind::Irecv:
+            return Role::Irecv;
+        case MPIOpKind::Sendrecv:
+        case MPIOpKind::SendrecvReplace:
+            return Role::SendRecv;
+        case MPIOpKind::Wait:
+        case MPIOpKind::Waitall:
+        case MPIOpKind::Waitany:
+        case MPIOpKind::Waitsome:
+            return Role::Wait;
+        case MPIOpKind::SendInit:
+        case MPIOpKind::SsendInit:
+        case MPIOpKind::BsendInit:
+        case MPIOpKind::RsendInit:
+        case MPIOpKind::RecvInit:
+        case MPIOpKind::Start:
+        case MPIOpKind::Startall:
+            return Role::Unmodeled;
+        default:
+            return uint8_t(kind) >= uint8_t(MPIOpKind::Barrier) && uint8_t(kind) <= uint8_t(MPIOpKind::Ialltoall)
+                       ? Role::Collective
+                       : Role::None;
+        }
+    }
+
+    // Peer interval with a concrete upper bound
+    struct PeerInterval
+    {
+        int32_t first;
+        int32_t stride;
+        uint32_t count;
+    };
+
+    // One call record of the simulated program
+    struct SimCall
+    {
+        Role role;
+        MPIOpKind kind;
+        PeerKind peerKind;
+        int32_t peer;
+        int32_t tag;
+        int32_t executingRank;  // The only rank that executes the call, or -1
+        RankSet executingRanks; // The ranks the rank guards let execute it
+        uint32_t bytes;
+        uint32_t firstInterval = 0; // Interval peers: the call's intervals in Program::intervals
+        uint32_t numIntervals = 0;
+        uint32_t numPeers = 0;
+        uint32_t site; // Index into Program::sites
+    };
+
+    // Consecutive calls iterated together
+    struct Block
+    {
+        uint32_t first, end; // Calls [first, end)
+        uint64_t repeat;
+        int32_t onlyRank; // The rank that executes all calls, or -1
+        bool inert;       // No call of the block costs anything
+    };
+
+    // Call records of all reports, shared by every rank
+    struct Program
+    {
+        std::vector<SimCall> calls;
+        std::vector<Block> blocks;
+        std::vector<PeerInterval> intervals;
+        std::vector<std::string> sites; // "file#index (function)"
+    };
+
+    constexpr int32_t AnySource = -1;
+    constexpr int32_t ProcNull = -2;
+    constexpr int32_t NoPeer = INT32_MIN;
+    constexpr int32_t AnyTag = -1; // MPI_ANY_TAG; calls with an unknown tag also match any tag
+
+    // A message in flight or queued at its destination
+    struct Message
+    {
+        int32_t src;
+        int32_t tag;
+        double arrival;
+        double sendStart;
+        uint32_t sendSite;
+    };
+
+    // A receive that waited for its message: the rank was idle until `end`
+    struct WaitEdge
+    {
+        double end;
+        double srcTime; // Start of the send
+        int32_t src;
+        uint32_t srcSite;
+        uint32_t site;
+    };
+
+    // A completed collective; every rank waited for the last one to arrive
+    struct CollectiveRecord
+    {
+        double completion;
+        double lastArrival;
+        int32_t lastRank;
+        uint32_t lastSite;
+    };
+
+    // A receive posted by MPI_Irecv
+    struct PostedRecv
+    {
+        int32_t src;
+        int32_t tag;
+        uint32_t site;
+    };
+
+    enum class Status : uint8_t
+    {
+        Runnable,
+        WaitMessage,
+        WaitCollective,
+        Done
+    };
+
+    // State of one simulated rank
+    struct RankState
+    {
+        double clock = 0;   // Time the rank is ready for its next call
+        double nicFree = 0; // Earliest start of the next send
+        double waited = 0;  // Time spent waiting for messages & collectives
+        uint64_t iteration = 0;
+        uint32_t block = 0;
+        uint32_t pos = 0; // Call within the block
+        uint32_t messages = 0;
+        Status status = Status::Runnable;
+        bool queued = false;
+        bool sent = false; // Send half of a SendRecv done
+        uint64_t bytes = 0;
+        std::vector<Message> inbox;
+        std::vector<PostedRecv> posted;
+        std::vector<WaitEdge> edges; // Ordered by end time
+    };
+
+    // Arrivals at the current collective on the ranks of one worker
+    struct CollectiveTally
+    {
+        uint32_t joined = 0;
+        double lastArrival = -1;
+        int32_t lastRank = -1;
+        uint32_t lastSite = 0;
+        double cost = 0;
+    };
+
+    // Cost of a collective over P ranks with k bytes per rank
+    double collectiveCost(MPIOpKind kind, uint32_t k, uint32_t P)
+    {
+        double steps = P > 1 ? std::ceil(std::log2(double(P))) : 0;
+        double transfer = k ? (k - 1) * gapPerByte : 0;
+        double hop = latency + 2 * overhead;
+        switch (kind)
+        {
+        case MPIOpKind::Barrier:
+        case MPIOpKind::Ibarrier:
+            return steps * hop;
+        case MPIOpKind::Allreduce:
+        case MPIOpKind::Iallreduce:
+        case MPIOpKind::ReduceScatter:
+        case MPIOpKind::ReduceScatterBlock:
+            return 2 * steps * (hop + transfer); // Reduce & broadcast
+        case MPIOpKind::Gather:
+        case MPIOpKind::Gatherv:
+        case MPIOpKind::Igather:
+        case MPIOpKind::Scatter:
+        case MPIOpKind::Scatterv:
+        case MPIOpKind::Iscatter:
+        case MPIOpKind::Allgather:
+        case MPIOpKind::Allgatherv:
+        case MPIOpKind::Iallgather:
+            return steps * hop + double(P - 1) * k * gapPerByte; // The data doubles at every step
+        case MPIOpKind::Alltoall:
+        case MPIOpKind::Alltoallv:
+        case MPIOpKind::Ialltoall:
+            return double(P - 1) * (std::max(gap.getValue(), 2 * overhead) + k * gapPerByte) + latency; // Pairwise
+        default:
+            return steps * (hop + transfer);
+        }
+    }
+
+    // Simulation of all ranks, split into contiguous blocks of ranks with one worker each
+    class Simulation
+    {
+        struct Worker
+        {
+            int32_t firstRank, endRank;
+            std::vector<int32_t> worklist;
+            std::vector<std::vector<std::pair<int32_t, Message>>> outbox[2]; // To other workers, by round parity
+            CollectiveTally tally;
+        };
+
+        const Program &program;
+        uint32_t P;
+        std::vector<RankState> ranks;
+        std::vector<Worker> workers;
+        int32_t ranksPerWorker;
+        unsigned parity = 0;
+        bool collectiveDone = false;
+
+    public:
+        std::vector<CollectiveRecord> collectives;
+        unsigned rounds = 0;
+
+        Simulation(const Program &program, uint32_t P, unsigned threads) : program(program), P(P), ranks(P)
+        {
+            unsigned count = std::max(1u, std::min(threads, P));
+            ranksPerWorker = (P + count - 1) / count;
+            for (int32_t first = 0; first < int32_t(P); first += ranksPerWorker)
+            {
+                workers.emplace_back();
+                workers.back().firstRank = first;
+                workers.back().endRank = std::min<int32_t>(first + ranksPerWorker, P);
+            }
+            for (Worker &worker : workers)
+                for (auto &outbox : worker.outbox)
+                    outbox.resize(workers.size());
+        }
+
+        const std::vector<RankState> &getRanks() const { return ranks; }
+
+        // Resolves the peer of a call on a rank; NoPeer if the rank does not communicate
+        int32_t getPeer(const SimCall &call, int32_t rank, uint64_t iteration, bool mirrored = false) const
+        {
+            int32_t offset = mirrored ? -call.peer : call.peer;
+            switch (call.peerKind)
+            {
+            case PeerKind::Constant:
+                // A constant peer equal to the rank is taken to be guarded off there (a blocking self-receive deadlocks)
+                if (call.peer == ProcNull || call.peer == rank)
+                    return NoPeer;
+                return call.peer == AnySource || (call.peer >= 0 && call.peer < int32_t(P)) ? call.peer : NoPeer;
+            case PeerKind::Relative:
+            {
+                int64_t peer = int64_t(rank) + offset;
+                return peer >= 0 && peer < P ? int32_t(peer) : NoPeer;
+            }
+            case PeerKind::RelativeModSize:
+                return int32_t(((int64_t(rank) + offset) % P + P) % P);
+            case PeerKind::Interval:
+            {
+                if (!call.numPeers)
+                    return NoPeer;
+                uint64_t index = iteration % call.numPeers;
+                for (uint32_t i = 0; i < call.numIntervals; i++)
+                {
+                    const PeerInterval &interval = program.intervals[call.firstInterval + i];
+                    if (index < interval.count)
+                        return interval.first + int32_t(index) * interval.stride;
+                    index -= interval.count;
+                }
+                return NoPeer;
+            }
+            case PeerKind::Unknown:
+                break;
+            }
+            return NoPeer;
+        }
+
+        // Function to run the simulation until every rank is done or blocked for good
+        void run(ThreadPool &pool)
+        {
+            for (int32_t rank = P - 1; rank >= 0; rank--)
+                workers[rank / ranksPerWorker].worklist.push_back(rank);
+
+            for (;; rounds++)
+            {
+                for (size_t w = 0; w < workers.size(); w++)
+                    pool.async([this, w]
+                               { step(workers[w]); });
+                pool.wait();
+
+                // Merge the collective arrivals of all workers
+                collectiveDone = false;
+                CollectiveTally total;
+                for (Worker &worker : workers)
+                {
+                    total.joined += worker.tally.joined;
+                    total.cost = std::max(total.cost, worker.tally.cost);
+                    if (worker.tally.joined && worker.tally.lastArrival > total.lastArrival)
+                    {
+                        total.lastArrival = worker.tally.lastArrival;
+                        total.lastRank = worker.tally.lastRank;
+                        total.lastSite = worker.tally.lastSite;
+                    }
+                }
+                if (total.joined == P)
+                {
+                    collectives.push_back({total.lastArrival + total.cost, total.lastArrival, total.lastRank,
+                                           total.lastSite});
+                    collectiveDone = true;
+                    for (Worker &worker : workers)
+                        worker.tally = CollectiveTally();
+                }
+
+                bool pending = collectiveDone;
+                for (Worker &worker : workers)
+                    pending |= any_of(worker.outbox[parity], [](const std::vector<std::pair<int32_t, Message>> &box)
+                                      { return !box.empty(); });
+                parity ^= 1;
+                if (!pending)
+                    break;
+            }
+        }
+
+    private:
+        // Function to advance the ranks of a worker until they all block
+        void step(Worker &worker)
+        {
+            if (collectiveDone)
+            {
+                const CollectiveRecord &record = collectives.back();
+                for (int32_t rank = worker.firstRank; rank < worker.endRank; rank++)
+                {
+                    RankState &state = ranks[rank];
+                    if (state.status != Status::WaitCollective)
+                        continue;
+                    state.waited += record.lastArrival - state.clock;
+                    state.clock = record.completion;
+                    state.status = Status::Runnable;
+                    advance(state);
+                    enqueue(worker, rank);
+                }
+            }
+
+            // Messages other workers sent in the previous round
+            size_t index = &worker - workers.data();
+            for (Worker &other : workers)
+            {
+                std::vector<std::pair<int32_t, Message>> &box = other.outbox[parity ^ 1][index];
+                for (const std::pair<int32_t, Message> &entry : box)
+                    deliver(worker, entry.first, entry.second);
+                box.clear();
+            }
+
+            while (!worker.worklist.empty())
+            {
+                int32_t rank = worker.worklist.back();
+                worker.worklist.pop_back();
+                ranks[rank].queued = false;
+                execute(worker, rank);
+            }
+        }
+
+        void enqueue(Worker &worker, int32_t rank)
+        {
+            if (!ranks[rank].queued)
+            {
+                ranks[rank].queued = true;
+                worker.worklist.push_back(rank);
+            }
+        }
+
+        void deliver(Worker &worker, int32_t rank, const Message &message)
+        {
+            RankState &state = ranks[rank];
+            state.inbox.push_back(message);
+            if (state.status == Status::WaitMessage)
+                enqueue(worker, rank);
+        }
+
+        // Moves the cursor of a rank to the next call
+        void advance(RankState &state)
+        {
+            const Block &block = program.blocks[state.block];
+            if (block.first + ++state.pos < block.end)
+                return;
+            state.pos = 0;
+            if (++state.iteration < block.repeat)
+                return;
+            state.iteration = 0;
+            state.block++;
+        }
+
+        // Function to match a receive against the queued messages; charges the receive on success
+        bool receive(RankState &state, int32_t src, int32_t tag, uint32_t site)
+        {
+            auto it = find_if(state.inbox, [&](const Message &message)
+                              { return (src == AnySource || message.src == src) &&
+                                       (tag == AnyTag || message.tag == AnyTag || message.tag == tag); });
+            if (it == state.inbox.end())
+                return false;
+            if (it->arrival > state.clock)
+            {
+                state.edges.push_back({it->arrival, it->sendStart, it->src, it->sendSite, site});
+                state.waited += it->arrival - state.clock;
+                state.clock = it->arrival;
+            }
+            state.clock += overhead;
+            state.inbox.erase(it);
+            return true;
+        }
+
+        void send(Worker &worker, int32_t rank, int32_t dst, const SimCall &call)
+        {
+            RankState &state = ranks[rank];
+            double transfer = call.bytes ? (call.bytes - 1) * gapPerByte : 0;
+            double start = std::max(state.clock, state.nicFree);
+            state.clock = start + overhead;
+            state.nicFree = start + std::max(gap.getValue(), overhead + transfer);
+            state.messages++;
+            state.bytes += call.bytes;
+
+            Message message = {rank, call.tag, start + overhead + transfer + latency, start, call.site};
+            if (dst >= worker.firstRank && dst < worker.endRank)
+                deliver(worker, dst, message);
+            else
+                worker.outbox[parity][dst / ranksPerWorker].push_back({dst, message});
+        }
+
+        // Function to run the calls of a rank until it blocks or finishes
+        void execute(Worker &worker, int32_t rank)
+        {
+            RankState &state = ranks[rank];
+            state.status = Status::Runnable;
+            while (state.block < program.blocks.size())
+            {
+                const Block &block = program.blocks[state.block];
+                if (block.inert || (block.onlyRank >= 0 && block.onlyRank != rank))
+                {
+                    state.block++;
+                    continue;
+                }
+
+                const SimCall &call = program.calls[block.first + state.pos];
+                if (!call.executingRanks.contains(rank))
+                {
+                    advance(state);
+                    continue;
+                }
+
+                switch (call.role)
+                {
+                case Role::Send:
+                {
+                    int32_t dst = getPeer(call, rank, state.iteration);
+                    if (dst >= 0)
+                        send(worker, rank, dst, call);
+                    break;
+                }
+                case Role::Recv:
+                {
+                    int32_t src = getPeer(call, rank, state.iteration);
+                    if (src != NoPeer && !receive(state, src, call.tag, call.site))
+                    {
+                        state.status = Status::WaitMessage;
+                        return;
+                    }
+                    break;
+                }
+                case Role::SendRecv:
+                {
+                    int32_t dst = getPeer(call, rank, state.iteration);
+                    if (!state.sent && dst >= 0)
+                        send(worker, rank, dst, call);
+                    state.sent = true;
+                    int32_t src = call.peerKind == PeerKind::Constant ? dst
+                                                                      : getPeer(call, rank, state.iteration, true);
+                    if (src != NoPeer && !receive(state, src, call.tag, call.site))
+                    {
+                        state.status = Status::WaitMessage;
+                        return;
+                    }
+                    state.sent = false;
+                    break;
+                }
+                case Role::Irecv:
+                {
+                    int32_t src = getPeer(call, rank, state.iteration);
+                    if (src != NoPeer)
+                        state.posted.push_back({src, call.tag, call.site});
+                    break;
+                }
+                case Role::Wait:
+                {
+                    auto pending = remove_if(state.posted, [&](const PostedRecv &recv)
+                                             { return receive(state, recv.src, recv.tag, recv.site); });
+                    state.posted.erase(pending, state.posted.end());
+                    if (!state.posted.empty())
+                    {
+                        state.status = Status::WaitMessage;
+                        return;
+                    }
+                    break;
+                }
+                case Role::Collective:
+                {
+                    // The rank stays at the call until all ranks have arrived
+                    CollectiveTally &tally = worker.tally;
+                    tally.joined++;
+                    tally.cost = std::max(tally.cost, collectiveCost(call.kind, call.bytes, P));
+                    if (state.clock > tally.lastArrival || (state.clock == tally.lastArrival && rank < tally.lastRank))
+                    {
+                        tally.lastArrival = state.clock;
+                        tally.lastRank = rank;
+                        tally.lastSite = call.site;
+                    }
+                    state.status = Status::WaitCollective;
+                    return;
+                }
+                case Role::None:
+                case Role::Unmodeled:
+                    break;
+                }
+                advance(state);
+            }
+            state.status = Status::Done;
+        }
+    };
+
+    // Function to build the simulated program from the call records of the reports
+    Program buildProgram(const std::vector<MPIReport> &reports, const std::vector<std::string> &files,
+                         uint32_t P, raw_ostream &OS)
+    {
+        Program program;
+        std::vector<uint64_t> repeats;
+        for (size_t r = 0; r < reports.size(); r++)
+        {
+            const MPIReport &report = reports[r];
+            StringRef file = report.sourceFile.empty() ? StringRef(files[r]) : StringRef(report.sourceFile);
+            for (size_t index = 0; index < report.calls.size(); index++)
+            {
+                const MPIReportCall &record = report.calls[index];
+                SimCall call;
+                call.role = getRole(record.kind);
+                call.kind = record.kind;
+                call.peerKind = record.peerKind;
+                call.peer = record.peer;
+                call.tag = record.tag == UnknownTag ? AnyTag : record.tag;
+                call.executingRank = record.executingRank;
+                call.executingRanks = record.executingRanks;
+                call.bytes = record.bytes;
+                call.site = program.sites.size();
+                program.sites.push_back((file + "#" + Twine(index) + " (" +
+                                         (record.function < report.functions.size() ? report.functions[record.function]
+                                                                                    : std::string("?")) +
+                                         ")")
+                                            .str());
+
+                const char *reason = nullptr;
+                bool pointToPoint = call.role == Role::Send || call.role == Role::Recv || call.role == Role::Irecv ||
+                                    call.role == Role::SendRecv;
+                if (call.role == Role::Unmodeled)
+                    reason = "persistent requests are not simulated";
+                else if ((pointToPoint || call.role == Role::Collective) && record.comm == SelfCommId)
+                    call.role = Role::None;
+                else if ((pointToPoint || call.role == Role::Collective) && record.comm != WorldCommId)
+                    reason = "only MPI_COMM_WORLD is simulated";
+                else if (pointToPoint && record.peerKind == PeerKind::Unknown)
+                    reason = "its peer is unknown";
+                else if (call.role == Role::SendRecv && record.peerKind == PeerKind::Interval)
+                    reason = "its source cannot be derived from an interval destination";
+                if (reason)
+                {
+                    OS << "[WARN] " << program.sites.back() << " is not simulated: " << reason << "\n";
+                    call.role = Role::Unmodeled;
+                }
+
+                // Interval peers, with their size-relative bounds resolved for P ranks
+                uint64_t repeat = std::max(1.0, std::round(double(record.frequency)));
+                if (call.role != Role::Unmodeled && record.peerKind == PeerKind::Interval)
+                {
+                    call.firstInterval = program.intervals.size();
+                    for (const RankInterval &interval : record.peerRanks.getIntervals())
+                    {
+                        int64_t last = interval.lastFromSize ? int64_t(P) + interval.last : interval.last;
+                        last = std::min<int64_t>(last, P - 1);
+                        if (last < interval.first || interval.first < 0)
+                            continue;
+                        uint32_t count = (last - interval.first) / interval.stride + 1;
+                        program.intervals.push_back({interval.first, interval.stride, count});
+                        call.numPeers += count;
+                    }
+                    call.numIntervals = program.intervals.size() - call.firstInterval;
+                    if (!record.exactFrequency && call.numPeers)
+                        repeat = call.numPeers; // The loop over the interval is the one estimated
+                }
+                program.calls.push_back(call);
+                repeats.push_back(std::min<uint64_t>(repeat, UINT32_MAX));
+            }
+        }
+
+        // Consecutive calls with the same repeat count form a block; interval peers set the count of theirs
+        for (uint32_t first = 0; first < program.calls.size();)
+        {
+            uint32_t end = first + 1;
+            while (end < program.calls.size() && repeats[end] == repeats[first])
+                end++;
+            Block block = {first, end, repeats[first], program.calls[first].executingRank, true};
+            for (uint32_t i = first; i < end; i++)
+            {
+                const SimCall &call = program.calls[i];
+                if (call.executingRank != block.onlyRank || call.executingRank < 0)
+                    block.onlyRank = -1;
+                if (call.role != Role::None && call.role != Role::Unmodeled)
+                    block.inert = false;
+            }
+            program.blocks.push_back(block);
+            first = end;
+        }
+        return program;
+    }
+
+    // A segment of the critical path, in reverse order while backtracking
+    struct Hop
+    {
+        bool collective;
+        int32_t src, dst;
+        double srcTime, dstTime;
+        uint32_t srcSite, dstSite;
+    };
+
+    // Function to backtrack the critical path from the rank that finishes last
+    std::vector<Hop> findCriticalPath(const Simulation &sim, int32_t rank, double time)
+    {
+        const std::vector<RankState> &ranks = sim.getRanks();
+        std::vector<Hop> hops;
+        size_t limit = sim.collectives.size();
+        for (const RankState &state : ranks)
+            limit += state.edges.size();
+
+        while (hops.size() <= limit)
+        {
+            // The latest wait of the rank before `time`: a message or a collective
+            const std::vector<WaitEdge> &edges = ranks[rank].edges;
+            auto edge = std::upper_bound(edges.begin(), edges.end(), time, [](double t, const WaitEdge &e)
+                                         { return t < e.end; });
+            auto collective = std::upper_bound(sim.collectives.begin(), sim.collectives.end(), time,
+                                               [](double t, const CollectiveRecord &c)
+                                               { return t < c.completion; });
+            bool hasEdge = edge != edges.begin(), hasCollective = collective != sim.collectives.begin();
+            if (!hasEdge && !hasCollective)
+                break;
+            if (hasCollective && (!hasEdge || std::prev(collective)->completion > std::prev(edge)->end))
+            {
+                const CollectiveRecord &record = *std::prev(collective);
+                hops.push_back({true, record.lastRank, rank, record.lastArrival, record.completion, record.lastSite,
+                                record.lastSite});
+                rank = record.lastRank;
+                time = record.lastArrival;
+            }
+            else
+            {
+                const WaitEdge &wait = *std::prev(edge);
+                hops.push_back({false, wait.src, rank, wait.srcTime, wait.end, wait.srcSite, wait.site});
+                rank = wait.src;
+                time = wait.srcTime;
+            }
+        }
+        std::reverse(hops.begin(), hops.end());
+        return hops;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "Simulates the communication of mpi-analysis reports under LogGP\n");
+
+    uint32_t P = numRanks;
+    if (P == 0)
+    {
+        errs() << "[ERROR] -ranks must be at least 1\n";
+        return 1;
+    }
+
+    std::vector<MPIReport> reports(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(inputs[i], /*IsText=*/false,
+                                                                              /*RequiresNullTerminator=*/false);
+        if (!buffer)
+        {
+            errs() << "[ERROR] Cannot read " << inputs[i] << ": " << buffer.getError().message() << "\n";
+            return 1;
+        }
+        if (Error error = readMPIReport((*buffer)->getBuffer(), reports[i]))
+        {
+            errs() << "[ERROR] " << inputs[i] << ": " << toString(std::move(error)) << "\n";
+            return 1;
+        }
+        if (reports[i].calls.empty())
+            errs() << "[WARN] " << inputs[i] << " has no call records; write it without quiet\n";
+    }
+
+    std::error_code EC;
+    raw_fd_ostream OS(outputFile, EC, sys::fs::OF_Text);
+    if (EC)
+    {
+        errs() << "[ERROR] Cannot write " << outputFile << ": " << EC.message() << "\n";
+        return 1;
+    }
+
+    Program program = buildProgram(reports, inputs, P, OS);
+    ThreadPoolStrategy strategy = hardware_concurrency(jobs);
+    ThreadPool pool(strategy);
+    Simulation sim(program, P, strategy.compute_thread_count());
+    sim.run(pool);
+
+    const std::vector<RankState> &ranks = sim.getRanks();
+    uint64_t messages = 0, bytes = 0, unreceived = 0;
+    double sum = 0;
+    int32_t first = 0, last = 0;
+    std::vector<int32_t> blocked;
+    for (int32_t rank = 0; rank < int32_t(P); rank++)
+    {
+        const RankState &state = ranks[rank];
+        messages += state.messages;
+        bytes += state.bytes;
+        unreceived += state.inbox.size();
+        sum += state.clock;
+        if (state.clock < ranks[first].clock)
+            first = rank;
+        if (state.clock > ranks[last].clock)
+            last = rank;
+        if (state.status != Status::Done)
+            blocked.push_back(rank);
+    }
+
+    OS << "[INFO] LogGP simulation of " << P << " rank(s) "
+       << format("(L=%g o=%g g=%g us, G=%g us/byte): ", latency.getValue(), overhead.getValue(), gap.getValue(),
+                 gapPerByte.getValue())
+       << messages << " message(s), " << bytes << " byte(s), " << sim.collectives.size() << " collective(s) in "
+       << sim.rounds + 1 << " round(s)\n";
+    OS << format("Completion time (us): min %.3f (rank %d), mean %.3f, max %.3f (rank %d)\n", ranks[first].clock,
+                 first, sum / P, ranks[last].clock, last);
+
+    // Slowest ranks first
+    std::vector<int32_t> order(P);
+    for (int32_t rank = 0; rank < int32_t(P); rank++)
+        order[rank] = rank;
+    size_t listed = perRank ? P : std::min<size_t>(P, 10);
+    std::partial_sort(order.begin(), order.begin() + listed, order.end(), [&](int32_t a, int32_t b)
+                      { return ranks[a].clock > ranks[b].clock || (ranks[a].clock == ranks[b].clock && a < b); });
+    OS << (perRank ? "Ranks:\n" : "Slowest ranks:\n");
+    OS << "Rank          Time (us)      Wait (us)   Messages          Bytes\n";
+    for (size_t i = 0; i < listed; i++)
+    {
+        const RankState &state = ranks[order[i]];
+        OS << format("%-10d %12.3f %14.3f %10u %14llu\n", order[i], state.clock, state.waited, state.messages,
+                     (unsigned long long)state.bytes);
+    }
+
+    std::vector<Hop> hops = findCriticalPath(sim, last, ranks[last].clock);
+    double messageTime = 0, collectiveTime = 0;
+    unsigned collectiveHops = 0;
+    for (const Hop &hop : hops)
+    {
+        (hop.collective ? collectiveTime : messageTime) += hop.dstTime - hop.srcTime;
+        collectiveHops += hop.collective;
+    }
+    OS << format("Critical path: %.3f us over %zu hop(s): %.3f us in %zu message(s), %.3f us in %u collective(s), "
+                 "%.3f us on the ranks\n",
+                 ranks[last].clock, hops.size(), messageTime, hops.size() - collectiveHops, collectiveTime,
+                 collectiveHops, ranks[last].clock - messageTime - collectiveTime);
+    for (size_t i = 0; i < hops.size() && i < maxHops; i++)
+    {
+        const Hop &hop = hops[i];
+        if (hop.collective)
+            OS << format("  %12.3f  collective completed by rank %d, the last to arrive at %s\n", hop.dstTime,
+                         hop.src, program.sites[hop.srcSite].c_str());
+        else
+            OS << format("  %12.3f  rank %d -> rank %d: %s -> %s\n", hop.dstTime, hop.src, hop.dst,
+                         program.sites[hop.srcSite].c_str(), program.sites[hop.dstSite].c_str());
+    }
+    if (hops.size() > maxHops)
+        OS << "  ... " << hops.size() - maxHops << " more hop(s)\n";
+
+    // Ranks that never finish point at unmatched calls or at calls the simulation could not replay
+    if (!blocked.empty())
+    {
+        OS << "[WARN] Deadlock: " << blocked.size() << " rank(s) never finish";
+        for (size_t i = 0; i < blocked.size() && i < 5; i++)
+        {
+            const RankState &state = ranks[blocked[i]];
+            const Block &block = program.blocks[state.block];
+            const SimCall &call = program.calls[block.first + state.pos];
+            OS << (i ? "; rank " : ", e.g. rank ") << blocked[i]
+               << (state.status == Status::WaitCollective ? " in the collective " : " waiting for a message at ")
+               << program.sites[call.site];
+        }
+        OS << "\n";
+    }
+    if (unreceived)
+        OS << "[WARN] " << unreceived << " message(s) were never received\n";
+    return 0;
+}
@@ -0,0 +1,336 @@
+// Node-aware rank placement from the traffic matrix written by mpi-analysis<traffic-matrix=...>.
+//
+// Groups ranks into nodes of a fixed size so that as many bytes as possible stay inside a node,
+// and writes the mapping as an Open MPI rankfile (mpirun --rankfile <file>).
+//
+// Usage: mpi_rank_placement <matrix> <ranks-per-node> [hosts-file] > rankfile
+//   matrix:         "src dst bytes" lines, with a "# ranks N" header
+//   ranks-per-node: number of ranks placed on each node
+//   hosts-file:     optional host names, one per line; relative "+n<i>" hosts are used otherwise
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Symmetric weighted rank graph in compressed sparse row form
+    struct TrafficGraph
+    {
+        int32_t ranks = 0;
+        std::vector<uint64_t> offsets;  // Edges of rank r are [offsets[r], offsets[r + 1])
+        std::vector<int32_t> neighbors; // Neighbor rank of each edge
+        std::vector<double> weights;    // Bytes exchanged in both directions
+    };
+
+    // Function to read the traffic matrix and build the symmetric graph
+    bool readTrafficMatrix(const char *path, TrafficGraph &graph)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            std::cerr << "[ERROR] Cannot read " << path << "\n";
+            return false;
+        }
+
+        struct Edge
+        {
+            int32_t src, dst;
+            double bytes;
+        };
+        std::vector<Edge> edges;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.empty())
+                continue;
+            if (line[0] == '#')
+            {
+                std::istringstream header(line.substr(1));
+                std::string key;
+                if (header >> key && key == "ranks")
+                    header >> graph.ranks;
+                continue;
+            }
+
+            Edge edge;
+            std::istringstream fields(line);
+            if (!(fields >> edge.src >> edge.dst >> edge.bytes) || edge.src < 0 || edge.dst < 0)
+            {
+                std::cerr << "[ERROR] Malformed matrix line: " << line << "\n";
+                return false;
+            }
+            graph.ranks = std::max({graph.ranks, edge.src + 1, edge.dst + 1});
+            edges.push_back(edge);
+        }
+
+        // Each directed edge is stored in both directions; duplicates are merged below
+        std::vector<uint64_t> degree(graph.ranks + 1, 0);
+        for (const Edge &edge : edges)
+        {
+            degree[edge.src]++;
+            degree[edge.dst]++;
+        }
+        graph.offsets.assign(graph.ranks + 1, 0);
+        for (int32_t r = 0; r < graph.ranks; r++)
+            graph.offsets[r + 1] = graph.offsets[r] + degree[r];
+        graph.neighbors.resize(graph.offsets.back());
+        graph.weights.resize(graph.offsets.back());
+        std::vector<uint64_t> fill(graph.offsets.begin(), graph.offsets.end() - 1);
+        for (const Edge &edge : edges)
+        {
+            graph.neighbors[fill[edge.src]] = edge.dst;
+            graph.weights[fill[edge.src]++] = edge.bytes;
+            graph.neighbors[fill[edge.dst]] = edge.src;
+            graph.weights[fill[edge.dst]++] = edge.bytes;
+        }
+
+        // Sort & merge each rank's adjacency list
+        uint64_t out = 0;
+        std::vector<std::pair<int32_t, double>> adjacency;
+        for (int32_t r = 0; r < graph.ranks; r++)
+        {
+            adjacency.clear();
+            for (uint64_t e = graph.offsets[r]; e < graph.offsets[r + 1]; e++)
+                adjacency.emplace_back(graph.neighbors[e], graph.weights[e]);
+            std::sort(adjacency.begin(), adjacency.end());
+
+            graph.offsets[r] = out;
+            for (size_t i = 0; i < adjacency.size(); i++)
+            {
+                if (out > graph.offsets[r] && graph.neighbors[out - 1] == adjacency[i].first)
+                {
+                    graph.weights[out - 1] += adjacency[i].second;
+                    continue;
+                }
+                graph.neighbors[out] = adjacency[i].first;
+                graph.weights[out++] = adjacency[i].second;
+            }
+        }
+        graph.offsets[graph.ranks] = out;
+        graph.neighbors.resize(out);
+        graph.weights.resize(out);
+        return true;
+    }
+
+    // Function to compute the bytes that cross node boundaries under a placement
+    double interNodeBytes(const TrafficGraph &graph, const std::vector<int32_t> &nodeOf)
+    {
+        double bytes = 0;
+        for (int32_t r = 0; r < graph.ranks; r++)
+        {
+            for (uint64_t e = graph.offsets[r]; e < graph.offsets[r + 1]; e++)
+            {
+                if (nodeOf[r] != nodeOf[graph.neighbors[e]])
+                    bytes += graph.weights[e];
+            }
+        }
+        return bytes / 2; // Every edge is stored twice
+    }
+
+    // Function to grow nodes one at a time: each node starts from the heaviest unplaced rank and
+    // repeatedly takes the unplaced rank with the most traffic to the ranks already on the node.
+    // A node with no connected candidates left is filled with the lightest unplaced ranks, so
+    // heavy ranks stay available as seeds of their own nodes.
+    std::vector<int32_t> growNodes(const TrafficGraph &graph, int32_t ranksPerNode)
+    {
+        std::vector<int32_t> nodeOf(graph.ranks, -1);
+        std::vector<double> gain(graph.ranks, 0);
+        std::vector<int32_t> touched;
+
+        // Seeds in order of total traffic
+        std::vector<int32_t> seeds(graph.ranks);
+        std::vector<double> total(graph.ranks, 0);
+        for (int32_t r = 0; r < graph.ranks; r++)
+        {
+            seeds[r] = r;
+            for (uint64_t e = graph.offsets[r]; e < graph.offsets[r + 1]; e++)
+                total[r] += graph.weights[e];
+        }
+        std::stable_sort(seeds.begin(), seeds.end(), [&](int32_t a, int32_t b)
+                         { return total[a] > total[b]; });
+        size_t nextSeed = 0, nextFiller = seeds.size();
+
+        for (int32_t node = 0, placed = 0; placed < graph.ranks; node++)
+        {
+            std::priority_queue<std::pair<double, int32_t>> candidates; // (gain, rank), stale entries skipped
+            for (int32_t slot = 0; slot < ranksPerNode && placed < graph.ranks; slot++)
+            {
+                int32_t rank = -1;
+                while (!candidates.empty() && rank < 0)
+                {
+                    auto top = candidates.top();
+                    candidates.pop();
+                    if (nodeOf[top.second] < 0 && top.first == gain[top.second])
+                        rank = top.second;
+                }
+                while (rank < 0 && slot == 0)
+                {
+                    if (nodeOf[seeds[nextSeed]] < 0)
+                        rank = seeds[nextSeed];
+                    nextSeed++;
+                }
+                while (rank < 0)
+                {
+                    nextFiller--;
+                    if (nodeOf[seeds[nextFiller]] < 0)
+                        rank = seeds[nextFiller];
+                }
+
+                nodeOf[rank] = node;
+                placed++;
+                for (uint64_t e = graph.offsets[rank]; e < graph.offsets[rank + 1]; e++)
+                {
+                    int32_t neighbor = graph.neighbors[e];
+                    if (nodeOf[neighbor] >= 0)
+                        continue;
+                    if (gain[neighbor] == 0)
+                        touched.push_back(neighbor);
+                    gain[neighbor] += graph.weights[e];
+                    candidates.emplace(gain[neighbor], neighbor);
+                }
+            }
+
+            for (int32_t rank : touched)
+                gain[rank] = 0;
+            touched.clear();
+        }
+        return nodeOf;
+    }
+
+    // Function to return the traffic between a rank and the ranks on a node
+    double trafficToNode(const TrafficGraph &graph, const std::vector<int32_t> &nodeOf, int32_t rank, int32_t node)
+    {
+        double bytes = 0;
+        for (uint64_t e = graph.offsets[rank]; e < graph.offsets[rank + 1]; e++)
+        {
+            if (nodeOf[graph.neighbors[e]] == node)
+                bytes += graph.weights[e];
+        }
+        return bytes;
+    }
+
+    // Function to refine a placement by swapping ranks between nodes whenever the swap lowers the
+    // inter-node traffic (keeps every node at the same size). Each rank v tries one swap: with the
+    // neighbor u on the node v has the most traffic to, so a pass costs O(edges).
+    void refineBySwaps(const TrafficGraph &graph, std::vector<int32_t> &nodeOf, int32_t nodes, int passes)
+    {
+        std::vector<double> toNode(nodes, 0); // Traffic of v to each node, reset after use
+        for (int pass = 0; pass < passes; pass++)
+        {
+            bool improved = false;
+            for (int32_t v = 0; v < graph.ranks; v++)
+            {
+                int32_t a = nodeOf[v], b = -1;
+                for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+                    toNode[nodeOf[graph.neighbors[e]]] += graph.weights[e];
+                for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+                {
+                    int32_t node = nodeOf[graph.neighbors[e]];
+                    if (node != a && (b < 0 || toNode[node] > toNode[b]))
+                        b = node;
+                }
+
+                // Swap partner: the neighbor on node b with the least traffic to v
+                int32_t u = -1;
+                double vu = 0;
+                if (b >= 0 && toNode[b] > toNode[a])
+                {
+                    for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+                    {
+                        if (nodeOf[graph.neighbors[e]] == b && (u < 0 || graph.weights[e] < vu))
+                        {
+                            u = graph.neighbors[e];
+                            vu = graph.weights[e];
+                        }
+                    }
+                }
+                double gainV = b >= 0 ? toNode[b] - toNode[a] : 0;
+                for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+                    toNode[nodeOf[graph.neighbors[e]]] = 0;
+                if (u < 0)
+                    continue;
+
+                double gain = gainV + trafficToNode(graph, nodeOf, u, a) - trafficToNode(graph, nodeOf, u, b) - 2 * vu;
+                if (gain > 0)
+                {
+                    std::swap(nodeOf[v], nodeOf[u]);
+                    improved = true;
+                }
+            }
+            if (!improved)
+                break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <matrix> <ranks-per-node> [hosts-file] > rankfile\n";
+        return 1;
+    }
+
+    int32_t ranksPerNode = std::atoi(argv[2]);
+    if (ranksPerNode <= 0)
+    {
+        std::cerr << "[ERROR] ranks-per-node must be positive\n";
+        return 1;
+    }
+
+    TrafficGraph graph;
+    if (!readTrafficMatrix(argv[1], graph))
+        return 1;
+
+    std::vector<std::string> hosts;
+    if (argc > 3)
+    {
+        std::ifstream hostsFile(argv[3]);
+        std::string host;
+        while (hostsFile >> host)
+            hosts.push_back(host);
+    }
+
+    // The default mapping places consecutive ranks on the same node
+    std::vector<int32_t> linear(graph.ranks);
+    for (int32_t r = 0; r < graph.ranks; r++)
+        linear[r] = r / ranksPerNode;
+
+    int32_t nodes = (graph.ranks + ranksPerNode - 1) / ranksPerNode;
+    std::vector<int32_t> nodeOf = growNodes(graph, ranksPerNode);
+    refineBySwaps(graph, nodeOf, nodes, 4);
+
+    double before = interNodeBytes(graph, linear), after = interNodeBytes(graph, nodeOf);
+    if (after > before)
+    {
+        nodeOf = linear; // Never do worse than the default mapping
+        after = before;
+    }
+
+    if (!hosts.empty() && int32_t(hosts.size()) < nodes)
+    {
+        std::cerr << "[ERROR] " << nodes << " nodes are needed but the hosts file lists " << hosts.size() << "\n";
+        return 1;
+    }
+
+    // Output the Open MPI rankfile
+    std::vector<int32_t> nextSlot(nodes, 0);
+    for (int32_t r = 0; r < graph.ranks; r++)
+    {
+        int32_t node = nodeOf[r];
+        std::cout << "rank " << r << "=" << (hosts.empty() ? "+n" + std::to_string(node) : hosts[node])
+                  << " slot=" << nextSlot[node]++ << "\n";
+    }
+
+    std::fprintf(stderr, "[INFO] %d ranks on %d node(s) of %d: inter-node bytes %.0f -> %.0f (linear -> placed)\n",
+                 graph.ranks, nodes, ranksPerNode, before, after);
+    return 0;
+}
@@ -31,17 +31,17 @@ elapsed=$((($end_time - $start_time) / 1000000))
 echo "✅ Compiled in ${elapsed} ms"
 echo "" # Newline
 
-# Step 2: Compile the MPIAnalysisPass.cpp to a shared object (MPIAnalysisPass.so)
-echo "🔍 Step 2: Compiling MPIAnalysisPass.cpp to shared object (MPIAnalysisPass.so)"
+# Step 2: Build the MPIAnalysisPass.cpp to a shared object (MPIAnalysisPass.so); make only rebuilds it when the pass changed
+echo "🔍 Step 2: Building MPIAnalysisPass.cpp to shared object (MPIAnalysisPass.so)"
 if $VERBOSE; then
-    echo "⛓️  Executing: clang++ -shared -fPIC -o MPIAnalysisPass.so MPIAnalysisPass.cpp \`llvm-config --cxxflags --ldflags --libs\`"
+    echo "⛓️  Executing: make MPIAnalysisPass.so"
 fi
 start_time=$(date +%s%N)
 # Command
-clang++ -shared -fPIC -o MPIAnalysisPass.so MPIAnalysisPass.cpp `llvm-config --cxxflags --ldflags --libs`
+make -s MPIAnalysisPass.so
 end_time=$(date +%s%N)
 elapsed=$((($end_time - $start_time) / 1000000))
-echo "✅ Compiled in ${elapsed} ms"
+echo "✅ Built in ${elapsed} ms"
 echo "" # Newline
 
 # Step 3: Run the custom LLVM pass (mpi-analysis) on the input.ll
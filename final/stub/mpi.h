@@ -0,0 +1,113 @@
+// Minimal single-process MPI for trying the analysis & instrumentation without an MPI installation.
+//
+// The process plays rank MPI_STUB_RANK of a job of MPI_STUB_SIZE ranks (environment variables,
+// default 0 of 1), so every rank's code path can be run on its own. Sends complete immediately and
+// their data is dropped; receives complete immediately with a zero-filled buffer. Collectives behave
+// as on a single rank. Handles are named like Open MPI's (ompi_mpi_comm_world, ompi_mpi_int, ...),
+// so programs compiled against this header are analyzed like Open MPI programs.
+
+#ifndef MPI_STUB_H
+#define MPI_STUB_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct ompi_communicator_t *MPI_Comm;
+    typedef struct ompi_datatype_t *MPI_Datatype;
+    typedef struct ompi_op_t *MPI_Op;
+    typedef struct ompi_request_t *MPI_Request;
+
+    typedef struct
+    {
+        int MPI_SOURCE;
+        int MPI_TAG;
+        int MPI_ERROR;
+        int count; // Received bytes
+    } MPI_Status;
+
+    extern struct ompi_communicator_t ompi_mpi_comm_world, ompi_mpi_comm_self, ompi_mpi_comm_null;
+    extern struct ompi_datatype_t ompi_mpi_char, ompi_mpi_byte, ompi_mpi_short, ompi_mpi_int, ompi_mpi_long,
+        ompi_mpi_unsigned, ompi_mpi_float, ompi_mpi_double, ompi_mpi_long_long_int;
+    extern struct ompi_op_t ompi_mpi_op_sum, ompi_mpi_op_max, ompi_mpi_op_min, ompi_mpi_op_prod;
+
+#define MPI_COMM_WORLD (&ompi_mpi_comm_world)
+#define MPI_COMM_SELF (&ompi_mpi_comm_self)
+#define MPI_COMM_NULL (&ompi_mpi_comm_null)
+#define MPI_CHAR (&ompi_mpi_char)
+#define MPI_BYTE (&ompi_mpi_byte)
+#define MPI_SHORT (&ompi_mpi_short)
+#define MPI_INT (&ompi_mpi_int)
+#define MPI_LONG (&ompi_mpi_long)
+#define MPI_UNSIGNED (&ompi_mpi_unsigned)
+#define MPI_FLOAT (&ompi_mpi_float)
+#define MPI_DOUBLE (&ompi_mpi_double)
+#define MPI_LONG_LONG (&ompi_mpi_long_long_int)
+#define MPI_SUM (&ompi_mpi_op_sum)
+#define MPI_MAX (&ompi_mpi_op_max)
+#define MPI_MIN (&ompi_mpi_op_min)
+#define MPI_PROD (&ompi_mpi_op_prod)
+#define MPI_REQUEST_NULL ((MPI_Request)0)
+#define MPI_STATUS_IGNORE ((MPI_Status *)0)
+#define MPI_STATUSES_IGNORE ((MPI_Status *)0)
+#define MPI_IN_PLACE ((void *)1)
+#define MPI_ANY_SOURCE (-1)
+#define MPI_ANY_TAG (-1)
+#define MPI_PROC_NULL (-2)
+#define MPI_UNDEFINED (-32766)
+#define MPI_SUCCESS 0
+#define MPI_THREAD_SINGLE 0
+#define MPI_THREAD_FUNNELED 1
+#define MPI_THREAD_SERIALIZED 2
+#define MPI_THREAD_MULTIPLE 3
+
+    int MPI_Init(int *argc, char ***argv);
+    int MPI_Init_thread(int *argc, char ***argv, int required, int *provided);
+    int MPI_Finalize(void);
+    int MPI_Abort(MPI_Comm comm, int errorcode);
+    double MPI_Wtime(void);
+
+    int MPI_Comm_rank(MPI_Comm comm, int *rank);
+    int MPI_Comm_size(MPI_Comm comm, int *size);
+    int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm);
+    int MPI_Comm_dup(MPI_Comm comm, MPI_Comm *newcomm);
+    int MPI_Comm_free(MPI_Comm *comm);
+
+    int MPI_Send(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm);
+    int MPI_Ssend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm);
+    int MPI_Bsend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm);
+    int MPI_Rsend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm);
+    int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+                 MPI_Status *status);
+    int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+                     void *recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm,
+                     MPI_Status *status);
+    int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm,
+                  MPI_Request *request);
+    int MPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+                  MPI_Request *request);
+    int MPI_Wait(MPI_Request *request, MPI_Status *status);
+    int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[]);
+    int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status);
+
+    int MPI_Barrier(MPI_Comm comm);
+    int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm);
+    int MPI_Reduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, int root,
+                   MPI_Comm comm);
+    int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op,
+                      MPI_Comm comm);
+    int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                   MPI_Datatype recvtype, int root, MPI_Comm comm);
+    int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                    MPI_Datatype recvtype, int root, MPI_Comm comm);
+    int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                      MPI_Datatype recvtype, MPI_Comm comm);
+    int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                     MPI_Datatype recvtype, MPI_Comm comm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MPI_STUB_H
@@ -0,0 +1,260 @@
+// Single-process implementation of the stub MPI declared in mpi.h (see there for its semantics)
+
+#include "mpi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct ompi_communicator_t
+{
+    int rank;
+    int size;
+};
+
+struct ompi_datatype_t
+{
+    int size;
+};
+
+struct ompi_op_t
+{
+    int unused;
+};
+
+struct ompi_communicator_t ompi_mpi_comm_world = {0, 1}, ompi_mpi_comm_self = {0, 1}, ompi_mpi_comm_null = {0, 0};
+struct ompi_datatype_t ompi_mpi_char = {1}, ompi_mpi_byte = {1}, ompi_mpi_short = {2}, ompi_mpi_int = {4},
+                       ompi_mpi_long = {sizeof(long)}, ompi_mpi_unsigned = {4}, ompi_mpi_float = {4},
+                       ompi_mpi_double = {8}, ompi_mpi_long_long_int = {8};
+struct ompi_op_t ompi_mpi_op_sum, ompi_mpi_op_max, ompi_mpi_op_min, ompi_mpi_op_prod;
+
+static size_t bytes(int count, MPI_Datatype datatype) { return count > 0 ? (size_t)count * datatype->size : 0; }
+
+static void complete_receive(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Status *status)
+{
+    memset(buf, 0, bytes(count, datatype));
+    if (status)
+    {
+        status->MPI_SOURCE = source;
+        status->MPI_TAG = tag;
+        status->MPI_ERROR = MPI_SUCCESS;
+        status->count = (int)bytes(count, datatype);
+    }
+}
+
+// Copies the calling rank's contribution, or zeros if it has none
+static void copy_or_clear(void *to, const void *from, size_t size)
+{
+    if (from && from != MPI_IN_PLACE)
+        memcpy(to, from, size);
+    else if (!from)
+        memset(to, 0, size);
+}
+
+int MPI_Init(int *argc, char ***argv)
+{
+    const char *size = getenv("MPI_STUB_SIZE");
+    const char *rank = getenv("MPI_STUB_RANK");
+    ompi_mpi_comm_world.size = size && atoi(size) > 0 ? atoi(size) : 1;
+    ompi_mpi_comm_world.rank = rank ? atoi(rank) : 0;
+    if (ompi_mpi_comm_world.rank < 0 || ompi_mpi_comm_world.rank >= ompi_mpi_comm_world.size)
+    {
+        fprintf(stderr, "[ERROR] MPI_STUB_RANK must be below MPI_STUB_SIZE\n");
+        exit(1);
+    }
+    return MPI_SUCCESS;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided)
+{
+    *provided = required;
+    return MPI_Init(argc, argv);
+}
+
+int MPI_Finalize(void) { return MPI_SUCCESS; }
+
+int MPI_Abort(MPI_Comm comm, int errorcode)
+{
+    exit(errorcode);
+}
+
+double MPI_Wtime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int MPI_Comm_rank(MPI_Comm comm, int *rank)
+{
+    *rank = comm->rank;
+    return MPI_SUCCESS;
+}
+
+int MPI_Comm_size(MPI_Comm comm, int *size)
+{
+    *size = comm->size;
+    return MPI_SUCCESS;
+}
+
+// Derived communicators keep the rank & size of their parent
+int MPI_Comm_dup(MPI_Comm comm, MPI_Comm *newcomm)
+{
+    *newcomm = malloc(sizeof(struct ompi_communicator_t));
+    **newcomm = *comm;
+    return MPI_SUCCESS;
+}
+
+int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm)
+{
+    if (color == MPI_UNDEFINED)
+    {
+        *newcomm = MPI_COMM_NULL;
+        return MPI_SUCCESS;
+    }
+    return MPI_Comm_dup(comm, newcomm);
+}
+
+int MPI_Comm_free(MPI_Comm *comm)
+{
+    free(*comm);
+    *comm = MPI_COMM_NULL;
+    return MPI_SUCCESS;
+}
+
+int MPI_Send(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm)
+{
+    return MPI_SUCCESS;
+}
+
+int MPI_Ssend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm)
+{
+    return MPI_SUCCESS;
+}
+
+int MPI_Bsend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm)
+{
+    return MPI_SUCCESS;
+}
+
+int MPI_Rsend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm)
+{
+    return MPI_SUCCESS;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Status *status)
+{
+    complete_receive(buf, count, datatype, source, tag, status);
+    return MPI_SUCCESS;
+}
+
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag, void *recvbuf,
+                 int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status *status)
+{
+    complete_receive(recvbuf, recvcount, recvtype, source, recvtag, status);
+    return MPI_SUCCESS;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm,
+              MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_SUCCESS;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Request *request)
+{
+    complete_receive(buf, count, datatype, source, tag, MPI_STATUS_IGNORE);
+    *request = MPI_REQUEST_NULL;
+    return MPI_SUCCESS;
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_SUCCESS;
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[])
+{
+    for (int i = 0; i < count; i++)
+        requests[i] = MPI_REQUEST_NULL;
+    return MPI_SUCCESS;
+}
+
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status)
+{
+    *request = MPI_REQUEST_NULL;
+    *flag = 1;
+    return MPI_SUCCESS;
+}
+
+int MPI_Barrier(MPI_Comm comm) { return MPI_SUCCESS; }
+
+int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm)
+{
+    if (comm->rank != root)
+        memset(buffer, 0, bytes(count, datatype));
+    return MPI_SUCCESS;
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, int root,
+               MPI_Comm comm)
+{
+    if (comm->rank == root)
+        copy_or_clear(recvbuf, sendbuf, bytes(count, datatype));
+    return MPI_SUCCESS;
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+    copy_or_clear(recvbuf, sendbuf, bytes(count, datatype));
+    return MPI_SUCCESS;
+}
+
+// The calling rank's block of a gathered buffer holds its own contribution, the others zeros
+static void gather_own(const void *sendbuf, size_t block, void *recvbuf, MPI_Comm comm)
+{
+    char *own = (char *)recvbuf + comm->rank * block;
+    if (sendbuf != MPI_IN_PLACE)
+    {
+        memset(recvbuf, 0, comm->size * block);
+        memcpy(own, sendbuf, block);
+    }
+}
+
+int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+               MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    if (comm->rank == root)
+        gather_own(sendbuf, bytes(recvcount, recvtype), recvbuf, comm);
+    return MPI_SUCCESS;
+}
+
+int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    if (recvbuf == MPI_IN_PLACE)
+        return MPI_SUCCESS;
+    if (comm->rank == root)
+        memcpy(recvbuf, (const char *)sendbuf + comm->rank * bytes(sendcount, sendtype), bytes(recvcount, recvtype));
+    else
+        memset(recvbuf, 0, bytes(recvcount, recvtype));
+    return MPI_SUCCESS;
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                  MPI_Datatype recvtype, MPI_Comm comm)
+{
+    gather_own(sendbuf, bytes(recvcount, recvtype), recvbuf, comm);
+    return MPI_SUCCESS;
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                 MPI_Datatype recvtype, MPI_Comm comm)
+{
+    size_t block = bytes(recvcount, recvtype);
+    gather_own(sendbuf == MPI_IN_PLACE ? sendbuf : (const char *)sendbuf + comm->rank * block, block, recvbuf, comm);
+    return MPI_SUCCESS;
+}
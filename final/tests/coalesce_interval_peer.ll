@@ -0,0 +1,39 @@
+; Regression test: mpi-coalesce reports a run of sends whose peer is a loop variable (an Interval peer)
+; without indexing past the function's rank intervals.
+;
+;   for (int i = 1; i < 4; i++) {
+;       MPI_Send(a, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
+;       MPI_Send(b, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
+;   }
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-coalesce -S %s 2>&1 | FileCheck %s
+
+; CHECK: [WARN] Not coalesced: 2 MPI_Send calls to {1..3} in Comm MPI_COMM_WORLD with Tag 0 (fan): the matching receives are not in the module
+; CHECK: [INFO] 0 run(s) of MPI_Send calls coalesced
+; CHECK-LABEL: define void @fan(
+; CHECK: call i32 @MPI_Send(i8* %a, i32 1,
+; CHECK-NEXT: call i32 @MPI_Send(i8* %b, i32 1,
+
+%struct._comm = type opaque
+%struct._dtype = type opaque
+
+@lam_mpi_comm_world = external global %struct._comm
+@lam_mpi_int = external global %struct._dtype
+
+define void @fan(i8* %a, i8* %b) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 1, %entry ], [ %inc, %loop ]
+  %0 = call i32 @MPI_Send(i8* %a, i32 1, %struct._dtype* @lam_mpi_int, i32 %i, i32 0, %struct._comm* @lam_mpi_comm_world)
+  %1 = call i32 @MPI_Send(i8* %b, i32 1, %struct._dtype* @lam_mpi_int, i32 %i, i32 0, %struct._comm* @lam_mpi_comm_world)
+  %inc = add nsw i32 %i, 1
+  %cmp = icmp slt i32 %inc, 4
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+declare i32 @MPI_Send(i8*, i32, %struct._dtype*, i32, i32, %struct._comm*)
@@ -0,0 +1,53 @@
+; mpi-coalesce packs a run of 2 + 1 ints into one message of 3 ints: the sends copy into the pack
+; buffer at byte offsets 0 & 8 before one MPI_Send, and the matching receives become one MPI_Recv
+; that is unpacked from the same offsets.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-coalesce -S %s 2>&1 | FileCheck %s
+
+; CHECK: [INFO] Coalesced 2 MPI_Send calls to 1 in Comm MPI_COMM_WORLD with Tag 5 (exchange) into one message of 12 bytes
+; CHECK: [INFO] 1 run(s) of MPI_Send calls coalesced
+
+%struct._comm = type opaque
+%struct._dtype = type opaque
+%struct._status = type { i32, i32, i32, i32 }
+
+@lam_mpi_comm_world = external global %struct._comm
+@lam_mpi_int = external global %struct._dtype
+
+; CHECK-LABEL: define void @exchange(
+; CHECK: %mpi.coalesce.buf = alloca i8, i64 12, align 16
+define void @exchange(i32 %rank, i8* %a, i8* %b) {
+entry:
+  %is0 = icmp eq i32 %rank, 0
+  br i1 %is0, label %send, label %recv
+
+; CHECK-LABEL: send:
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 %mpi.coalesce.buf, i8* align 1 %a, i64 8, i1 false)
+; CHECK-NEXT: [[SLOT:%.*]] = getelementptr inbounds i8, i8* %mpi.coalesce.buf, i64 8
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 [[SLOT]], i8* align 1 %b, i64 4, i1 false)
+; CHECK-NEXT: call i32 @MPI_Send(i8* %mpi.coalesce.buf, i32 3, %struct._dtype* @lam_mpi_int, i32 1, i32 5,
+; CHECK-NOT: @MPI_Send
+; CHECK: br label %exit
+send:
+  %s1 = call i32 @MPI_Send(i8* %a, i32 2, %struct._dtype* @lam_mpi_int, i32 1, i32 5, %struct._comm* @lam_mpi_comm_world)
+  %s2 = call i32 @MPI_Send(i8* %b, i32 1, %struct._dtype* @lam_mpi_int, i32 1, i32 5, %struct._comm* @lam_mpi_comm_world)
+  br label %exit
+
+; CHECK-LABEL: recv:
+; CHECK-NEXT: call i32 @MPI_Recv(i8* %mpi.coalesce.buf, i32 3, %struct._dtype* @lam_mpi_int, i32 0, i32 5,
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 %a, i8* align 1 %mpi.coalesce.buf, i64 8, i1 false)
+; CHECK-NEXT: [[UNPACK:%.*]] = getelementptr inbounds i8, i8* %mpi.coalesce.buf, i64 8
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 %b, i8* align 1 [[UNPACK]], i64 4, i1 false)
+; CHECK-NOT: @MPI_Recv
+; CHECK: br label %exit
+recv:
+  %r1 = call i32 @MPI_Recv(i8* %a, i32 2, %struct._dtype* @lam_mpi_int, i32 0, i32 5, %struct._comm* @lam_mpi_comm_world, %struct._status* null)
+  %r2 = call i32 @MPI_Recv(i8* %b, i32 1, %struct._dtype* @lam_mpi_int, i32 0, i32 5, %struct._comm* @lam_mpi_comm_world, %struct._status* null)
+  br label %exit
+
+exit:
+  ret void
+}
+
+declare i32 @MPI_Send(i8*, i32, %struct._dtype*, i32, i32, %struct._comm*)
+declare i32 @MPI_Recv(i8*, i32, %struct._dtype*, i32, i32, %struct._comm*, %struct._status*)
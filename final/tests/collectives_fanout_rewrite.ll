@@ -0,0 +1,59 @@
+; mpi-collectives<rewrite> replaces the fan-out `if (rank == 0) { if (size > 1) for (i = 1; i < size; i++)
+; MPI_Send(..., i, ...) } else MPI_Recv(..., 0, ...)` by MPI_Bcast on both sides of the rank guard. The
+; loop is entered straight from the size test, so it is put into simplified form to get a preheader
+; for the root's broadcast.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes='mpi-collectives<rewrite>' -S %s 2>&1 | FileCheck %s
+
+; CHECK: [INFO] Rewrote the fan-out into MPI_Bcast
+; CHECK: [INFO] 1 collective pattern(s) built from point-to-point calls, 1 rewritten
+
+; CHECK-LABEL: define void @fanout(
+; CHECK-NOT: @MPI_Send
+; CHECK: root:
+; CHECK: br i1 %has, label %[[PREHEADER:.*]], label %done
+; CHECK: [[PREHEADER]]:
+; CHECK-NEXT: call i32 @MPI_Bcast(i8* %a, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 0, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+; CHECK-NEXT: br label %loop
+; CHECK-NOT: @MPI_Send
+; CHECK: other:
+; CHECK-NEXT: call i32 @MPI_Bcast(i8* %a, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 0, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+; CHECK-NOT: @MPI_Recv(
+; CHECK-NOT: @MPI_Send(
+; CHECK: ret void
+
+%struct.ompi_communicator_t = type opaque
+%struct.ompi_datatype_t = type opaque
+@ompi_mpi_comm_world = external global %struct.ompi_communicator_t
+@ompi_mpi_int = external global %struct.ompi_datatype_t
+
+declare i32 @MPI_Send(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*)
+declare i32 @MPI_Recv(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*, i8*)
+declare i32 @MPI_Comm_size(%struct.ompi_communicator_t*, i32*)
+declare i32 @MPI_Comm_rank(%struct.ompi_communicator_t*, i32*)
+
+define void @fanout(i8* %a) {
+entry:
+  %rk = alloca i32
+  %sz = alloca i32
+  %q1 = call i32 @MPI_Comm_rank(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %rk)
+  %q2 = call i32 @MPI_Comm_size(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %sz)
+  %r = load i32, i32* %rk
+  %n = load i32, i32* %sz
+  %is0 = icmp eq i32 %r, 0
+  br i1 %is0, label %root, label %other
+root:
+  %has = icmp sgt i32 %n, 1
+  br i1 %has, label %loop, label %done
+loop:
+  %i = phi i32 [1, %root], [%i1, %loop]
+  %s = call i32 @MPI_Send(i8* %a, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %i, i32 0, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %i1 = add nuw nsw i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %loop, label %done
+other:
+  %rv = call i32 @MPI_Recv(i8* %a, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 0, i32 0, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8* null)
+  br label %done
+done:
+  ret void
+}
@@ -0,0 +1,51 @@
+; mpi-fuse packs the inputs of back-to-back MPI_Allreduce calls into the first half of one buffer
+; (2 + 1 doubles at byte offsets 0 & 16), reduces into the second half (from byte 24) with one call of
+; count 3, and copies each result back to its output buffer. A call whose input is the output of the
+; call before it is not fused.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-fuse -S %s 2>&1 | FileCheck %s
+
+; CHECK: [WARN] Not fused: MPI_Allreduce in Comm MPI_COMM_WORLD (chained) with the one before it: its buffer may depend on the output of an earlier call
+; CHECK: [INFO] Fused 2 MPI_Allreduce calls in Comm MPI_COMM_WORLD (norms) into one of 24 bytes
+; CHECK: [INFO] 1 run(s) of collectives fused
+
+%struct.ompi_communicator_t = type opaque
+%struct.ompi_datatype_t = type opaque
+%struct.ompi_op_t = type opaque
+
+@ompi_mpi_comm_world = external global %struct.ompi_communicator_t
+@ompi_mpi_double = external global %struct.ompi_datatype_t
+@ompi_mpi_op_sum = external global %struct.ompi_op_t
+
+; CHECK-LABEL: define void @norms(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %mpi.fuse.buf = alloca i8, i64 48, align 16
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 %mpi.fuse.buf, i8* align 1 %a, i64 16, i1 false)
+; CHECK-NEXT: [[B:%.*]] = getelementptr inbounds i8, i8* %mpi.fuse.buf, i64 16
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 [[B]], i8* align 1 %b, i64 8, i1 false)
+; CHECK-NEXT: [[OUT:%.*]] = getelementptr inbounds i8, i8* %mpi.fuse.buf, i64 24
+; CHECK-NEXT: %y = call i32 @MPI_Allreduce(i8* %mpi.fuse.buf, i8* [[OUT]], i32 3,
+; CHECK-NEXT: [[RA:%.*]] = getelementptr inbounds i8, i8* %mpi.fuse.buf, i64 24
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 %ra, i8* align 1 [[RA]], i64 16, i1 false)
+; CHECK-NEXT: [[RB:%.*]] = getelementptr inbounds i8, i8* %mpi.fuse.buf, i64 40
+; CHECK-NEXT: call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 1 %rb, i8* align 1 [[RB]], i64 8, i1 false)
+; CHECK-NEXT: ret void
+define void @norms(i8* noalias %a, i8* noalias %ra, i8* noalias %b, i8* noalias %rb) {
+entry:
+  %x = call i32 @MPI_Allreduce(i8* %a, i8* %ra, i32 2, %struct.ompi_datatype_t* @ompi_mpi_double, %struct.ompi_op_t* @ompi_mpi_op_sum, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %y = call i32 @MPI_Allreduce(i8* %b, i8* %rb, i32 1, %struct.ompi_datatype_t* @ompi_mpi_double, %struct.ompi_op_t* @ompi_mpi_op_sum, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  ret void
+}
+
+; CHECK-LABEL: define void @chained(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %x = call i32 @MPI_Allreduce(i8* %a, i8* %ra, i32 2,
+; CHECK-NEXT: %y = call i32 @MPI_Allreduce(i8* %ra, i8* %rb, i32 2,
+define void @chained(i8* noalias %a, i8* noalias %ra, i8* noalias %rb) {
+entry:
+  %x = call i32 @MPI_Allreduce(i8* %a, i8* %ra, i32 2, %struct.ompi_datatype_t* @ompi_mpi_double, %struct.ompi_op_t* @ompi_mpi_op_sum, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %y = call i32 @MPI_Allreduce(i8* %ra, i8* %rb, i32 2, %struct.ompi_datatype_t* @ompi_mpi_double, %struct.ompi_op_t* @ompi_mpi_op_sum, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  ret void
+}
+
+declare i32 @MPI_Allreduce(i8*, i8*, i32, %struct.ompi_datatype_t*, %struct.ompi_op_t*, %struct.ompi_communicator_t*)
@@ -0,0 +1,39 @@
+; mpi-instrument times the calls that communicate or wait, not MPI_Comm_rank; mpi-instrument<all> times
+; every call. Either way each call keeps its call-site ID (its position in the mpi-analysis report).
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-instrument -S %s | FileCheck %s --check-prefixes=CHECK,TIMED
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes='mpi-instrument<all>' -S %s | FileCheck %s --check-prefixes=CHECK,ALL
+
+%struct.ompi_communicator_t = type opaque
+%struct.ompi_datatype_t = type opaque
+
+@ompi_mpi_comm_world = external global %struct.ompi_communicator_t
+@ompi_mpi_int = external global %struct.ompi_datatype_t
+
+; CHECK: @mpi_instrument.sites = internal global [3 x %mpi_instrument.site]
+
+; CHECK-LABEL: define void @notify(
+; TIMED-NOT: @llvm.readcyclecounter
+; TIMED: call i32 @MPI_Comm_rank(
+; ALL: [[RANKSTART:%.*]] = call i64 @llvm.readcyclecounter()
+; ALL-NEXT: call i32 @MPI_Comm_rank(
+; ALL-NEXT: [[RANKEND:%.*]] = call i64 @llvm.readcyclecounter()
+; ALL-NEXT: call void @__mpi_instrument_record({{.*}}@mpi_instrument.sites, i32 0, i32 0), i64 [[RANKSTART]], i64 [[RANKEND]], i32 -1, i32 -1)
+; CHECK-NEXT: [[START:%.*]] = call i64 @llvm.readcyclecounter()
+; CHECK-NEXT: call i32 @MPI_Send(
+; CHECK-NEXT: [[END:%.*]] = call i64 @llvm.readcyclecounter()
+; CHECK-NEXT: call void @__mpi_instrument_record({{.*}}@mpi_instrument.sites, i32 0, i32 1), i64 [[START]], i64 [[END]], i32 1, i32 7)
+; CHECK-NEXT: call void @__mpi_instrument_finalize()
+; CHECK-NEXT: call i32 @MPI_Finalize()
+define void @notify(i8* %a) {
+entry:
+  %rk = alloca i32
+  %0 = call i32 @MPI_Comm_rank(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %rk)
+  %1 = call i32 @MPI_Send(i8* %a, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 1, i32 7, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %2 = call i32 @MPI_Finalize()
+  ret void
+}
+
+declare i32 @MPI_Comm_rank(%struct.ompi_communicator_t*, i32*)
+declare i32 @MPI_Send(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*)
+declare i32 @MPI_Finalize()
@@ -0,0 +1,56 @@
+; MPICH numbers MPI_ANY_SOURCE -2 and MPI_PROC_NULL -1 (Open MPI & LAM the other way round): where
+; handles are integers, the queue lint reports the receives from -2 as wildcards in both report formats,
+; not the one from -1, and mpi-coalesce does not pack the wildcard receives.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes='mpi-analysis<lint>' -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=TEXT
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes='mpi-analysis<lint;format=jsonl>' -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=JSONL
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-coalesce -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=COALESCE
+
+; TEXT: [INFO] Unexpected-Message Queue Lint
+; TEXT: [WARN] Severity 2046: MPI_Recv from MPI_ANY_SOURCE with Tag 3 in Comm MPI_COMM_WORLD (gather)
+; TEXT-NEXT: [WARN] Severity 2046: MPI_Recv from MPI_ANY_SOURCE with Tag 3 in Comm MPI_COMM_WORLD (gather)
+; TEXT-NOT: (boundary)
+
+; JSONL: {"record":"queue","kind":"wildcardReceive",{{.*}}"function":"gather","op":"MPI_Recv","peer":"MPI_ANY_SOURCE"}
+; JSONL-NOT: "record":"queue",{{.*}}"function":"boundary"
+
+; COALESCE: [WARN] Not coalesced: 2 MPI_Send calls to 0 in Comm MPI_COMM_WORLD with Tag 3 (gather): a run of receives of the tag is not coalesced
+; COALESCE: [INFO] 0 run(s) of MPI_Send calls coalesced
+
+%struct.MPI_Status = type { i32, i32, i32, i32, i32 }
+
+define void @gather(i8* %a, i8* %b) {
+entry:
+  %rk = alloca i32
+  %0 = call i32 @MPI_Comm_rank(i32 1140850688, i32* %rk)
+  %rank = load i32, i32* %rk
+  %is0 = icmp eq i32 %rank, 0
+  br i1 %is0, label %root, label %leaf
+
+root:
+  %r1 = call i32 @MPI_Recv(i8* %a, i32 2, i32 1275069445, i32 -2, i32 3, i32 1140850688, %struct.MPI_Status* null)
+  %r2 = call i32 @MPI_Recv(i8* %b, i32 1, i32 1275069445, i32 -2, i32 3, i32 1140850688, %struct.MPI_Status* null)
+  br label %exit
+
+leaf:
+  %s1 = call i32 @MPI_Send(i8* %a, i32 2, i32 1275069445, i32 0, i32 3, i32 1140850688)
+  %s2 = call i32 @MPI_Send(i8* %b, i32 1, i32 1275069445, i32 0, i32 3, i32 1140850688)
+  br label %exit
+
+exit:
+  ret void
+}
+
+; MPI_PROC_NULL in MPICH: the receive completes at once and is no wildcard
+define void @boundary(i8* %a) {
+entry:
+  %r = call i32 @MPI_Recv(i8* %a, i32 1, i32 1275069445, i32 -1, i32 4, i32 1140850688, %struct.MPI_Status* null)
+  ret void
+}
+
+declare i32 @MPI_Comm_rank(i32, i32*)
+declare i32 @MPI_Send(i8*, i32, i32, i32, i32, i32)
+declare i32 @MPI_Recv(i8*, i32, i32, i32, i32, i32, %struct.MPI_Status*)
@@ -0,0 +1,24 @@
+; Where handles are integers (MPICH), MPI_STATUS_IGNORE is (MPI_Status *)1, not a null pointer: the
+; MPI_Wait of a converted send passes it, and the request is an integer handle.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-overlap -S %s 2>&1 | FileCheck %s
+
+; CHECK: [INFO] MPI_Send in notify -> MPI_Isend + MPI_Wait after 2 instruction(s), ~2 executed per call, before a store that may access the buffer
+
+; CHECK-LABEL: define void @notify(
+; CHECK: %mpi.request = alloca i32
+; CHECK: call i32 @MPI_Isend(i8* %a, i32 4, i32 1275069445, i32 1, i32 0, i32 1140850688, i32* %mpi.request)
+; CHECK-NEXT: %x = load i8, i8* %b
+; CHECK-NEXT: %y = add i8 %x, 1
+; CHECK-NEXT: call i32 @MPI_Wait(i32* %mpi.request, i8* inttoptr (i64 1 to i8*))
+; CHECK-NEXT: store i8 %y, i8* %b
+define void @notify(i8* %a, i8* %b) {
+entry:
+  %r = call i32 @MPI_Send(i8* %a, i32 4, i32 1275069445, i32 1, i32 0, i32 1140850688)
+  %x = load i8, i8* %b
+  %y = add i8 %x, 1
+  store i8 %y, i8* %b
+  ret void
+}
+
+declare i32 @MPI_Send(i8*, i32, i32, i32, i32, i32)
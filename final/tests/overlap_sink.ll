@@ -0,0 +1,94 @@
+; mpi-overlap turns blocking sends & receives into MPI_Isend/MPI_Irecv and sinks each MPI_Wait until an
+; instruction may access the buffer: with noalias buffers both waits of a Send;Recv pair pass the loop
+; that follows, and the receive's wait lands before the load of its buffer. A buffer that may alias
+; the next store keeps the send blocking.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-overlap -S %s 2>&1 | FileCheck %s
+
+; CHECK: [INFO] MPI_Send in exchange -> MPI_Isend + MPI_Wait after 15 instruction(s), ~447 executed per call, before the exits of the function
+; CHECK: [INFO] MPI_Recv in exchange -> MPI_Irecv + MPI_Wait after 14 instruction(s), ~446 executed per call, before a load that may access the buffer
+; CHECK: [INFO] MPI_Send in loop_alias -> MPI_Isend + MPI_Wait after 3 instruction(s), ~96 executed per call, before a store that may access the buffer
+; CHECK: [INFO] MPI_Send in aliased stays blocking: nothing to overlap before a store that may access the buffer
+; CHECK: [INFO] 3 of 4 blocking call(s) overlapped with computation
+
+%struct.ompi_communicator_t = type opaque
+%struct.ompi_datatype_t = type opaque
+
+@ompi_mpi_comm_world = external global %struct.ompi_communicator_t
+@ompi_mpi_double = external global %struct.ompi_datatype_t
+
+; CHECK-LABEL: define double @exchange(
+; CHECK: call i32 @MPI_Isend(i8* %ob, i32 8, %struct.ompi_datatype_t* @ompi_mpi_double, i32 %peer, i32 1, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8** [[SEND:%mpi.request[0-9]*]])
+; CHECK-NEXT: call i32 @MPI_Irecv(i8* %ib, i32 8, %struct.ompi_datatype_t* @ompi_mpi_double, i32 %peer, i32 1, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8** [[RECV:%mpi.request[0-9]*]])
+; CHECK-NEXT: br label %loop
+; CHECK: loop:
+; CHECK-NOT: @MPI_Wait
+; CHECK: done:
+; CHECK-NEXT: call i32 @MPI_Wait(i8** [[RECV]], i8* null)
+; CHECK-NEXT: %x = load double, double* %in
+; CHECK-NEXT: call i32 @MPI_Wait(i8** [[SEND]], i8* null)
+; CHECK-NEXT: ret double %x
+define double @exchange(double* noalias %out, double* noalias %in, double* noalias %work, i32 %n, i32 %peer) {
+entry:
+  %ob = bitcast double* %out to i8*
+  %ib = bitcast double* %in to i8*
+  %s = call i32 @MPI_Send(i8* %ob, i32 8, %struct.ompi_datatype_t* @ompi_mpi_double, i32 %peer, i32 1, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %r = call i32 @MPI_Recv(i8* %ib, i32 8, %struct.ompi_datatype_t* @ompi_mpi_double, i32 %peer, i32 1, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8* null)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = getelementptr double, double* %work, i32 %i
+  %v = load double, double* %p
+  %v2 = fmul double %v, 2.0
+  store double %v2, double* %p
+  %i.next = add i32 %i, 1
+  %more = icmp slt i32 %i.next, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  %x = load double, double* %in
+  ret double %x
+}
+
+; CHECK-LABEL: define double @loop_alias(
+; CHECK: call i32 @MPI_Isend(
+; CHECK: %v2 = fmul double %v, 2.0
+; CHECK-NEXT: call i32 @MPI_Wait(i8** %mpi.request, i8* null)
+; CHECK-NEXT: store double %v2, double* %p
+define double @loop_alias(double* %out, double* %in, double* %work, i32 %n, i32 %peer) {
+entry:
+  %ob = bitcast double* %out to i8*
+  %s = call i32 @MPI_Send(i8* %ob, i32 8, %struct.ompi_datatype_t* @ompi_mpi_double, i32 %peer, i32 2, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = getelementptr double, double* %work, i32 %i
+  %v = load double, double* %p
+  %v2 = fmul double %v, 2.0
+  store double %v2, double* %p
+  %i.next = add i32 %i, 1
+  %more = icmp slt i32 %i.next, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  %x = load double, double* %in
+  ret double %x
+}
+
+; CHECK-LABEL: define void @aliased(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %ob = bitcast double* %out to i8*
+; CHECK-NEXT: call i32 @MPI_Send(i8* %ob,
+; CHECK-NEXT: store double 0.0
+define void @aliased(double* %out, double* %work, i32 %peer) {
+entry:
+  %ob = bitcast double* %out to i8*
+  %s = call i32 @MPI_Send(i8* %ob, i32 8, %struct.ompi_datatype_t* @ompi_mpi_double, i32 %peer, i32 3, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  store double 0.0, double* %work
+  ret void
+}
+
+declare i32 @MPI_Send(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*)
+declare i32 @MPI_Recv(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*, i8*)
@@ -0,0 +1,145 @@
+; mpi-persistent turns a send repeated with invariant arguments in a loop into a persistent request:
+; MPI_Send_init on the first execution (guarded by a created flag that starts false), MPI_Start &
+; MPI_Wait on every execution, and a guarded MPI_Request_free that resets the flag on each exit of the
+; loop. A buffer that changes between iterations, or a peer loaded from memory that a store in the loop
+; may write (the slot of the peer, through a select), keeps the send as is; a store to another slot
+; does not.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-persistent -S %s 2>&1 | FileCheck %s
+
+; CHECK: [INFO] MPI_Send in halo -> MPI_Send_init + MPI_Start/MPI_Wait in the loop at loop (depth 1)
+; CHECK: [INFO] MPI_Send in variant_buffer stays as is: the buffer may change between iterations
+; CHECK: [INFO] MPI_Send in aliasing_store stays as is: the peer may change between iterations
+; CHECK: [INFO] MPI_Send in private_store -> MPI_Send_init + MPI_Start/MPI_Wait in the loop at loop (depth 1)
+; CHECK: [INFO] 2 of 4 send(s) & receive(s) in loops turned into persistent requests
+
+%struct.ompi_communicator_t = type opaque
+%struct.ompi_datatype_t = type opaque
+
+@ompi_mpi_comm_world = external global %struct.ompi_communicator_t
+@ompi_mpi_int = external global %struct.ompi_datatype_t
+
+; CHECK-LABEL: define void @halo(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %mpi.persistent = alloca i8*
+; CHECK-NEXT: %mpi.persistent.created = alloca i1
+; CHECK-NEXT: store i1 false, i1* %mpi.persistent.created
+; CHECK: body:
+; CHECK-NEXT: [[CREATED:%.*]] = load i1, i1* %mpi.persistent.created
+; CHECK-NEXT: [[FIRST:%.*]] = xor i1 [[CREATED]], true
+; CHECK-NEXT: br i1 [[FIRST]], label %[[INIT:.*]], label %[[START:.*]]
+; CHECK: [[INIT]]:
+; CHECK-NEXT: call i32 @MPI_Send_init(i8* %a, i32 4, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %peer, i32 1, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8** %mpi.persistent)
+; CHECK-NEXT: store i1 true, i1* %mpi.persistent.created
+; CHECK-NEXT: br label %[[START]]
+; CHECK: [[START]]:
+; CHECK-NEXT: call i32 @MPI_Start(i8** %mpi.persistent)
+; CHECK-NEXT: call i32 @MPI_Wait(i8** %mpi.persistent, i8* null)
+; CHECK-NEXT: br i1 %stop, label %early, label %latch
+; CHECK: early:
+; CHECK-NEXT: [[LIVE:%.*]] = load i1, i1* %mpi.persistent.created
+; CHECK-NEXT: br i1 [[LIVE]], label %[[FREE:.*]], label %[[RET:.*]]
+; CHECK: [[FREE]]:
+; CHECK-NEXT: call i32 @MPI_Request_free(i8** %mpi.persistent)
+; CHECK-NEXT: store i1 false, i1* %mpi.persistent.created
+; CHECK: [[RET]]:
+; CHECK-NEXT: ret void
+; CHECK: done:
+; CHECK-NEXT: [[LIVE2:%.*]] = load i1, i1* %mpi.persistent.created
+; CHECK-NEXT: br i1 [[LIVE2]], label %[[FREE2:.*]], label %[[RET2:.*]]
+; CHECK: [[FREE2]]:
+; CHECK-NEXT: call i32 @MPI_Request_free(i8** %mpi.persistent)
+; CHECK-NEXT: store i1 false, i1* %mpi.persistent.created
+; CHECK: [[RET2]]:
+; CHECK-NEXT: ret void
+define void @halo(i8* %a, i32 %peer, i32 %n, i1 %stop) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %more = icmp slt i32 %i, %n
+  br i1 %more, label %body, label %done
+
+body:
+  %s = call i32 @MPI_Send(i8* %a, i32 4, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %peer, i32 1, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  br i1 %stop, label %early, label %latch
+
+latch:
+  %i.next = add nsw i32 %i, 1
+  br label %loop
+
+early:
+  ret void
+
+done:
+  ret void
+}
+
+; CHECK-LABEL: define void @variant_buffer(
+; CHECK: call i32 @MPI_Send(i8* %b,
+; CHECK-NOT: @MPI_Send_init
+define void @variant_buffer(i32* %a, i32 %peer, i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = getelementptr i32, i32* %a, i32 %i
+  %b = bitcast i32* %p to i8*
+  %s = call i32 @MPI_Send(i8* %b, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %peer, i32 2, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %i.next = add nsw i32 %i, 1
+  %more = icmp slt i32 %i.next, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  ret void
+}
+
+; CHECK-LABEL: define void @aliasing_store(
+; CHECK: call i32 @MPI_Send(i8* %a,
+; CHECK-NOT: @MPI_Send_init
+define void @aliasing_store(i8* %a, i32 %to, i32 %n, i1 %c) {
+entry:
+  %slot = alloca i32
+  %counter = alloca i32
+  store i32 %to, i32* %slot
+  %q = select i1 %c, i32* %slot, i32* %counter
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %peer = load i32, i32* %slot
+  %s = call i32 @MPI_Send(i8* %a, i32 4, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %peer, i32 3, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  store i32 %i, i32* %q
+  %i.next = add nsw i32 %i, 1
+  %more = icmp slt i32 %i.next, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  ret void
+}
+
+; CHECK-LABEL: define void @private_store(
+; CHECK: call i32 @MPI_Send_init(i8* %a, i32 4, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %peer, i32 4,
+define void @private_store(i8* %a, i32 %to, i32 %n) {
+entry:
+  %slot = alloca i32
+  %counter = alloca i32
+  store i32 %to, i32* %slot
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %peer = load i32, i32* %slot
+  %s = call i32 @MPI_Send(i8* %a, i32 4, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %peer, i32 4, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  store i32 %i, i32* %counter
+  %i.next = add nsw i32 %i, 1
+  %more = icmp slt i32 %i.next, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  ret void
+}
+
+declare i32 @MPI_Send(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*)
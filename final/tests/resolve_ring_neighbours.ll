@@ -0,0 +1,80 @@
+; The left neighbour of a ring, (rank - 1 + size) % size or (rank + size - 1) % size, resolves to
+; (rank-1)%size and matches the send to (rank+1)%size in the unmatched-shift report; a receive from
+; (rank-2)%size still has no matching send.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes=mpi-analysis -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --implicit-check-not="has no matching"
+
+; CHECK: MPI_Send: comm=MPI_COMM_WORLD, tag=7, rank=(rank+1)%size
+; CHECK: MPI_Recv: comm=MPI_COMM_WORLD, tag=7, rank=(rank-1)%size
+; CHECK: MPI_Send: comm=MPI_COMM_WORLD, tag=8, rank=(rank+1)%size
+; CHECK: MPI_Recv: comm=MPI_COMM_WORLD, tag=8, rank=(rank-1)%size
+; CHECK: MPI_Send: comm=MPI_COMM_WORLD, tag=9, rank=(rank+1)%size
+; CHECK: MPI_Recv: comm=MPI_COMM_WORLD, tag=9, rank=(rank-2)%size
+; CHECK: [WARN] MPI_Send with peer (rank+1)%size in Comm MPI_COMM_WORLD with Tag 9 has no matching receive
+; CHECK: [WARN] MPI_Recv with peer (rank-2)%size in Comm MPI_COMM_WORLD with Tag 9 has no matching send
+
+%struct.ompi_communicator_t = type opaque
+%struct.ompi_datatype_t = type opaque
+
+@ompi_mpi_comm_world = external global %struct.ompi_communicator_t
+@ompi_mpi_int = external global %struct.ompi_datatype_t
+
+define void @ring(i8* %out, i8* %in) {
+entry:
+  %rk = alloca i32
+  %sz = alloca i32
+  %0 = call i32 @MPI_Comm_rank(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %rk)
+  %1 = call i32 @MPI_Comm_size(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %sz)
+  %rank = load i32, i32* %rk
+  %size = load i32, i32* %sz
+  %next = add nsw i32 %rank, 1
+  %right = srem i32 %next, %size
+  %s = call i32 @MPI_Send(i8* %out, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %right, i32 7, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %prev = sub nsw i32 %rank, 1
+  %wrap = add nsw i32 %prev, %size
+  %left = srem i32 %wrap, %size
+  %r = call i32 @MPI_Recv(i8* %in, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %left, i32 7, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8* null)
+  ret void
+}
+
+define void @ring_size_first(i8* %out, i8* %in) {
+entry:
+  %rk = alloca i32
+  %sz = alloca i32
+  %0 = call i32 @MPI_Comm_rank(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %rk)
+  %1 = call i32 @MPI_Comm_size(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %sz)
+  %rank = load i32, i32* %rk
+  %size = load i32, i32* %sz
+  %next = add nsw i32 %rank, 1
+  %right = srem i32 %next, %size
+  %s = call i32 @MPI_Send(i8* %out, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %right, i32 8, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %wrap = add nsw i32 %rank, %size
+  %prev = sub nsw i32 %wrap, 1
+  %left = srem i32 %prev, %size
+  %r = call i32 @MPI_Recv(i8* %in, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %left, i32 8, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8* null)
+  ret void
+}
+
+define void @ring_skip(i8* %out, i8* %in) {
+entry:
+  %rk = alloca i32
+  %sz = alloca i32
+  %0 = call i32 @MPI_Comm_rank(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %rk)
+  %1 = call i32 @MPI_Comm_size(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %sz)
+  %rank = load i32, i32* %rk
+  %size = load i32, i32* %sz
+  %next = add nsw i32 %rank, 1
+  %right = srem i32 %next, %size
+  %s = call i32 @MPI_Send(i8* %out, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %right, i32 9, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %wrap = add nsw i32 %rank, %size
+  %prev = sub nsw i32 %wrap, 2
+  %left = srem i32 %prev, %size
+  %r = call i32 @MPI_Recv(i8* %in, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %left, i32 9, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8* null)
+  ret void
+}
+
+declare i32 @MPI_Send(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*)
+declare i32 @MPI_Recv(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*, i8*)
+declare i32 @MPI_Comm_size(%struct.ompi_communicator_t*, i32*)
+declare i32 @MPI_Comm_rank(%struct.ompi_communicator_t*, i32*)
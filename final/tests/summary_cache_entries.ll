@@ -0,0 +1,72 @@
+; Cached summaries are written field by field: two runs write byte-identical entries (no uninitialized
+; padding), and a run that hits the cache reports the same calls as the run that analyzed them.
+;
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes='mpi-analysis<cache-dir=%t/a>' -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefixes=CHECK,MISS
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes='mpi-analysis<cache-dir=%t/b>' -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefixes=CHECK,MISS
+; RUN: diff -r %t/a %t/b
+; RUN: opt -load-pass-plugin=./MPIAnalysisPass.so -passes='mpi-analysis<cache-dir=%t/a>' -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefixes=CHECK,HIT
+
+; CHECK: [INFO] Detected MPI MPI_Send: comm=MPI_COMM_WORLD, tag=7, rank=(rank+1)%size, bytes=4, freq=1
+; CHECK: [INFO] Detected MPI MPI_Recv: comm=MPI_COMM_WORLD, tag=7, rank=(rank-1)%size, bytes=4, freq=1
+; CHECK: [INFO] Detected MPI MPI_Send: comm=MPI_COMM_WORLD, tag=8, rank=?, bytes=4, freq=~12.75
+; CHECK: [INFO] Detected MPI MPI_Recv: comm=MPI_COMM_WORLD, tag=8, rank=0, bytes=4, freq=1, executing={1..size-1}
+; MISS: [INFO] Summary cache: 0 of 2 function(s) unchanged
+; HIT: [INFO] Summary cache: 2 of 2 function(s) unchanged
+
+%struct.ompi_communicator_t = type opaque
+%struct.ompi_datatype_t = type opaque
+
+@ompi_mpi_comm_world = external global %struct.ompi_communicator_t
+@ompi_mpi_int = external global %struct.ompi_datatype_t
+
+define void @ring(i8* %out, i8* %in) {
+entry:
+  %rk = alloca i32
+  %sz = alloca i32
+  %0 = call i32 @MPI_Comm_rank(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %rk)
+  %1 = call i32 @MPI_Comm_size(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %sz)
+  %rank = load i32, i32* %rk
+  %size = load i32, i32* %sz
+  %next = add nsw i32 %rank, 1
+  %right = srem i32 %next, %size
+  %s = call i32 @MPI_Send(i8* %out, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %right, i32 7, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %prev = sub nsw i32 %rank, 1
+  %wrap = add nsw i32 %prev, %size
+  %left = srem i32 %wrap, %size
+  %r = call i32 @MPI_Recv(i8* %in, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %left, i32 7, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8* null)
+  ret void
+}
+
+define void @fanout(i8* %a) {
+entry:
+  %rk = alloca i32
+  %sz = alloca i32
+  %0 = call i32 @MPI_Comm_rank(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %rk)
+  %1 = call i32 @MPI_Comm_size(%struct.ompi_communicator_t* @ompi_mpi_comm_world, i32* %sz)
+  %r = load i32, i32* %rk
+  %n = load i32, i32* %sz
+  %is0 = icmp eq i32 %r, 0
+  br i1 %is0, label %loop, label %other
+
+loop:
+  %i = phi i32 [ 1, %entry ], [ %i1, %loop ]
+  %s = call i32 @MPI_Send(i8* %a, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 %i, i32 8, %struct.ompi_communicator_t* @ompi_mpi_comm_world)
+  %i1 = add nuw nsw i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %loop, label %done
+
+other:
+  %rv = call i32 @MPI_Recv(i8* %a, i32 1, %struct.ompi_datatype_t* @ompi_mpi_int, i32 0, i32 8, %struct.ompi_communicator_t* @ompi_mpi_comm_world, i8* null)
+  br label %done
+
+done:
+  ret void
+}
+
+declare i32 @MPI_Send(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*)
+declare i32 @MPI_Recv(i8*, i32, %struct.ompi_datatype_t*, i32, i32, %struct.ompi_communicator_t*, i8*)
+declare i32 @MPI_Comm_size(%struct.ompi_communicator_t*, i32*)
+declare i32 @MPI_Comm_rank(%struct.ompi_communicator_t*, i32*)